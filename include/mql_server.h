@@ -14,16 +14,56 @@
 extern "C" {
 #endif
 
-//  This is the mql_server constructor as a zactor_fn;
+//  This is the mql_server constructor as a zactor_fn; once initialized the
+//  actor sends STARTED, or FAILED and ends if the config can't be applied
 MQL_EXPORT void
     mql_server_actor (zsock_t *pipe, void *args);
 
+//  Start the server, return NULL if it failed to start
 MQL_EXPORT zactor_t *
     mql_server_new (zconfig_t *config);
 
 MQL_EXPORT void
     mql_server_destroy (zactor_t **self_p);
 
+//  Completion of a message sent from within the process, called with the
+//  status code, as over http, and the reply body, which it may take.
+typedef void (mql_server_reply_fn) (int status_code, zframe_t **body_p, void *arg);
+
+//  Connect the calling thread to the server, to send messages from within the
+//  process. The messages and their replies go over the returned socket, not
+//  the actor pipe; it belongs to the calling thread, which destroys it with
+//  mql_server_disconnect. Returns NULL if the server can't connect it.
+MQL_EXPORT zsock_t *
+    mql_server_connect (zactor_t *self);
+
+//  Disconnect the client, the replies still to come to it are dropped.
+MQL_EXPORT void
+    mql_server_disconnect (zactor_t *self, zsock_t **client_p);
+
+//  Send a message to the actor at address, "type/id", from within the process
+//  instead of over http. The headers, NULL for none, are the ones of POST
+//  /send: X-Mql-Timeout, X-Mql-Priority, X-Mql-Ttl, Idempotency-Key and the
+//  tenant header, with these exact names. The message goes through the same
+//  checks as from http: the rates of the tenant, actor type and subject, the
+//  body size, the json, the mailbox quota, the reply cache and the idempotency
+//  key. The body frame must be valid json, the server takes ownership of it
+//  and queues its data without a copy. The callback, if not NULL, is called
+//  with the arg by mql_server_recv_reply once the reply comes.
+//  The server doesn't read the messages of a client while replies wait for
+//  room on its socket, so this blocks once the socket is full, until the
+//  replies are received. Returns 0 if sent, -1 if interrupted.
+MQL_EXPORT int
+    mql_server_request (zsock_t *client, const char *address, const char *subject, zhash_t *headers,
+                        zframe_t **body_p, mql_server_reply_fn *callback, void *arg);
+
+//  Receive the next reply to a message sent with mql_server_request, in the
+//  order the replies complete, and call its callback. Poll the client, or add
+//  it to a zloop, to complete the messages as their replies come. Returns the
+//  status code, or -1 if interrupted.
+MQL_EXPORT int
+    mql_server_recv_reply (zsock_t *client);
+
 //  Self test of this actor
 MQL_EXPORT void
     mql_server_test (bool verbose);
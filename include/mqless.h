@@ -27,4 +27,16 @@
 #define MQL_SOURCE_FUNCTION 1
 #define MQL_SOURCE_MQL      2
 
+//  Native actors are shared libraries exporting a handler with this name.
+//  The handler receives the same json envelope a lambda actor receives and
+//  returns a json response allocated with malloc, or NULL on failure.
+//  Handlers are called concurrently from the worker threads. Calls for the
+//  same actor are serialized, unless its type has a parallelism above 1:
+//  the readonly and reentrant subjects then run alongside other calls for
+//  the actor, and all the calls of a stateless type share the parallelism
+//  regardless of the actor. The handlers of such types must be thread safe.
+#define MQL_ACTOR_HANDLER "mql_actor_handler"
+
+typedef char * (mql_actor_handler_fn) (const char *request);
+
 #endif
@@ -0,0 +1,408 @@
+#include "mql_classes.h"
+
+struct _actor_type_t {
+    char *name;
+    actor_type_invoke_fn *invoke;
+    void *backend;
+    int timeout;
+    quota_t *quota;
+    size_t mailbox_length;
+    size_t mailbox_bytes;
+    actor_type_overflow_t overflow;
+    zhashx_t *subjects;         //  Access of the subjects which are not writes
+    int parallelism;
+    bool stateless;
+    zhashx_t *priorities;       //  Priority plus one of the configured subjects
+    bool weighted;
+    zhashx_t *cache_ttls;       //  Milliseconds the replies of the cacheable subjects are kept
+    zhashx_t *ttls;             //  Milliseconds the messages of the subjects are worth invoking
+    zhashx_t *coalesced;        //  Subjects of which only the latest pending message is kept
+    size_t expired;             //  Messages expired before they were invoked
+    bucket_t *bucket;           //  Rate of messages sent by http callers, if limited
+    zhashx_t *buckets;          //  Rates of the limited subjects
+    limiter_t *limiter;         //  Adaptive concurrency of the function, if enabled
+    zlistx_t *waiting;          //  Mailboxes waiting for the limiter
+    warmer_t *warmer;           //  Warm containers of the function, if warmed
+    breaker_t *breaker;         //  Circuit breaker of the function, if enabled
+    bool fail_fast;             //  Fail the messages while the breaker is open instead of waiting
+};
+
+actor_type_t *
+actor_type_new (const char *name, actor_type_invoke_fn *invoke, void *backend) {
+    assert (name);
+    assert (invoke);
+
+    actor_type_t *self = (actor_type_t *) zmalloc (sizeof (actor_type_t));
+    assert (self);
+
+    self->name = strdup (name);
+    self->invoke = invoke;
+    self->backend = backend;
+    self->quota = quota_new (0, 0);
+    self->overflow = ACTOR_TYPE_REJECT;
+    self->subjects = zhashx_new ();
+    self->parallelism = 1;
+    self->priorities = zhashx_new ();
+    self->cache_ttls = zhashx_new ();
+    self->ttls = zhashx_new ();
+    self->coalesced = zhashx_new ();
+    self->buckets = zhashx_new ();
+    zhashx_set_destructor (self->buckets, (czmq_destructor *) bucket_destroy);
+    self->waiting = zlistx_new ();
+
+    return self;
+}
+
+void actor_type_destroy (actor_type_t **self_p) {
+    assert (self_p);
+    actor_type_t *self = *self_p;
+
+    if (self) {
+        zstr_free (&self->name);
+        quota_destroy (&self->quota);
+        zhashx_destroy (&self->subjects);
+        zhashx_destroy (&self->priorities);
+        zhashx_destroy (&self->cache_ttls);
+        zhashx_destroy (&self->ttls);
+        zhashx_destroy (&self->coalesced);
+        bucket_destroy (&self->bucket);
+        zhashx_destroy (&self->buckets);
+        limiter_destroy (&self->limiter);
+        zlistx_destroy (&self->waiting);
+        warmer_destroy (&self->warmer);
+        breaker_destroy (&self->breaker);
+
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+const char *actor_type_name (actor_type_t *self) {
+    assert (self);
+    return self->name;
+}
+
+void *actor_type_backend (actor_type_t *self) {
+    assert (self);
+    return self->backend;
+}
+
+int actor_type_timeout (actor_type_t *self) {
+    assert (self);
+    return self->timeout;
+}
+
+void actor_type_set_timeout (actor_type_t *self, int timeout) {
+    assert (self);
+    self->timeout = timeout;
+}
+
+void actor_type_set_limits (actor_type_t *self, size_t mailbox_length, size_t mailbox_bytes,
+                            size_t length, size_t bytes, actor_type_overflow_t overflow) {
+    assert (self);
+    assert (quota_length (self->quota) == 0);
+
+    quota_destroy (&self->quota);
+    self->quota = quota_new (length, bytes);
+    self->mailbox_length = mailbox_length;
+    self->mailbox_bytes = mailbox_bytes;
+    self->overflow = overflow;
+}
+
+quota_t *actor_type_quota (actor_type_t *self) {
+    assert (self);
+    return self->quota;
+}
+
+quota_t *actor_type_new_mailbox_quota (actor_type_t *self) {
+    assert (self);
+    return quota_new (self->mailbox_length, self->mailbox_bytes);
+}
+
+actor_type_overflow_t actor_type_overflow (actor_type_t *self) {
+    assert (self);
+    return self->overflow;
+}
+
+void actor_type_set_access (actor_type_t *self, const char *subject, actor_type_access_t access) {
+    assert (self);
+
+    if (access == ACTOR_TYPE_WRITE)
+        zhashx_delete (self->subjects, subject);
+    else
+        zhashx_update (self->subjects, subject, (void *) (intptr_t) access);
+}
+
+actor_type_access_t actor_type_access (actor_type_t *self, const char *subject) {
+    assert (self);
+
+    if (self->stateless)
+        return ACTOR_TYPE_REENTRANT;
+
+    return (actor_type_access_t) (intptr_t) zhashx_lookup (self->subjects, subject);
+}
+
+void actor_type_set_parallelism (actor_type_t *self, int parallelism) {
+    assert (self);
+    assert (parallelism > 0);
+    self->parallelism = parallelism;
+}
+
+int actor_type_parallelism (actor_type_t *self) {
+    assert (self);
+    return self->parallelism;
+}
+
+void actor_type_set_priority (actor_type_t *self, const char *subject, int priority) {
+    assert (self);
+    assert (priority >= 0 && priority < ACTOR_TYPE_PRIORITIES);
+    zhashx_update (self->priorities, subject, (void *) (intptr_t) (priority + 1));
+}
+
+int actor_type_priority (actor_type_t *self, const char *subject) {
+    assert (self);
+
+    intptr_t priority = (intptr_t) zhashx_lookup (self->priorities, subject);
+    return priority ? (int) priority - 1 : ACTOR_TYPE_DEFAULT_PRIORITY;
+}
+
+void actor_type_set_weighted (actor_type_t *self, bool weighted) {
+    assert (self);
+    self->weighted = weighted;
+}
+
+bool actor_type_weighted (actor_type_t *self) {
+    assert (self);
+    return self->weighted;
+}
+
+void actor_type_set_stateless (actor_type_t *self, bool stateless) {
+    assert (self);
+    self->stateless = stateless;
+}
+
+bool actor_type_stateless (actor_type_t *self) {
+    assert (self);
+    return self->stateless;
+}
+
+void actor_type_set_cache_ttl (actor_type_t *self, const char *subject, int ttl) {
+    assert (self);
+    assert (ttl > 0);
+    zhashx_update (self->cache_ttls, subject, (void *) (intptr_t) ttl);
+}
+
+int actor_type_cache_ttl (actor_type_t *self, const char *subject) {
+    assert (self);
+    return (int) (intptr_t) zhashx_lookup (self->cache_ttls, subject);
+}
+
+void actor_type_set_ttl (actor_type_t *self, const char *subject, int ttl) {
+    assert (self);
+
+    if (ttl <= 0) {
+        zsys_warning ("Actor type: ttl of %s %s must be positive, not expiring", self->name, subject);
+        return;
+    }
+    zhashx_update (self->ttls, subject, (void *) (intptr_t) ttl);
+}
+
+int actor_type_ttl (actor_type_t *self, const char *subject) {
+    assert (self);
+    return zhashx_size (self->ttls) ? (int) (intptr_t) zhashx_lookup (self->ttls, subject) : 0;
+}
+
+void actor_type_set_coalesced (actor_type_t *self, const char *subject) {
+    assert (self);
+    zhashx_update (self->coalesced, subject, (void *) self);
+}
+
+bool actor_type_coalesced (actor_type_t *self, const char *subject) {
+    assert (self);
+    return zhashx_size (self->coalesced) && zhashx_lookup (self->coalesced, subject) != NULL;
+}
+
+void actor_type_count_expired (actor_type_t *self) {
+    assert (self);
+    self->expired++;
+}
+
+size_t actor_type_expired (actor_type_t *self) {
+    assert (self);
+    return self->expired;
+}
+
+void actor_type_set_rate (actor_type_t *self, const char *subject, double rate, double burst) {
+    assert (self);
+
+    bucket_t *bucket = bucket_new (rate, burst);
+    if (subject)
+        zhashx_update (self->buckets, subject, bucket);
+    else {
+        bucket_destroy (&self->bucket);
+        self->bucket = bucket;
+    }
+}
+
+bucket_t *actor_type_bucket (actor_type_t *self, const char *subject) {
+    assert (self);
+
+    if (subject)
+        return zhashx_size (self->buckets) ? (bucket_t *) zhashx_lookup (self->buckets, subject) : NULL;
+    return self->bucket;
+}
+
+void actor_type_set_limiter (actor_type_t *self, limiter_t **limiter_p) {
+    assert (self);
+    assert (limiter_p);
+
+    limiter_destroy (&self->limiter);
+    self->limiter = *limiter_p;
+    *limiter_p = NULL;
+}
+
+limiter_t *actor_type_limiter (actor_type_t *self) {
+    assert (self);
+    return self->limiter;
+}
+
+void actor_type_wait (actor_type_t *self, void *mailbox) {
+    assert (self);
+    zlistx_add_end (self->waiting, mailbox);
+}
+
+void *actor_type_next_waiting (actor_type_t *self) {
+    assert (self);
+    return zlistx_size (self->waiting) ? zlistx_detach (self->waiting, NULL) : NULL;
+}
+
+void actor_type_set_warmer (actor_type_t *self, warmer_t **warmer_p) {
+    assert (self);
+    assert (warmer_p);
+
+    warmer_destroy (&self->warmer);
+    self->warmer = *warmer_p;
+    *warmer_p = NULL;
+}
+
+warmer_t *actor_type_warmer (actor_type_t *self) {
+    assert (self);
+    return self->warmer;
+}
+
+void actor_type_set_breaker (actor_type_t *self, breaker_t **breaker_p, bool fail_fast) {
+    assert (self);
+    assert (breaker_p);
+
+    breaker_destroy (&self->breaker);
+    self->breaker = *breaker_p;
+    self->fail_fast = fail_fast;
+    *breaker_p = NULL;
+}
+
+breaker_t *actor_type_breaker (actor_type_t *self) {
+    assert (self);
+    return self->breaker;
+}
+
+bool actor_type_fail_fast (actor_type_t *self) {
+    assert (self);
+    return self->fail_fast;
+}
+
+int actor_type_invoke (actor_type_t *self, char **content, aws_lambda_callback_fn callback, void *arg) {
+    assert (self);
+    return self->invoke (self->backend, self->name, content, callback, arg);
+}
+
+static int
+actor_type_test_invoke (void *backend, const char *function_name, char **content,
+                        aws_lambda_callback_fn callback, void *arg) {
+    assert (streq (function_name, "counter"));
+    zstr_free ((char **) backend);
+    *(char **) backend = *content;
+    *content = NULL;
+    callback (arg, NULL);
+    return 0;
+}
+
+static void
+actor_type_test_callback (void *arg, zhttp_response_t *response) {
+    (*(int *) arg)++;
+}
+
+void actor_type_test (bool verbose) {
+    printf (" * actor_type: ");
+
+    char *invoked = NULL;
+    actor_type_t *self = actor_type_new ("counter", actor_type_test_invoke, &invoked);
+    assert (streq (actor_type_name (self), "counter"));
+    assert (actor_type_backend (self) == &invoked);
+
+    //  The backend takes the content and calls back
+    int completed = 0;
+    char *content = strdup ("{}");
+    assert (actor_type_invoke (self, &content, actor_type_test_callback, &completed) == 0);
+    assert (content == NULL);
+    assert (streq (invoked, "{}"));
+    assert (completed == 1);
+    zstr_free (&invoked);
+
+    //  Subjects are writes unless declared otherwise, all reentrant when stateless
+    actor_type_set_access (self, "get", ACTOR_TYPE_READONLY);
+    assert (actor_type_access (self, "get") == ACTOR_TYPE_READONLY);
+    assert (actor_type_access (self, "inc") == ACTOR_TYPE_WRITE);
+    actor_type_set_access (self, "get", ACTOR_TYPE_WRITE);
+    assert (actor_type_access (self, "get") == ACTOR_TYPE_WRITE);
+    actor_type_set_stateless (self, true);
+    assert (actor_type_access (self, "inc") == ACTOR_TYPE_REENTRANT);
+    actor_type_set_stateless (self, false);
+
+    //  Priorities of the configured subjects, the default for the others
+    actor_type_set_priority (self, "alarm", 0);
+    assert (actor_type_priority (self, "alarm") == 0);
+    assert (actor_type_priority (self, "inc") == ACTOR_TYPE_DEFAULT_PRIORITY);
+
+    //  Ttls of the configured subjects, others never expire and bad values are skipped
+    assert (actor_type_ttl (self, "tick") == 0);
+    actor_type_set_ttl (self, "tick", 500);
+    actor_type_set_ttl (self, "inc", 0);
+    actor_type_set_ttl (self, "get", -1);
+    assert (actor_type_ttl (self, "tick") == 500);
+    assert (actor_type_ttl (self, "inc") == 0);
+    assert (actor_type_ttl (self, "get") == 0);
+    actor_type_set_ttl (self, "tick", 0);
+    assert (actor_type_ttl (self, "tick") == 500);
+
+    //  Cached and coalesced subjects
+    actor_type_set_cache_ttl (self, "get", 1000);
+    assert (actor_type_cache_ttl (self, "get") == 1000);
+    assert (actor_type_cache_ttl (self, "inc") == 0);
+    assert (!actor_type_coalesced (self, "position"));
+    actor_type_set_coalesced (self, "position");
+    assert (actor_type_coalesced (self, "position"));
+    assert (!actor_type_coalesced (self, "inc"));
+
+    //  Expired messages are counted
+    assert (actor_type_expired (self) == 0);
+    actor_type_count_expired (self);
+    assert (actor_type_expired (self) == 1);
+
+    //  Limits of each mailbox and of the whole type
+    actor_type_set_limits (self, 2, 100, 10, 1000, ACTOR_TYPE_DROP_OLDEST);
+    assert (actor_type_overflow (self) == ACTOR_TYPE_DROP_OLDEST);
+    quota_t *quota = actor_type_new_mailbox_quota (self);
+    quota_add (quota, 60);
+    assert (quota_fits (quota, 40));
+    assert (!quota_fits (quota, 41));
+    quota_add (quota, 0);
+    assert (!quota_fits (quota, 0));
+    quota_destroy (&quota);
+    assert (quota_fits (actor_type_quota (self), 1000));
+    assert (!quota_fits (actor_type_quota (self), 1001));
+
+    actor_type_destroy (&self);
+    assert (self == NULL);
+
+    printf ("OK\n");
+}
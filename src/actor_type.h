@@ -0,0 +1,144 @@
+#ifndef ACTOR_TYPE_H_INCLUDED
+#define ACTOR_TYPE_H_INCLUDED
+
+#include "mql_classes.h"
+
+typedef struct _actor_type_t actor_type_t;
+
+//  Priorities of the messages, zero is the highest
+#define ACTOR_TYPE_PRIORITIES 4
+#define ACTOR_TYPE_DEFAULT_PRIORITY 1
+
+//  What to do with a message which doesn't fit in its mailbox
+typedef enum {
+    ACTOR_TYPE_REJECT,          //  Refuse the message, http callers get 429 with Retry-After
+    ACTOR_TYPE_DROP_OLDEST,     //  Drop queued messages to make room
+    ACTOR_TYPE_DROP_NEWEST      //  Drop the message
+} actor_type_overflow_t;
+
+//  How an invocation of a subject shares the actor with the other invocations
+typedef enum {
+    ACTOR_TYPE_WRITE,           //  Runs alone
+    ACTOR_TYPE_READONLY,        //  Runs alongside other read-only invocations
+    ACTOR_TYPE_REENTRANT        //  Runs alongside any invocation
+} actor_type_access_t;
+
+//  Invocation backend of an actor type, aws_invoke_lambda and native_invoke
+//  both have this signature. The backend takes ownership of the content and
+//  calls the callback once the invocation completed.
+typedef int (actor_type_invoke_fn) (void *backend, const char *function_name, char **content,
+                                    aws_lambda_callback_fn callback, void *arg);
+
+actor_type_t *actor_type_new (const char *name, actor_type_invoke_fn *invoke, void *backend);
+
+void actor_type_destroy (actor_type_t **self_p);
+
+const char *actor_type_name (actor_type_t *self);
+
+void *actor_type_backend (actor_type_t *self);
+
+//  Milliseconds an http caller waits for a reply, zero to wait forever
+int actor_type_timeout (actor_type_t *self);
+
+void actor_type_set_timeout (actor_type_t *self, int timeout);
+
+//  Limits of each mailbox of the type, and of all of them together, zero is unlimited
+void actor_type_set_limits (actor_type_t *self, size_t mailbox_length, size_t mailbox_bytes,
+                            size_t length, size_t bytes, actor_type_overflow_t overflow);
+
+//  Quota shared by all the mailboxes of the type
+quota_t *actor_type_quota (actor_type_t *self);
+
+//  Create the quota of a new mailbox of the type
+quota_t *actor_type_new_mailbox_quota (actor_type_t *self);
+
+actor_type_overflow_t actor_type_overflow (actor_type_t *self);
+
+void actor_type_set_access (actor_type_t *self, const char *subject, actor_type_access_t access);
+
+//  Subjects not declared read-only or reentrant are writes, all the subjects
+//  of a stateless actor type are reentrant
+actor_type_access_t actor_type_access (actor_type_t *self, const char *subject);
+
+//  Invocations running at once on a single actor, one by default
+void actor_type_set_parallelism (actor_type_t *self, int parallelism);
+
+int actor_type_parallelism (actor_type_t *self);
+
+void actor_type_set_priority (actor_type_t *self, const char *subject, int priority);
+
+//  Priority of the subject, ACTOR_TYPE_DEFAULT_PRIORITY when not configured
+int actor_type_priority (actor_type_t *self, const char *subject);
+
+//  Serve the priorities by weight instead of strictly, so the lower ones still progress
+void actor_type_set_weighted (actor_type_t *self, bool weighted);
+
+bool actor_type_weighted (actor_type_t *self);
+
+//  Stateless actor types share a single mailbox between all their actors
+void actor_type_set_stateless (actor_type_t *self, bool stateless);
+
+bool actor_type_stateless (actor_type_t *self);
+
+void actor_type_set_cache_ttl (actor_type_t *self, const char *subject, int ttl);
+
+//  Milliseconds the replies of the subject are cached, zero when the subject
+//  is not cacheable. Any other subject invalidates the cached replies of the actor.
+int actor_type_cache_ttl (actor_type_t *self, const char *subject);
+
+void actor_type_set_ttl (actor_type_t *self, const char *subject, int ttl);
+
+//  Milliseconds a message of the subject is worth invoking once sent, zero
+//  when it never expires
+int actor_type_ttl (actor_type_t *self, const char *subject);
+
+//  Keep only the latest pending message of the subject for each actor
+void actor_type_set_coalesced (actor_type_t *self, const char *subject);
+
+bool actor_type_coalesced (actor_type_t *self, const char *subject);
+
+//  Count a message expired before it was invoked
+void actor_type_count_expired (actor_type_t *self);
+
+size_t actor_type_expired (actor_type_t *self);
+
+//  Limit the rate of the messages http callers send to the subject, or to
+//  the whole type when subject is NULL, in messages per second
+void actor_type_set_rate (actor_type_t *self, const char *subject, double rate, double burst);
+
+//  Bucket of the subject, or of the whole type when subject is NULL, NULL if not limited
+bucket_t *actor_type_bucket (actor_type_t *self, const char *subject);
+
+//  Limit the invocations of all the mailboxes of the type together, the
+//  type takes ownership of the limiter
+void actor_type_set_limiter (actor_type_t *self, limiter_t **limiter_p);
+
+//  Adaptive concurrency limit of the function, NULL if not enabled
+limiter_t *actor_type_limiter (actor_type_t *self);
+
+//  Queue a mailbox until the limiter has room again
+void actor_type_wait (actor_type_t *self, void *mailbox);
+
+//  Mailbox which waited the longest, NULL if none
+void *actor_type_next_waiting (actor_type_t *self);
+
+//  Keep containers of the function warm, the type takes ownership of the warmer
+void actor_type_set_warmer (actor_type_t *self, warmer_t **warmer_p);
+
+//  Warmer of the function, NULL if not warmed
+warmer_t *actor_type_warmer (actor_type_t *self);
+
+//  Stop invoking the function while it fails, the type takes ownership of
+//  the breaker. Messages wait for the breaker to close, or fail when fail_fast.
+void actor_type_set_breaker (actor_type_t *self, breaker_t **breaker_p, bool fail_fast);
+
+//  Circuit breaker of the function, NULL if not enabled
+breaker_t *actor_type_breaker (actor_type_t *self);
+
+bool actor_type_fail_fast (actor_type_t *self);
+
+int actor_type_invoke (actor_type_t *self, char **content, aws_lambda_callback_fn callback, void *arg);
+
+void actor_type_test (bool verbose);
+
+#endif
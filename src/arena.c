@@ -0,0 +1,288 @@
+#include "mql_classes.h"
+#include <jansson.h>
+
+#define ARENA_ALIGNMENT 16
+
+typedef struct _arena_chunk_t arena_chunk_t;
+
+struct _arena_chunk_t {
+    arena_chunk_t *next;
+    size_t size;
+    size_t used;
+    _Alignas (ARENA_ALIGNMENT) char data[];
+};
+
+//  The chunks are found by address in units of unit_size bytes, each unit
+//  a chunk overlaps has an entry, a unit can be shared by two chunks
+typedef struct {
+    uintptr_t unit;
+    arena_chunk_t *chunk;       //  NULL for a free entry
+} arena_entry_t;
+
+struct _arena_t {
+    arena_chunk_t *chunks;      //  Current chunk first, the first one allocated, of the usual size, last
+    size_t chunk_size;
+    size_t used;
+    size_t unit_size;           //  Power of two, at least the chunk size
+    arena_entry_t *entries;     //  Open addressing, linear probing
+    size_t capacity;            //  Power of two
+    size_t count;
+};
+
+//  Arena of the calling thread, NULL when jansson uses malloc
+static __thread arena_t *s_current = NULL;
+
+static size_t
+arena_slot (arena_t *self, uintptr_t unit) {
+    return (size_t) ((unit * 0x9E3779B97F4A7C15ull) >> 32) & (self->capacity - 1);
+}
+
+static void
+arena_index_add (arena_t *self, uintptr_t unit, arena_chunk_t *chunk) {
+    size_t slot = arena_slot (self, unit);
+    while (self->entries[slot].chunk)
+        slot = (slot + 1) & (self->capacity - 1);
+
+    self->entries[slot].unit = unit;
+    self->entries[slot].chunk = chunk;
+    self->count++;
+}
+
+static void
+arena_index_chunk (arena_t *self, arena_chunk_t *chunk) {
+    uintptr_t first = (uintptr_t) chunk->data / self->unit_size;
+    uintptr_t last = ((uintptr_t) chunk->data + chunk->size - 1) / self->unit_size;
+
+    //  Kept at most half full
+    if (2 * (self->count + last - first + 1) > self->capacity) {
+        arena_entry_t *entries = self->entries;
+        size_t capacity = self->capacity;
+        while (2 * (self->count + last - first + 1) > self->capacity)
+            self->capacity *= 2;
+        self->entries = (arena_entry_t *) zmalloc (self->capacity * sizeof (arena_entry_t));
+        assert (self->entries);
+        self->count = 0;
+        for (size_t slot = 0; slot < capacity; slot++)
+            if (entries[slot].chunk)
+                arena_index_add (self, entries[slot].unit, entries[slot].chunk);
+        free (entries);
+    }
+
+    for (uintptr_t unit = first; unit <= last; unit++)
+        arena_index_add (self, unit, chunk);
+}
+
+static arena_chunk_t *
+arena_chunk_new (arena_t *self, size_t size) {
+    arena_chunk_t *chunk = (arena_chunk_t *) malloc (sizeof (arena_chunk_t) + size);
+    assert (chunk);
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    arena_index_chunk (self, chunk);
+    return chunk;
+}
+
+arena_t *arena_new (size_t chunk_size) {
+    assert (chunk_size > 0);
+
+    arena_t *self = (arena_t *) zmalloc (sizeof (arena_t));
+    assert (self);
+
+    self->chunk_size = chunk_size;
+    self->unit_size = ARENA_ALIGNMENT;
+    while (self->unit_size < chunk_size)
+        self->unit_size *= 2;
+    self->capacity = 16;
+    self->entries = (arena_entry_t *) zmalloc (self->capacity * sizeof (arena_entry_t));
+    assert (self->entries);
+    self->chunks = arena_chunk_new (self, chunk_size);
+
+    return self;
+}
+
+void arena_destroy (arena_t **self_p) {
+    assert (self_p);
+    arena_t *self = *self_p;
+
+    if (self) {
+        assert (s_current != self);
+        while (self->chunks) {
+            arena_chunk_t *next = self->chunks->next;
+            free (self->chunks);
+            self->chunks = next;
+        }
+
+        free (self->entries);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+void *arena_alloc (arena_t *self, size_t size) {
+    assert (self);
+
+    size = (size + ARENA_ALIGNMENT - 1) & ~((size_t) ARENA_ALIGNMENT - 1);
+    if (size == 0)
+        size = ARENA_ALIGNMENT;
+
+    arena_chunk_t *chunk = self->chunks;
+    if (chunk->size - chunk->used < size) {
+        //  Large allocations get a chunk of their own
+        chunk = arena_chunk_new (self, size > self->chunk_size ? size : self->chunk_size);
+        chunk->next = self->chunks;
+        self->chunks = chunk;
+    }
+
+    void *pointer = chunk->data + chunk->used;
+    chunk->used += size;
+    self->used += size;
+
+    return pointer;
+}
+
+bool arena_owns (arena_t *self, const void *pointer) {
+    assert (self);
+
+    const char *address = (const char *) pointer;
+    uintptr_t unit = (uintptr_t) address / self->unit_size;
+    for (size_t slot = arena_slot (self, unit); self->entries[slot].chunk; slot = (slot + 1) & (self->capacity - 1)) {
+        arena_chunk_t *chunk = self->entries[slot].chunk;
+        if (self->entries[slot].unit == unit && address >= chunk->data && address < chunk->data + chunk->size)
+            return true;
+    }
+
+    return false;
+}
+
+void arena_reset (arena_t *self) {
+    assert (self);
+
+    if (self->chunks->next) {
+        while (self->chunks->next) {
+            arena_chunk_t *next = self->chunks->next;
+            free (self->chunks);
+            self->chunks = next;
+        }
+
+        memset (self->entries, 0, self->capacity * sizeof (arena_entry_t));
+        self->count = 0;
+        arena_index_chunk (self, self->chunks);
+    }
+
+    self->chunks->used = 0;
+    self->used = 0;
+}
+
+size_t arena_used (arena_t *self) {
+    assert (self);
+    return self->used;
+}
+
+static void *
+arena_json_malloc (size_t size) {
+    return s_current ? arena_alloc (s_current, size) : malloc (size);
+}
+
+//  Memory of the arena is released on reset, the rest was allocated by
+//  malloc, possibly before the hooks were installed
+static void
+arena_json_free (void *pointer) {
+    if (s_current && arena_owns (s_current, pointer))
+        return;
+
+    free (pointer);
+}
+
+void arena_install_json (void) {
+    json_malloc_t malloc_fn;
+    json_free_t free_fn;
+    json_get_alloc_funcs (&malloc_fn, &free_fn);
+    if (malloc_fn != arena_json_malloc)
+        json_set_alloc_funcs (arena_json_malloc, arena_json_free);
+}
+
+bool arena_enter (arena_t *self) {
+    assert (self);
+    if (s_current)
+        return false;
+
+    s_current = self;
+    return true;
+}
+
+void arena_leave (arena_t *self) {
+    assert (self);
+    assert (s_current == self);
+    s_current = NULL;
+    arena_reset (self);
+}
+
+void arena_test (bool verbose) {
+    printf (" * arena: ");
+
+    arena_t *self = arena_new (256);
+
+    char *small = (char *) arena_alloc (self, 10);
+    char *other = (char *) arena_alloc (self, 1);
+    assert (((uintptr_t) small % ARENA_ALIGNMENT) == 0 && ((uintptr_t) other % ARENA_ALIGNMENT) == 0);
+    assert (other == small + ARENA_ALIGNMENT);
+    memset (small, 'a', 10);
+
+    char *large = (char *) arena_alloc (self, 1000);
+    memset (large, 'b', 1000);
+    assert (arena_owns (self, small) && arena_owns (self, large + 999));
+    assert (arena_used (self) == 2 * ARENA_ALIGNMENT + 1008);
+
+    char *heap = (char *) malloc (10);
+    assert (!arena_owns (self, heap));
+    free (heap);
+
+    arena_reset (self);
+    assert (arena_used (self) == 0);
+    assert (arena_alloc (self, 10) == small);
+
+    //  Jansson inside the arena, and before and after it, the hooks may be
+    //  installed once jansson is in use
+    json_t *outside = json_pack ("{ss}", "kept", "outside");
+    arena_install_json ();
+    arena_install_json ();
+    json_t *inside = json_pack ("{ss}", "kept", "inside");
+
+    assert (arena_enter (self));
+    assert (!arena_enter (self));
+    json_t *root = json_loads ("{\"a\": [1, 2, {\"b\": \"c\"}], \"d\": \"e\"}", 0, NULL);
+    assert (root);
+    assert (arena_owns (self, root));
+    json_object_set_new (root, "f", json_string ("g"));
+    json_decref (root);
+    json_decref (outside);
+    json_decref (inside);
+    assert (arena_used (self) > 0);
+    arena_leave (self);
+    assert (arena_used (self) == 0);
+
+    //  Memory jansson allocates outside arenas is released by free
+    root = json_pack ("{si}", "n", 1);
+    assert (!arena_owns (self, root));
+    char *dump = json_dumps (root, JSON_COMPACT);
+    assert (streq (dump, "{\"n\":1}"));
+    free (dump);
+    json_decref (root);
+
+    //  Many chunks don't slow the frees down, each is a lookup by address
+    assert (arena_enter (self));
+    json_t *array = json_array ();
+    for (int index = 0; index < 100000; index++)
+        json_array_append_new (array, json_string ("a string of the array"));
+    assert (self->chunks->next);
+    assert (arena_owns (self, json_array_get (array, 0)));
+    json_decref (array);
+    arena_leave (self);
+    assert (!self->chunks->next);
+    assert (self->count <= 2);
+
+    arena_destroy (&self);
+
+    printf ("OK\n");
+}
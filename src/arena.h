@@ -0,0 +1,45 @@
+#ifndef ARENA_H_INCLUDED
+#define ARENA_H_INCLUDED
+
+#include "mql_classes.h"
+
+typedef struct _arena_t arena_t;
+
+//  Bump allocator released wholesale. Once the jansson hooks are installed,
+//  the jansson allocations of a thread go to the arena it entered, and to
+//  malloc otherwise, so json trees built while handling a message cost no
+//  malloc and no free. Nothing jansson allocates inside the arena may be
+//  kept after leaving it.
+
+arena_t *arena_new (size_t chunk_size);
+
+void arena_destroy (arena_t **self_p);
+
+//  Memory aligned for any type, valid until the arena is reset
+void *arena_alloc (arena_t *self, size_t size);
+
+//  Return true if the memory was allocated from the arena
+bool arena_owns (arena_t *self, const void *pointer);
+
+//  Release all the allocations, the first chunk is kept for reuse
+void arena_reset (arena_t *self);
+
+//  Bytes allocated since the last reset
+size_t arena_used (arena_t *self);
+
+//  Route the jansson allocations through the arena of the calling thread,
+//  and through malloc outside arenas, so jansson memory allocated outside
+//  arenas is still released by free. The hooks are installed once, they
+//  stay installed, and may be installed while jansson is already in use
+void arena_install_json (void);
+
+//  Allocate the jansson memory of the calling thread from the arena, return
+//  false if the thread already is in an arena, which is then kept
+bool arena_enter (arena_t *self);
+
+//  Back to malloc, and reset the arena
+void arena_leave (arena_t *self);
+
+void arena_test (bool verbose);
+
+#endif
@@ -12,21 +12,39 @@ typedef enum {
     ERROR
 } credentials_state_t;
 
+typedef struct {
+    char endpoint[256];
+    char *host;
+    char region[256];
+    aws_sign_t *sign;
+} aws_endpoint_t;
+
+//  Invocation in flight, to account its outcome to its endpoint
+typedef struct {
+    aws_t *aws;
+    int endpoint;
+    int64_t started;
+    aws_lambda_callback_fn *callback;
+    void *arg;
+} aws_call_t;
+
 struct _aws_t {
     zhttp_client_t *http_client;
-    aws_sign_t *sign;
+    aws_endpoint_t endpoints[ROUTER_MAX_ENDPOINTS];
+    router_t *router;
+    zhashx_t *functions;        //  Endpoints of the functions restricted to some of them
+    zlistx_t *failed;           //  Calls without an endpoint, answered by the next execute
 
-    char endpoint[256];
     char access_key[256];
     char secret[256];
     char region[256];
     char role[256];
     char privateIp[256];
     char *session_token;
-    char *host;
 
     zhttp_request_t *request;
     zhttp_response_t *response;
+    zhttp_response_t *unavailable;
     credentials_state_t credentials_state;
 };
 
@@ -47,34 +65,100 @@ aws_t *aws_new () {
     self->request = zhttp_request_new ();
     self->response = zhttp_response_new ();
     self->credentials_state = DONE;
+    self->router = router_new ();
+    self->functions = zhashx_new ();
+    zhashx_set_destructor (self->functions, (czmq_destructor *) zstr_free);
+    self->failed = zlistx_new ();
+    zlistx_set_destructor (self->failed, (czmq_destructor *) zstr_free);
+    self->unavailable = zhttp_response_new ();
+    zhttp_response_set_status_code (self->unavailable, 503);
+    zhttp_response_set_content_const (self->unavailable, "{\"body\": \"No endpoint available\"}");
 
     strcpy (self->region, "");
 
     return self;
 }
 
+static void
+aws_endpoint_sign (aws_t *self, aws_endpoint_t *endpoint) {
+    aws_sign_destroy (&endpoint->sign);
+    endpoint->sign = aws_sign_new (self->access_key, self->secret, endpoint->region, LAMBDA_SERVICE_NAME);
+}
+
+int aws_add_endpoint (aws_t *self, const char *name, const char *region, const char *endpoint) {
+    assert (self);
+    assert (region);
+
+    if (router_size (self->router) == ROUTER_MAX_ENDPOINTS)
+        return -1;
+
+    aws_endpoint_t *self_endpoint = &self->endpoints[router_size (self->router)];
+
+    if (endpoint)
+        snprintf (self_endpoint->endpoint, sizeof (self_endpoint->endpoint), "%s", endpoint);
+    else
+        snprintf (self_endpoint->endpoint, sizeof (self_endpoint->endpoint), "https://%s.%s.amazonaws.com", LAMBDA_SERVICE_NAME, region);
+
+    if (strncmp ("https://", self_endpoint->endpoint, strlen ("https://")) == 0)
+        self_endpoint->host = self_endpoint->endpoint + strlen ("https://");
+    else
+    if (strncmp ("http://", self_endpoint->endpoint, strlen ("http://")) == 0)
+        self_endpoint->host = self_endpoint->endpoint + strlen ("http://");
+    else
+        return -1;
+
+    snprintf (self_endpoint->region, sizeof (self_endpoint->region), "%s", region);
+    aws_endpoint_sign (self, self_endpoint);
+
+    return router_add (self->router, name ? name : self_endpoint->endpoint);
+}
+
 void aws_set (aws_t *self, const char* region, const char *access_key,
               const char *secret, const char *endpoint) {
     assert (self);
 
-    aws_sign_destroy (&self->sign);
-    self->sign = aws_sign_new (access_key, secret, region, LAMBDA_SERVICE_NAME);
     strcpy (self->access_key, access_key);
     strcpy (self->secret, secret);
     strcpy (self->region, region);
 
-    if (endpoint)
-        strcpy (self->endpoint, endpoint);
-    else
-        sprintf (self->endpoint, "https://%s.%s.amazonaws.com", LAMBDA_SERVICE_NAME, region);
+    //  The first endpoint is the one of the region, the others keep their own region
+    if (router_size (self->router) == 0 && aws_add_endpoint (self, NULL, region, endpoint) == -1)
+        zsys_error ("AWS: invalid endpoint %s, invocations will fail", endpoint);
 
-    if (strncmp ("https://", self->endpoint, strlen ("https://")) == 0)
-        self->host = self->endpoint + strlen ("https://");
-    else
-    if (strncmp ("http://", self->endpoint, strlen ("http://")) == 0)
-        self->host = self->endpoint + strlen ("http://");
-    else
-        assert (false);
+    for (size_t index = 0; index < router_size (self->router); index++)
+        aws_endpoint_sign (self, &self->endpoints[index]);
+}
+
+int aws_set_endpoints (aws_t *self, const char *function_name, const char *names) {
+    assert (self);
+
+    uint32_t set = 0;
+    char *list = strdup (names);
+    char *saveptr = NULL;
+    for (char *name = strtok_r (list, ", ", &saveptr); name; name = strtok_r (NULL, ", ", &saveptr)) {
+        int index = router_lookup (self->router, name);
+        if (index == -1) {
+            zsys_error ("AWS: unknown endpoint %s of %s", name, function_name);
+            zstr_free (&list);
+            return -1;
+        }
+        set |= (uint32_t) 1 << index;
+    }
+    zstr_free (&list);
+
+    if (set == 0) {
+        zsys_error ("AWS: no endpoint for %s", function_name);
+        return -1;
+    }
+
+    zhashx_update (self->functions, function_name, zsys_sprintf ("%u", set));
+
+    return 0;
+}
+
+json_t *aws_status (aws_t *self) {
+    assert (self);
+    return router_status (self->router, zclock_mono ());
 }
 
 void aws_destroy (aws_t **self_p) {
@@ -85,7 +169,12 @@ void aws_destroy (aws_t **self_p) {
         zhttp_client_destroy (&self->http_client);
         zhttp_request_destroy (&self->request);
         zhttp_response_destroy (&self->response);
-        aws_sign_destroy (&self->sign);
+        zhttp_response_destroy (&self->unavailable);
+        zlistx_destroy (&self->failed);
+        for (size_t index = 0; index < router_size (self->router); index++)
+            aws_sign_destroy (&self->endpoints[index].sign);
+        router_destroy (&self->router);
+        zhashx_destroy (&self->functions);
         zstr_free (&self->session_token);
 
         memset (self->secret, 0, strlen (self->secret));
@@ -283,6 +372,19 @@ int aws_refresh_credentials_sync (aws_t *self) {
     return self->credentials_state == DONE ? 0 : -1;
 }
 
+//  Throttles and failures of the service count against the endpoint,
+//  errors of the function itself don't
+static void aws_call_completed (aws_call_t *call, zhttp_response_t *response) {
+    uint32_t status_code = zhttp_response_status_code (response);
+    int64_t now = zclock_mono ();
+
+    router_completed (call->aws->router, call->endpoint, now - call->started,
+                      status_code == 0 || status_code == 429 || status_code >= 500, now);
+
+    call->callback (call->arg, response);
+    free (call);
+}
+
 int aws_invoke_lambda (
         aws_t *self,
         const char *function_name,
@@ -290,6 +392,21 @@ int aws_invoke_lambda (
         aws_lambda_callback_fn callback,
         void *arg) {
 
+    const char *set = (const char *) zhashx_lookup (self->functions, function_name);
+    int index = router_pick (self->router, set ? (uint32_t) strtoul (set, NULL, 10) : ROUTER_ALL, zclock_mono ());
+    if (index == -1) {
+        zsys_error ("AWS: no endpoint available for %s", function_name);
+        aws_call_t *call = (aws_call_t *) zmalloc (sizeof (aws_call_t));
+        call->aws = self;
+        call->endpoint = -1;
+        call->callback = callback;
+        call->arg = arg;
+        zlistx_add_end (self->failed, call);
+        zstr_free (content);
+        return -1;
+    }
+    aws_endpoint_t *endpoint = &self->endpoints[index];
+
     char datetime[DATETIME_LEN];
     get_datetime (datetime);
 
@@ -297,7 +414,7 @@ int aws_invoke_lambda (
     sprintf (path, "/2015-03-31/functions/%s/invocations", function_name);
 
     char authorization_header[MAX_AUTHORIZATION_LEN];
-    aws_sign (self->sign, authorization_header, "POST", self->host, path, "", datetime, *content);
+    aws_sign (endpoint->sign, authorization_header, "POST", endpoint->host, path, "", datetime, *content);
 
     zhash_t *headers = zhttp_request_headers (self->request);
 
@@ -311,21 +428,38 @@ int aws_invoke_lambda (
         zhash_insert (headers, "X-Amz-Security-Token", self->session_token);
 
     char url[2000];
-    sprintf(url, "%s%s", self->endpoint, path);
+    sprintf(url, "%s%s", endpoint->endpoint, path);
+
+    aws_call_t *call = (aws_call_t *) zmalloc (sizeof (aws_call_t));
+    call->aws = self;
+    call->endpoint = index;
+    call->started = zclock_mono ();
+    call->callback = callback;
+    call->arg = arg;
 
     // TODO: get timeout from configuration
     zhttp_request_set_content (self->request, content);
     zhttp_request_set_method (self->request, "POST");
     zhttp_request_set_url (self->request, url);
-    zhttp_request_send (self->request, self->http_client, -1, callback, arg);
+    zhttp_request_send (self->request, self->http_client, -1, aws_call_completed, call);
 
     return 0;
 }
 
-int aws_execute (aws_t *self) {
+int aws_execute (aws_t *self, int budget) {
     zsock_t* sock = aws_get_socket (self);
+    int count = 0;
+
+    aws_call_t *call = (aws_call_t *) zlistx_first (self->failed);
+    while (count < budget && call) {
+        zlistx_detach_cur (self->failed);
+        call->callback (call->arg, self->unavailable);
+        free (call);
+        count++;
+        call = (aws_call_t *) zlistx_first (self->failed);
+    }
 
-    while (zsock_has_in (sock)) {
+    while (count < budget && zsock_has_in (sock)) {
         aws_lambda_callback_fn *callback;
         void* arg;
         int rc = zhttp_response_recv (self->response, self->http_client, (void**) &callback, &arg);
@@ -333,9 +467,15 @@ int aws_execute (aws_t *self) {
             return rc;
 
         callback(arg, self->response);
+        count++;
     }
 
-    return 0;
+    return count;
+}
+
+bool aws_has_failed (aws_t *self) {
+    assert (self);
+    return zlistx_size (self->failed) > 0;
 }
 
 const char *aws_private_ip_address (aws_t *self) {
@@ -377,9 +517,35 @@ recv_http_request(void* server) {
     return routing_id;
 }
 
+static void aws_test_failed_callback (void *arg, zhttp_response_t *response) {
+    *(uint32_t *) arg = zhttp_response_status_code (response);
+}
+
 void aws_test () {
     printf (" * aws: ");
 
+    //  Bad endpoints are refused, invocations without one fail with 503
+    aws_t *self = aws_new ();
+    assert (aws_add_endpoint (self, "ftp", "us-east-1", "ftp://example.com") == -1);
+    assert (aws_add_endpoint (self, "west", "us-west-2", NULL) == 0);
+    assert (aws_set_endpoints (self, "hello", "east") == -1);
+    assert (aws_set_endpoints (self, "hello", " , ") == -1);
+    assert (aws_set_endpoints (self, "hello", "west") == 0);
+
+    aws_destroy (&self);
+    self = aws_new ();
+
+    uint32_t status_code = 0;
+    char *content = strdup ("\"hello\"");
+    assert (aws_invoke_lambda (self, "hello", &content, aws_test_failed_callback, &status_code) == -1);
+    assert (content == NULL);
+    assert (status_code == 0);
+    assert (aws_has_failed (self));
+    assert (aws_execute (self, 10) == 1);
+    assert (status_code == 503);
+    assert (!aws_has_failed (self));
+    aws_destroy (&self);
+
 //    //  Creating http server for local tests
 //    zsock_t *server = zsock_new_stream (NULL);
 //    int port = zsock_bind (server, "tcp://127.0.0.1:*");
@@ -406,7 +572,7 @@ void aws_test () {
 //    //  Waiting for the response
 //    int rc = zhttp_client_wait (self->http_client, -1);
 //    assert (rc == 0);
-//    rc = aws_execute (self);
+//    rc = aws_execute (self, 1);
 //    assert (rc == 0);
 //    assert (event);
 //
@@ -12,9 +12,28 @@ void aws_destroy (aws_t ** aws_p);
 
 void aws_set (aws_t *self, const char* region, const char *access_key, const char *secret, const char *endpoint);
 
+//  Add an endpoint serving the same functions in its own region, the endpoint
+//  of the region when NULL. Invocations go to the best scoring endpoint.
+//  Return the index of the endpoint, -1 on error.
+int aws_add_endpoint (aws_t *self, const char *name, const char *region, const char *endpoint);
+
+//  Restrict the function to the comma separated endpoints, named by their
+//  name or endpoint, return -1 if one is unknown or none is given
+int aws_set_endpoints (aws_t *self, const char *function_name, const char *names);
+
+//  Latency, error rate and state of the endpoints
+json_t *aws_status (aws_t *self);
+
+//  Invoke the function on the best scoring endpoint. Without one available the
+//  invocation fails with 503, through the callback on the next aws_execute, and
+//  -1 is returned.
 int aws_invoke_lambda (aws_t *self, const char* function_name, char **content, aws_lambda_callback_fn callback, void* arg);
 
-int aws_execute (aws_t *aws);
+//  Process up to budget completed invocations, return how many were processed
+int aws_execute (aws_t *aws, int budget);
+
+//  Whether failed invocations wait for aws_execute
+bool aws_has_failed (aws_t *self);
 
 zsock_t* aws_get_socket (aws_t *aws);
 
@@ -79,6 +79,10 @@ static void compute_hash (char *output, const byte *request_payload, size_t requ
     to_hex (output, hash, SHA256_DIGEST_SIZE);
 }
 
+void aws_sign_hash (char *output, const char *data, size_t size) {
+    compute_hash (output, (const byte *) data, size);
+}
+
 bool should_encode_char (char c, bool legacy) {
 
     if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'))
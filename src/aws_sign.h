@@ -22,6 +22,12 @@ void aws_sign (
         const char *datetime,
         const char *request_payload);
 
+// Length of a hex SHA-256 digest, with the terminator
+#define AWS_SIGN_HASH_LEN 65
+
+// Hex SHA-256 of the data, output must be AWS_SIGN_HASH_LEN long
+void aws_sign_hash (char *output, const char *data, size_t size);
+
 void aws_sign_test();
 
 #endif
\ No newline at end of file
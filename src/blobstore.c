@@ -0,0 +1,195 @@
+#include "mql_classes.h"
+#include <dirent.h>
+#include <sys/stat.h>
+#include <utime.h>
+
+struct _blobstore_t {
+    char *directory;
+    uint64_t sequence;          //  Names of the temporary files
+};
+
+blobstore_t *blobstore_new (const char *directory) {
+    assert (directory);
+
+    blobstore_t *self = (blobstore_t *) zmalloc (sizeof (blobstore_t));
+    assert (self);
+
+    self->directory = strdup (directory);
+    mkdir (directory, 0700);
+
+    return self;
+}
+
+void blobstore_destroy (blobstore_t **self_p) {
+    assert (self_p);
+    blobstore_t *self = *self_p;
+
+    if (self) {
+        zstr_free (&self->directory);
+
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+bool blobstore_is_ref (const char *ref) {
+    size_t prefix_size = strlen (BLOBSTORE_REF_PREFIX);
+    if (ref == NULL || strlen (ref) != BLOBSTORE_REF_LEN - 1 || strncmp (ref, BLOBSTORE_REF_PREFIX, prefix_size) != 0)
+        return false;
+
+    //  Only the hex digest, so a reference never escapes the directory
+    for (const char *c = ref + prefix_size; *c; c++)
+        if (!((*c >= '0' && *c <= '9') || (*c >= 'a' && *c <= 'f')))
+            return false;
+
+    return true;
+}
+
+static char *
+blobstore_path (blobstore_t *self, const char *ref) {
+    return zsys_sprintf ("%s/%s", self->directory, ref + strlen (BLOBSTORE_REF_PREFIX));
+}
+
+int blobstore_put (blobstore_t *self, const char *data, size_t size, char *ref) {
+    assert (self);
+    assert (ref);
+
+    strcpy (ref, BLOBSTORE_REF_PREFIX);
+    aws_sign_hash (ref + strlen (BLOBSTORE_REF_PREFIX), data, size);
+
+    //  Touched, so a blob stored again isn't expired under its new reference
+    char *path = blobstore_path (self, ref);
+    if (utime (path, NULL) == 0) {
+        zstr_free (&path);
+        return 0;
+    }
+
+    //  Written aside and renamed, so a blob is never seen half written
+    char *temp_path = zsys_sprintf ("%s/.%u-%" PRIu64 ".tmp", self->directory, (unsigned) getpid (), self->sequence++);
+    FILE *file = fopen (temp_path, "w");
+    int rc = -1;
+
+    if (file) {
+        if (fwrite (data, 1, size, file) == size && fclose (file) == 0)
+            rc = rename (temp_path, path);
+        else
+            fclose (file);
+    }
+
+    if (rc != 0) {
+        zsys_error ("blobstore: fail to write %s", path);
+        unlink (temp_path);
+    }
+
+    zstr_free (&temp_path);
+    zstr_free (&path);
+
+    return rc == 0 ? 0 : -1;
+}
+
+char *blobstore_get (blobstore_t *self, const char *ref, size_t *size) {
+    assert (self);
+    assert (size);
+
+    if (!blobstore_is_ref (ref))
+        return NULL;
+
+    char *path = blobstore_path (self, ref);
+    FILE *file = fopen (path, "r");
+    zstr_free (&path);
+    if (!file)
+        return NULL;
+
+    char *data = NULL;
+    struct stat info;
+    if (fstat (fileno (file), &info) == 0) {
+        data = (char *) malloc (info.st_size + 1);
+        assert (data);
+        if (fread (data, 1, info.st_size, file) == (size_t) info.st_size) {
+            data[info.st_size] = '\0';
+            *size = info.st_size;
+        }
+        else
+            zstr_free (&data);
+    }
+    fclose (file);
+
+    return data;
+}
+
+size_t blobstore_expire (blobstore_t *self, int64_t max_age) {
+    assert (self);
+
+    DIR *dir = opendir (self->directory);
+    if (!dir)
+        return 0;
+
+    time_t now = time (NULL);
+    size_t expired = 0;
+
+    for (struct dirent *entry = readdir (dir); entry; entry = readdir (dir)) {
+        if (entry->d_name[0] == '.' && !strstr (entry->d_name, ".tmp"))
+            continue;
+
+        char *path = zsys_sprintf ("%s/%s", self->directory, entry->d_name);
+        struct stat info;
+        if (stat (path, &info) == 0 && S_ISREG (info.st_mode) && now - info.st_mtime > max_age) {
+            unlink (path);
+            expired++;
+        }
+        zstr_free (&path);
+    }
+    closedir (dir);
+
+    return expired;
+}
+
+#define SELFTEST_DIR_RW "src/selftest-rw"
+
+void blobstore_test (bool verbose) {
+    printf (" * blobstore: ");
+
+    blobstore_t *self = blobstore_new (SELFTEST_DIR_RW "/blobs");
+
+    char ref[BLOBSTORE_REF_LEN];
+    assert (blobstore_put (self, "abc", 3, ref) == 0);
+    assert (streq (ref, "sha256:ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"));
+    assert (blobstore_is_ref (ref));
+
+    //  Same content, same blob
+    char again[BLOBSTORE_REF_LEN];
+    assert (blobstore_put (self, "abc", 3, again) == 0);
+    assert (streq (ref, again));
+
+    size_t size = 0;
+    char *data = blobstore_get (self, ref, &size);
+    assert (data && size == 3 && streq (data, "abc"));
+    zstr_free (&data);
+
+    assert (!blobstore_is_ref ("sha256:../../etc/passwd"));
+    assert (!blobstore_is_ref ("abc"));
+    assert (blobstore_get (self, "sha256:../x", &size) == NULL);
+    ref[10] = ref[10] == '0' ? '1' : '0';
+    assert (blobstore_get (self, ref, &size) == NULL);
+
+    assert (blobstore_expire (self, 3600) == 0);
+
+    //  Storing an old blob again keeps it another max age
+    data = blobstore_path (self, again);
+    struct utimbuf old = { time (NULL) - 7200, time (NULL) - 7200 };
+    assert (utime (data, &old) == 0);
+    assert (blobstore_put (self, "abc", 3, again) == 0);
+    assert (blobstore_expire (self, 3600) == 0);
+    assert (utime (data, &old) == 0);
+    assert (blobstore_expire (self, 3600) == 1);
+    assert (blobstore_put (self, "abc", 3, again) == 0);
+    zstr_free (&data);
+
+    assert (blobstore_expire (self, -1) == 1);
+    assert (blobstore_get (self, again, &size) == NULL);
+
+    blobstore_destroy (&self);
+    rmdir (SELFTEST_DIR_RW "/blobs");
+
+    printf ("OK\n");
+}
@@ -0,0 +1,36 @@
+#ifndef BLOBSTORE_H_INCLUDED
+#define BLOBSTORE_H_INCLUDED
+
+#include "mql_classes.h"
+
+typedef struct _blobstore_t blobstore_t;
+
+//  Prefix of the references of the blobs, followed by the hex SHA-256 of the content
+#define BLOBSTORE_REF_PREFIX "sha256:"
+#define BLOBSTORE_REF_LEN (sizeof (BLOBSTORE_REF_PREFIX) - 1 + AWS_SIGN_HASH_LEN)
+
+//  Content addressed store of large bodies in a local directory, so only a
+//  reference travels through the envelopes. Storing the same content twice
+//  writes it once.
+
+blobstore_t *blobstore_new (const char *directory);
+
+void blobstore_destroy (blobstore_t **self_p);
+
+//  Store the content and write its reference, BLOBSTORE_REF_LEN long,
+//  return -1 if it can't be written. Content already stored is touched, so
+//  its age starts over.
+int blobstore_put (blobstore_t *self, const char *data, size_t size, char *ref);
+
+//  Return the content of the reference, freed by the caller, or NULL if not found
+char *blobstore_get (blobstore_t *self, const char *ref, size_t *size);
+
+//  Return true if the string is a well formed reference
+bool blobstore_is_ref (const char *ref);
+
+//  Remove the blobs older than max_age seconds, return their count
+size_t blobstore_expire (blobstore_t *self, int64_t max_age);
+
+void blobstore_test (bool verbose);
+
+#endif
@@ -0,0 +1,190 @@
+#include "mql_classes.h"
+
+//  Slots of the rolling window
+#define BREAKER_SLOTS 10
+
+typedef struct {
+    size_t calls;
+    size_t failures;
+} breaker_slot_t;
+
+struct _breaker_t {
+    double threshold;
+    size_t min_calls;
+    int64_t slot_time;          //  Milliseconds of a slot
+    int64_t slot;               //  Current slot, by time
+    breaker_slot_t slots[BREAKER_SLOTS];
+    int64_t open_time;
+    breaker_state_t state;
+    int64_t open_until;
+    bool probing;               //  The probe is in flight
+};
+
+breaker_t *breaker_new (double threshold, size_t min_calls, int64_t window, int64_t open_time) {
+    assert (threshold > 0);
+    assert (window >= BREAKER_SLOTS);
+
+    breaker_t *self = (breaker_t *) zmalloc (sizeof (breaker_t));
+    assert (self);
+
+    self->threshold = threshold;
+    self->min_calls = min_calls > 0 ? min_calls : 1;
+    self->slot_time = window / BREAKER_SLOTS;
+    self->open_time = open_time;
+    self->state = BREAKER_CLOSED;
+
+    return self;
+}
+
+void breaker_destroy (breaker_t **self_p) {
+    assert (self_p);
+    breaker_t *self = *self_p;
+
+    if (self) {
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+//  Move to the slot of now, clearing the slots left behind
+static void
+breaker_advance (breaker_t *self, int64_t now) {
+    int64_t slot = now / self->slot_time;
+    if (slot - self->slot > BREAKER_SLOTS)
+        self->slot = slot - BREAKER_SLOTS;
+
+    while (self->slot < slot) {
+        self->slot++;
+        self->slots[self->slot % BREAKER_SLOTS].calls = 0;
+        self->slots[self->slot % BREAKER_SLOTS].failures = 0;
+    }
+}
+
+static void
+breaker_open (breaker_t *self, int64_t now) {
+    self->state = BREAKER_OPEN;
+    self->open_until = now + self->open_time;
+    self->probing = false;
+    memset (self->slots, 0, sizeof (self->slots));
+}
+
+bool breaker_blocked (breaker_t *self, int64_t now) {
+    assert (self);
+
+    if (self->state == BREAKER_OPEN)
+        return now < self->open_until;
+    if (self->state == BREAKER_HALF_OPEN)
+        return self->probing;
+
+    return false;
+}
+
+bool breaker_allow (breaker_t *self, int64_t now) {
+    assert (self);
+
+    if (breaker_blocked (self, now))
+        return false;
+
+    if (self->state != BREAKER_CLOSED) {
+        self->state = BREAKER_HALF_OPEN;
+        self->probing = true;
+    }
+
+    return true;
+}
+
+void breaker_record (breaker_t *self, bool failed, int64_t now) {
+    assert (self);
+
+    if (self->state == BREAKER_HALF_OPEN) {
+        if (failed)
+            breaker_open (self, now);
+        else {
+            self->state = BREAKER_CLOSED;
+            self->probing = false;
+        }
+        return;
+    }
+
+    //  Invocations which started before the breaker opened
+    if (self->state == BREAKER_OPEN)
+        return;
+
+    breaker_advance (self, now);
+    breaker_slot_t *slot = &self->slots[self->slot % BREAKER_SLOTS];
+    slot->calls++;
+    if (failed)
+        slot->failures++;
+
+    size_t calls = 0;
+    size_t failures = 0;
+    for (int index = 0; index < BREAKER_SLOTS; index++) {
+        calls += self->slots[index].calls;
+        failures += self->slots[index].failures;
+    }
+
+    if (calls >= self->min_calls && failures >= self->threshold * calls)
+        breaker_open (self, now);
+}
+
+breaker_state_t breaker_state (breaker_t *self) {
+    assert (self);
+    return self->state;
+}
+
+void breaker_test (bool verbose) {
+    printf (" * breaker: ");
+
+    int64_t now = 100000;
+    breaker_t *self = breaker_new (0.5, 4, 10000, 5000);
+    assert (breaker_state (self) == BREAKER_CLOSED);
+
+    //  A few errors among successes keep it closed
+    for (int index = 0; index < 10; index++) {
+        assert (breaker_allow (self, now));
+        breaker_record (self, index % 4 == 3, now);
+    }
+    assert (breaker_state (self) == BREAKER_CLOSED);
+
+    //  Errors out of the window are forgotten
+    now += 20000;
+    for (int index = 0; index < 3; index++) {
+        assert (breaker_allow (self, now));
+        breaker_record (self, true, now);
+    }
+    assert (breaker_state (self) == BREAKER_CLOSED);
+
+    //  Open once the error rate reaches the threshold
+    assert (breaker_allow (self, now));
+    breaker_record (self, true, now);
+    assert (breaker_state (self) == BREAKER_OPEN);
+    assert (breaker_blocked (self, now));
+    assert (!breaker_allow (self, now + 4999));
+
+    //  Completions of invocations started before don't count
+    breaker_record (self, false, now + 1000);
+    assert (breaker_state (self) == BREAKER_OPEN);
+
+    //  A single probe after the open time, a failed one opens it again
+    now += 5000;
+    assert (!breaker_blocked (self, now));
+    assert (breaker_allow (self, now));
+    assert (breaker_state (self) == BREAKER_HALF_OPEN);
+    assert (!breaker_allow (self, now));
+    breaker_record (self, true, now);
+    assert (breaker_state (self) == BREAKER_OPEN);
+    assert (!breaker_allow (self, now + 1000));
+
+    //  A successful probe closes it
+    now += 5000;
+    assert (breaker_allow (self, now));
+    breaker_record (self, false, now);
+    assert (breaker_state (self) == BREAKER_CLOSED);
+    assert (breaker_allow (self, now));
+    breaker_record (self, false, now);
+
+    breaker_destroy (&self);
+    assert (self == NULL);
+
+    printf ("OK\n");
+}
@@ -0,0 +1,35 @@
+#ifndef BREAKER_H_INCLUDED
+#define BREAKER_H_INCLUDED
+
+#include "mql_classes.h"
+
+typedef struct _breaker_t breaker_t;
+
+typedef enum {
+    BREAKER_CLOSED,             //  Invocations go through
+    BREAKER_OPEN,               //  Invocations are refused until the open time elapsed
+    BREAKER_HALF_OPEN           //  A single probe decides whether to close or open again
+} breaker_state_t;
+
+//  Circuit breaker of a function, opened when the error rate over a rolling
+//  window reaches the threshold, with at least min_calls invocations in it
+
+breaker_t *breaker_new (double threshold, size_t min_calls, int64_t window, int64_t open_time);
+
+void breaker_destroy (breaker_t **self_p);
+
+//  Return true if an invocation can start now, the first one once the
+//  open time elapsed is the probe
+bool breaker_allow (breaker_t *self, int64_t now);
+
+//  Return true if no invocation can start now, without changing the state
+bool breaker_blocked (breaker_t *self, int64_t now);
+
+//  Count the outcome of an invocation allowed
+void breaker_record (breaker_t *self, bool failed, int64_t now);
+
+breaker_state_t breaker_state (breaker_t *self);
+
+void breaker_test (bool verbose);
+
+#endif
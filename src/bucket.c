@@ -0,0 +1,100 @@
+#include "mql_classes.h"
+
+struct _bucket_t {
+    double rate;                //  Tokens per millisecond
+    double burst;
+    double tokens;
+    int64_t updated;
+};
+
+static void
+bucket_refill (bucket_t *self, int64_t now) {
+    if (now > self->updated) {
+        self->tokens += (now - self->updated) * self->rate;
+        if (self->tokens > self->burst)
+            self->tokens = self->burst;
+        self->updated = now;
+    }
+}
+
+bucket_t *bucket_new (double rate, double burst) {
+    assert (rate >= 0);
+
+    bucket_t *self = (bucket_t *) zmalloc (sizeof (bucket_t));
+    assert (self);
+
+    self->rate = rate / 1000;
+    self->burst = burst >= 1 ? burst : 1;
+    self->tokens = self->burst;
+
+    return self;
+}
+
+void bucket_destroy (bucket_t **self_p) {
+    assert (self_p);
+    bucket_t *self = *self_p;
+
+    if (self) {
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+bool bucket_take (bucket_t *self, int64_t now) {
+    return bucket_take_all (&self, 1, now);
+}
+
+bool bucket_take_all (bucket_t **buckets, size_t size, int64_t now) {
+    for (size_t index = 0; index < size; index++) {
+        if (buckets[index] == NULL)
+            continue;
+
+        bucket_refill (buckets[index], now);
+        if (buckets[index]->tokens < 1)
+            return false;
+    }
+
+    for (size_t index = 0; index < size; index++)
+        if (buckets[index])
+            buckets[index]->tokens -= 1;
+
+    return true;
+}
+
+bool bucket_full (bucket_t *self, int64_t now) {
+    assert (self);
+    bucket_refill (self, now);
+    return self->tokens >= self->burst;
+}
+
+void bucket_test (bool verbose) {
+    printf (" * bucket: ");
+
+    int64_t now = 1000;
+    bucket_t *tenant = bucket_new (10, 2);
+    bucket_t *type = bucket_new (1000, 3);
+
+    //  The burst, then the rate
+    assert (bucket_take (tenant, now));
+    assert (bucket_take (tenant, now));
+    assert (!bucket_take (tenant, now));
+    assert (!bucket_take (tenant, now + 50));
+    assert (bucket_take (tenant, now + 100));
+    assert (!bucket_full (tenant, now + 100));
+    assert (bucket_full (tenant, now + 1000));
+
+    //  An empty bucket takes nothing from the others
+    bucket_t *buckets[] = { NULL, type, tenant };
+    now += 1000;
+    assert (bucket_take_all (buckets, 3, now));
+    assert (bucket_take_all (buckets, 3, now));
+    assert (!bucket_take_all (buckets, 3, now));
+    assert (bucket_take (type, now));
+    assert (!bucket_take (type, now));
+
+    bucket_destroy (&tenant);
+    bucket_destroy (&type);
+    assert (tenant == NULL);
+
+    printf ("OK\n");
+}
@@ -0,0 +1,28 @@
+#ifndef BUCKET_H_INCLUDED
+#define BUCKET_H_INCLUDED
+
+#include "mql_classes.h"
+
+typedef struct _bucket_t bucket_t;
+
+//  Token bucket refilled lazily from the elapsed time whenever it is used,
+//  so idle buckets cost nothing
+
+//  Rate is in tokens per second, burst is the size of the bucket, the bucket starts full
+bucket_t *bucket_new (double rate, double burst);
+
+void bucket_destroy (bucket_t **self_p);
+
+//  Take a token, return false if the bucket is empty
+bool bucket_take (bucket_t *self, int64_t now);
+
+//  Take a token from each of the buckets, NULL ones are skipped, or from none
+//  of them if any is empty
+bool bucket_take_all (bucket_t **buckets, size_t size, int64_t now);
+
+//  Return true if the bucket refilled completely, it is then the same as a new one
+bool bucket_full (bucket_t *self, int64_t now);
+
+void bucket_test (bool verbose);
+
+#endif
@@ -0,0 +1,203 @@
+#include "mql_classes.h"
+
+typedef struct _cache_entry_t cache_entry_t;
+
+struct _cache_entry_t {
+    cache_entry_t *prev;        //  More recently used
+    cache_entry_t *next;        //  Less recently used
+    char *key;
+    char *content;
+    size_t bytes;
+    uint64_t epoch;
+    int64_t expiry;
+};
+
+struct _cache_t {
+    zhashx_t *entries;
+    cache_entry_t *head;        //  Most recently used
+    cache_entry_t *tail;
+    size_t bytes;
+    size_t max_bytes;
+};
+
+static void
+cache_entry_destroy (cache_entry_t **self_p) {
+    cache_entry_t *self = *self_p;
+    zstr_free (&self->key);
+    zstr_free (&self->content);
+
+    free (self);
+    *self_p = NULL;
+}
+
+static void
+cache_unlink (cache_t *self, cache_entry_t *entry) {
+    if (entry->prev)
+        entry->prev->next = entry->next;
+    else
+        self->head = entry->next;
+
+    if (entry->next)
+        entry->next->prev = entry->prev;
+    else
+        self->tail = entry->prev;
+
+    entry->prev = entry->next = NULL;
+}
+
+static void
+cache_push_front (cache_t *self, cache_entry_t *entry) {
+    entry->prev = NULL;
+    entry->next = self->head;
+    if (self->head)
+        self->head->prev = entry;
+    else
+        self->tail = entry;
+    self->head = entry;
+}
+
+static void
+cache_remove (cache_t *self, cache_entry_t *entry) {
+    cache_unlink (self, entry);
+    self->bytes -= entry->bytes;
+    zhashx_delete (self->entries, entry->key);
+}
+
+cache_t *cache_new (size_t max_bytes) {
+    cache_t *self = (cache_t *) zmalloc (sizeof (cache_t));
+    assert (self);
+
+    self->max_bytes = max_bytes;
+    self->entries = zhashx_new ();
+    zhashx_set_destructor (self->entries, (czmq_destructor *) cache_entry_destroy);
+
+    return self;
+}
+
+void cache_destroy (cache_t **self_p) {
+    assert (self_p);
+    cache_t *self = *self_p;
+
+    if (self) {
+        zhashx_destroy (&self->entries);
+
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+char *cache_key (const char *address, const char *subject, const char *body, size_t size) {
+    //  FNV-1a of the body
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t index = 0; index < size; index++) {
+        hash ^= (uint8_t) body[index];
+        hash *= 1099511628211ULL;
+    }
+
+    return zsys_sprintf ("%s\n%s\n%016" PRIx64, address, subject, hash);
+}
+
+void cache_insert (cache_t *self, const char *key, const char *content, uint64_t epoch, int64_t expiry) {
+    assert (self);
+
+    cache_entry_t *entry = (cache_entry_t *) zhashx_lookup (self->entries, key);
+    if (entry)
+        cache_remove (self, entry);
+
+    entry = (cache_entry_t *) zmalloc (sizeof (cache_entry_t));
+    entry->key = strdup (key);
+    entry->content = strdup (content);
+    entry->bytes = strlen (key) + strlen (content) + sizeof (cache_entry_t);
+    entry->epoch = epoch;
+    entry->expiry = expiry;
+
+    if (entry->bytes > self->max_bytes) {
+        cache_entry_destroy (&entry);
+        return;
+    }
+
+    zhashx_insert (self->entries, entry->key, entry);
+    cache_push_front (self, entry);
+    self->bytes += entry->bytes;
+
+    while (self->bytes > self->max_bytes)
+        cache_remove (self, self->tail);
+}
+
+const char *cache_lookup (cache_t *self, const char *key, uint64_t epoch, int64_t now) {
+    assert (self);
+
+    cache_entry_t *entry = (cache_entry_t *) zhashx_lookup (self->entries, key);
+    if (entry == NULL)
+        return NULL;
+
+    //  Stale entries are dropped as soon as they are found
+    if (entry->epoch != epoch || entry->expiry <= now) {
+        cache_remove (self, entry);
+        return NULL;
+    }
+
+    cache_unlink (self, entry);
+    cache_push_front (self, entry);
+
+    return entry->content;
+}
+
+size_t cache_size (cache_t *self) {
+    assert (self);
+    return zhashx_size (self->entries);
+}
+
+size_t cache_bytes (cache_t *self) {
+    assert (self);
+    return self->bytes;
+}
+
+void cache_test (bool verbose) {
+    printf (" * cache: ");
+
+    char *key_a = cache_key ("profile/1", "get-profile", "{}", 2);
+    char *key_b = cache_key ("profile/2", "get-profile", "{}", 2);
+    char *key_c = cache_key ("profile/1", "get-profile", "{\"full\":true}", 13);
+    assert (!streq (key_a, key_b) && !streq (key_a, key_c));
+
+    size_t entry_bytes = strlen (key_a) + 100 + sizeof (cache_entry_t);
+    cache_t *self = cache_new (entry_bytes * 2);
+
+    char content[101];
+    memset (content, 'a', 100);
+    content[100] = '\0';
+
+    cache_insert (self, key_a, content, 1, 1000);
+    assert (streq (cache_lookup (self, key_a, 1, 0), content));
+
+    //  A new epoch or the expiry invalidates the entry
+    assert (cache_lookup (self, key_a, 2, 0) == NULL);
+    assert (cache_size (self) == 0);
+    cache_insert (self, key_a, content, 1, 1000);
+    assert (cache_lookup (self, key_a, 1, 1000) == NULL);
+    assert (cache_size (self) == 0 && cache_bytes (self) == 0);
+
+    //  The least recently used entry is evicted
+    cache_insert (self, key_a, content, 1, 1000);
+    cache_insert (self, key_b, content, 1, 1000);
+    assert (cache_lookup (self, key_a, 1, 0));
+    content[0] = 'b';
+    cache_insert (self, key_c, content, 1, 1000);
+    assert (cache_size (self) == 2);
+    assert (cache_lookup (self, key_b, 1, 0) == NULL);
+    assert (cache_lookup (self, key_a, 1, 0));
+    assert (cache_lookup (self, key_c, 1, 0)[0] == 'b');
+
+    //  Replacing an entry
+    cache_insert (self, key_c, "{}", 1, 1000);
+    assert (streq (cache_lookup (self, key_c, 1, 0), "{}"));
+    assert (cache_size (self) == 2);
+
+    cache_destroy (&self);
+    zstr_free (&key_a);
+    zstr_free (&key_b);
+    zstr_free (&key_c);
+
+    printf ("OK\n");
+}
@@ -0,0 +1,32 @@
+#ifndef CACHE_H_INCLUDED
+#define CACHE_H_INCLUDED
+
+#include "mql_classes.h"
+
+typedef struct _cache_t cache_t;
+
+//  Replies of cacheable subjects, bounded in bytes with the least recently
+//  used entries evicted first. Each entry is tagged with the epoch of its
+//  mailbox, a mailbox invalidates all its entries by moving to a new epoch.
+
+cache_t *cache_new (size_t max_bytes);
+
+void cache_destroy (cache_t **self_p);
+
+//  Key of a message, freed by the caller
+char *cache_key (const char *address, const char *subject, const char *body, size_t size);
+
+//  Store a copy of the content, replacing the entry with the same key
+void cache_insert (cache_t *self, const char *key, const char *content, uint64_t epoch, int64_t expiry);
+
+//  Return the content if cached with the epoch and not expired, the content
+//  is valid until the cache changes
+const char *cache_lookup (cache_t *self, const char *key, uint64_t epoch, int64_t now);
+
+size_t cache_size (cache_t *self);
+
+size_t cache_bytes (cache_t *self);
+
+void cache_test (bool verbose);
+
+#endif
@@ -0,0 +1,200 @@
+#include "mql_classes.h"
+
+#define CONNTABLE_INITIAL_CAPACITY 1024
+#define CONNTABLE_END UINT32_MAX
+
+typedef struct {
+    void *connection;           //  NULL when the slot is free
+    void *timer;                //  Deadline of the connection, if any
+    uint32_t generation;
+    uint32_t next_free;
+} conntable_slot_t;
+
+struct _conntable_t {
+    conntable_slot_t *slots;
+    uint32_t capacity;
+    uint32_t free_head;
+    size_t size;
+};
+
+static void
+conntable_grow (conntable_t *self, uint32_t capacity) {
+    self->slots = (conntable_slot_t *) realloc (self->slots, capacity * sizeof (conntable_slot_t));
+    assert (self->slots);
+
+    // Chain the new slots in front of the free list
+    for (uint32_t index = self->capacity; index < capacity; index++) {
+        self->slots[index].connection = NULL;
+        self->slots[index].timer = NULL;
+        self->slots[index].generation = 1;
+        self->slots[index].next_free = index + 1 < capacity ? index + 1 : self->free_head;
+    }
+
+    self->free_head = self->capacity;
+    self->capacity = capacity;
+}
+
+conntable_t *conntable_new () {
+    conntable_t *self = (conntable_t *) zmalloc (sizeof (conntable_t));
+    assert (self);
+
+    self->free_head = CONNTABLE_END;
+    conntable_grow (self, CONNTABLE_INITIAL_CAPACITY);
+
+    return self;
+}
+
+void conntable_destroy (conntable_t **self_p) {
+    assert (self_p);
+    conntable_t *self = *self_p;
+
+    if (self) {
+        free (self->slots);
+
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+uint64_t conntable_insert (conntable_t *self, void *connection) {
+    assert (self);
+    assert (connection);
+
+    if (self->free_head == CONNTABLE_END)
+        conntable_grow (self, self->capacity * 2);
+
+    uint32_t index = self->free_head;
+    conntable_slot_t *slot = &self->slots[index];
+    self->free_head = slot->next_free;
+
+    slot->connection = connection;
+    self->size++;
+
+    return ((uint64_t) slot->generation << 32) | index;
+}
+
+static conntable_slot_t *
+conntable_slot (conntable_t *self, uint64_t handle) {
+    uint32_t index = (uint32_t) handle;
+    uint32_t generation = (uint32_t) (handle >> 32);
+
+    if (index >= self->capacity)
+        return NULL;
+
+    conntable_slot_t *slot = &self->slots[index];
+    if (slot->connection == NULL || slot->generation != generation)
+        return NULL;
+
+    return slot;
+}
+
+void *conntable_lookup (conntable_t *self, uint64_t handle) {
+    assert (self);
+
+    conntable_slot_t *slot = conntable_slot (self, handle);
+    return slot ? slot->connection : NULL;
+}
+
+void *conntable_remove (conntable_t *self, uint64_t handle) {
+    assert (self);
+
+    conntable_slot_t *slot = conntable_slot (self, handle);
+    if (slot == NULL)
+        return NULL;
+
+    void *connection = slot->connection;
+    slot->connection = NULL;
+    slot->timer = NULL;
+
+    // Generation zero is skipped, so handle zero is never valid
+    slot->generation++;
+    if (slot->generation == 0)
+        slot->generation = 1;
+
+    slot->next_free = self->free_head;
+    self->free_head = (uint32_t) handle;
+    self->size--;
+
+    return connection;
+}
+
+void conntable_set_timer (conntable_t *self, uint64_t handle, void *timer) {
+    assert (self);
+
+    conntable_slot_t *slot = conntable_slot (self, handle);
+    if (slot)
+        slot->timer = timer;
+}
+
+void *conntable_timer (conntable_t *self, uint64_t handle) {
+    assert (self);
+
+    conntable_slot_t *slot = conntable_slot (self, handle);
+    return slot ? slot->timer : NULL;
+}
+
+size_t conntable_size (conntable_t *self) {
+    assert (self);
+    return self->size;
+}
+
+void conntable_format (uint64_t handle, char *buffer) {
+    snprintf (buffer, CONNTABLE_ADDRESS_LEN, CONNTABLE_ADDRESS_PREFIX "%" PRIu64, handle);
+}
+
+uint64_t conntable_parse (const char *address) {
+    size_t prefix_len = strlen (CONNTABLE_ADDRESS_PREFIX);
+
+    if (strncmp (address, CONNTABLE_ADDRESS_PREFIX, prefix_len) != 0)
+        return 0;
+
+    return strtoull (address + prefix_len, NULL, 10);
+}
+
+void conntable_test (bool verbose) {
+    printf (" * conntable: ");
+
+    conntable_t *self = conntable_new ();
+    assert (self);
+
+    int a, b;
+    uint64_t handle_a = conntable_insert (self, &a);
+    uint64_t handle_b = conntable_insert (self, &b);
+    assert (handle_a != 0 && handle_b != 0 && handle_a != handle_b);
+    assert (conntable_lookup (self, handle_a) == &a);
+    assert (conntable_size (self) == 2);
+
+    //  A removed handle is stale, even after its slot is reused
+    assert (conntable_remove (self, handle_a) == &a);
+    assert (conntable_remove (self, handle_a) == NULL);
+    uint64_t handle_c = conntable_insert (self, &a);
+    assert ((uint32_t) handle_c == (uint32_t) handle_a);
+    assert (conntable_lookup (self, handle_a) == NULL);
+    assert (conntable_lookup (self, handle_c) == &a);
+    assert (conntable_lookup (self, 0) == NULL);
+
+    //  The timer goes away with the connection
+    int timer;
+    conntable_set_timer (self, handle_c, &timer);
+    assert (conntable_timer (self, handle_c) == &timer);
+    assert (conntable_remove (self, handle_c) == &a);
+    handle_c = conntable_insert (self, &a);
+    assert (conntable_timer (self, handle_c) == NULL);
+
+    //  Grow beyond the initial capacity
+    uint64_t handles[CONNTABLE_INITIAL_CAPACITY * 2];
+    for (int i = 0; i < CONNTABLE_INITIAL_CAPACITY * 2; i++)
+        handles[i] = conntable_insert (self, &b);
+    for (int i = 0; i < CONNTABLE_INITIAL_CAPACITY * 2; i++)
+        assert (conntable_remove (self, handles[i]) == &b);
+    assert (conntable_size (self) == 2);
+
+    char address[CONNTABLE_ADDRESS_LEN];
+    conntable_format (handle_b, address);
+    assert (conntable_parse (address) == handle_b);
+    assert (conntable_parse ("counter/1") == 0);
+
+    conntable_destroy (&self);
+
+    printf ("OK\n");
+}
@@ -0,0 +1,45 @@
+#ifndef CONNTABLE_H_INCLUDED
+#define CONNTABLE_H_INCLUDED
+
+#include "mql_classes.h"
+
+//  Address actors use to reply to an http caller, followed by the handle
+#define CONNTABLE_ADDRESS_PREFIX "$http/"
+#define CONNTABLE_ADDRESS_LEN 32
+
+typedef struct _conntable_t conntable_t;
+
+//  Slab of pending http connections. Connections are addressed by a handle
+//  made of the slot index and the slot generation, the generation changes
+//  every time the slot is freed so a handle of a completed connection is
+//  never valid again. Handle zero is never valid.
+
+conntable_t *conntable_new ();
+
+void conntable_destroy (conntable_t **self_p);
+
+uint64_t conntable_insert (conntable_t *self, void *connection);
+
+//  Return the connection, or NULL if the handle is stale
+void *conntable_lookup (conntable_t *self, uint64_t handle);
+
+//  Free the slot and return the connection, or NULL if the handle is stale
+void *conntable_remove (conntable_t *self, uint64_t handle);
+
+//  Attach the deadline timer of the connection, cleared when the slot is freed
+void conntable_set_timer (conntable_t *self, uint64_t handle, void *timer);
+
+//  Return the deadline timer of the connection, or NULL
+void *conntable_timer (conntable_t *self, uint64_t handle);
+
+size_t conntable_size (conntable_t *self);
+
+//  Format a handle as an actor address, buffer must be CONNTABLE_ADDRESS_LEN long
+void conntable_format (uint64_t handle, char *buffer);
+
+//  Parse an actor address, return zero if not an http caller
+uint64_t conntable_parse (const char *address);
+
+void conntable_test (bool verbose);
+
+#endif
@@ -0,0 +1,231 @@
+#include "mql_classes.h"
+#include <time.h>
+
+#define CRON_FIELDS 5
+#define CRON_HORIZON (5 * 366 * 24 * 60)
+
+struct _cron_t {
+    uint64_t fields[CRON_FIELDS];   //  Bit per allowed value
+    bool any_day_of_month;
+    bool any_day_of_week;
+};
+
+static const int cron_min[CRON_FIELDS] = { 0, 0, 1, 1, 0 };
+static const int cron_max[CRON_FIELDS] = { 59, 23, 31, 12, 7 };
+
+static int
+cron_parse_number (const char **text, int *value) {
+    char *end;
+    long number = strtol (*text, &end, 10);
+    if (end == *text)
+        return -1;
+
+    *text = end;
+    *value = (int) number;
+    return 0;
+}
+
+//  Parse a field, a comma separated list of *, n or n-m, each with an optional /step
+
+static int
+cron_parse_field (const char *text, int field, uint64_t *bits, bool *any) {
+    *bits = 0;
+    *any = streq (text, "*");
+
+    while (*text) {
+        int low = cron_min[field];
+        int high = cron_max[field];
+        int step = 1;
+
+        if (*text == '*')
+            text++;
+        else {
+            if (cron_parse_number (&text, &low) == -1)
+                return -1;
+            high = low;
+
+            if (*text == '-') {
+                text++;
+                if (cron_parse_number (&text, &high) == -1)
+                    return -1;
+            }
+        }
+
+        if (*text == '/') {
+            text++;
+            if (cron_parse_number (&text, &step) == -1 || step <= 0)
+                return -1;
+
+            //  n/step runs up to the end of the range
+            if (low == high)
+                high = cron_max[field];
+        }
+
+        if (low < cron_min[field] || high > cron_max[field] || low > high)
+            return -1;
+
+        for (int value = low; value <= high; value += step)
+            *bits |= (uint64_t) 1 << value;
+
+        if (*text == ',')
+            text++;
+        else
+        if (*text)
+            return -1;
+    }
+
+    return *bits ? 0 : -1;
+}
+
+cron_t *cron_new (const char *expression) {
+    assert (expression);
+
+    cron_t *self = (cron_t *) zmalloc (sizeof (cron_t));
+    assert (self);
+
+    char *copy = strdup (expression);
+    char *saveptr = NULL;
+    int field = 0;
+
+    for (char *token = strtok_r (copy, " \t", &saveptr); token; token = strtok_r (NULL, " \t", &saveptr), field++) {
+        bool any;
+        if (field == CRON_FIELDS || cron_parse_field (token, field, &self->fields[field], &any) == -1) {
+            field = -1;
+            break;
+        }
+
+        if (field == 2)
+            self->any_day_of_month = any;
+        else
+        if (field == 4)
+            self->any_day_of_week = any;
+    }
+
+    zstr_free (&copy);
+
+    if (field != CRON_FIELDS) {
+        cron_destroy (&self);
+        return NULL;
+    }
+
+    //  Sunday is both 0 and 7
+    if (self->fields[4] & ((uint64_t) 1 << 7))
+        self->fields[4] |= 1;
+
+    return self;
+}
+
+void cron_destroy (cron_t **self_p) {
+    assert (self_p);
+    cron_t *self = *self_p;
+
+    if (self) {
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+static bool
+cron_match_day (cron_t *self, struct tm *tm) {
+    bool day_of_month = (self->fields[2] >> tm->tm_mday) & 1;
+    bool day_of_week = (self->fields[4] >> tm->tm_wday) & 1;
+
+    //  When both are restricted either one matching is enough
+    if (self->any_day_of_month)
+        return day_of_week;
+    if (self->any_day_of_week)
+        return day_of_month;
+    return day_of_month || day_of_week;
+}
+
+int64_t cron_next (cron_t *self, int64_t after) {
+    assert (self);
+
+    time_t time = (time_t) (after / 60 + 1) * 60;
+    struct tm tm;
+
+    //  Skip whole months, days and hours which don't match, so at most a
+    //  few thousand steps are needed even for sparse expressions
+    for (int steps = 0; steps < CRON_HORIZON; steps++) {
+        gmtime_r (&time, &tm);
+
+        if (!((self->fields[3] >> (tm.tm_mon + 1)) & 1)) {
+            tm.tm_mon++;
+            tm.tm_mday = 1;
+            tm.tm_hour = 0;
+            tm.tm_min = 0;
+        }
+        else
+        if (!cron_match_day (self, &tm)) {
+            tm.tm_mday++;
+            tm.tm_hour = 0;
+            tm.tm_min = 0;
+        }
+        else
+        if (!((self->fields[1] >> tm.tm_hour) & 1)) {
+            tm.tm_hour++;
+            tm.tm_min = 0;
+        }
+        else
+        if (!((self->fields[0] >> tm.tm_min) & 1))
+            tm.tm_min++;
+        else
+            return (int64_t) time;
+
+        tm.tm_sec = 0;
+        time = timegm (&tm);
+    }
+
+    return -1;
+}
+
+void cron_test (bool verbose) {
+    printf (" * cron: ");
+
+    //  2021-03-14 15:09:26 UTC, a Sunday
+    int64_t now = 1615734566;
+
+    cron_t *self = cron_new ("* * * * *");
+    assert (self);
+    assert (cron_next (self, now) == 1615734600);
+    assert (cron_next (self, 1615734600) == 1615734660);
+    cron_destroy (&self);
+
+    self = cron_new ("*/15 * * * *");
+    assert (cron_next (self, now) == 1615734900);
+    cron_destroy (&self);
+
+    //  Next day at 08:30
+    self = cron_new ("30 8 * * *");
+    assert (cron_next (self, now) == 1615797000);
+    cron_destroy (&self);
+
+    //  Monday, day of week 1
+    self = cron_new ("0 0 * * 1");
+    assert (cron_next (self, now) == 1615766400);
+    cron_destroy (&self);
+
+    //  First of next month, or any Sunday when both are restricted
+    self = cron_new ("0 12 1 * 7");
+    assert (cron_next (self, now) == 1615723200 + 86400 * 7);
+    cron_destroy (&self);
+
+    self = cron_new ("0 0 1 1,6 *");
+    assert (cron_next (self, now) == 1622505600);
+    cron_destroy (&self);
+
+    //  Never happens
+    self = cron_new ("0 0 31 2 *");
+    assert (self);
+    assert (cron_next (self, now) == -1);
+    cron_destroy (&self);
+
+    assert (cron_new ("* * * *") == NULL);
+    assert (cron_new ("* * * * * *") == NULL);
+    assert (cron_new ("60 * * * *") == NULL);
+    assert (cron_new ("5-1 * * * *") == NULL);
+    assert (cron_new ("*/0 * * * *") == NULL);
+    assert (cron_new ("a * * * *") == NULL);
+
+    printf ("OK\n");
+}
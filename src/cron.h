@@ -0,0 +1,21 @@
+#ifndef CRON_H_INCLUDED
+#define CRON_H_INCLUDED
+
+#include "mql_classes.h"
+
+typedef struct _cron_t cron_t;
+
+//  Cron expression of five fields, minute hour day-of-month month day-of-week,
+//  each a list of *, values and ranges with an optional step, evaluated in UTC.
+//  Return NULL if the expression is invalid.
+cron_t *cron_new (const char *expression);
+
+void cron_destroy (cron_t **self_p);
+
+//  Return the first time matching the expression strictly after the time, in
+//  seconds since the epoch, or -1 if none within the next five years
+int64_t cron_next (cron_t *self, int64_t after);
+
+void cron_test (bool verbose);
+
+#endif
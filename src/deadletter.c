@@ -0,0 +1,572 @@
+#include "mql_classes.h"
+#include <jansson.h>
+
+typedef struct {
+    uint64_t id;
+    int64_t time;
+    long offset;                //  Line of the letter in the file
+    size_t size;
+    char *type;
+    char *address;
+    char *error;
+    bool replayed;
+    bool queued;                //  Queued for replay
+} deadletter_entry_t;
+
+struct _deadletter_t {
+    char *path;
+    FILE *file;
+    uint64_t next_id;
+    zlistx_t *entries;          //  All the letters, oldest first
+    zhashx_t *ids;
+    zhashx_t *types;            //  Letters of each actor type, address and error
+    zhashx_t *addresses;
+    zhashx_t *errors;
+    zlistx_t *replaying;
+};
+
+static void
+deadletter_entry_destroy (deadletter_entry_t **self_p) {
+    deadletter_entry_t *self = *self_p;
+
+    if (self) {
+        zstr_free (&self->type);
+        zstr_free (&self->address);
+        zstr_free (&self->error);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+static void
+deadletter_index (zhashx_t *index, const char *key, deadletter_entry_t *entry) {
+    zlistx_t *entries = (zlistx_t *) zhashx_lookup (index, key);
+    if (!entries) {
+        entries = zlistx_new ();
+        zhashx_insert (index, key, entries);
+    }
+    zlistx_add_end (entries, entry);
+}
+
+static void
+deadletter_index_entry (deadletter_t *self, deadletter_entry_t *entry) {
+    char key[32];
+    snprintf (key, sizeof (key), "%" PRIu64, entry->id);
+    zhashx_insert (self->ids, key, entry);
+
+    deadletter_index (self->types, entry->type, entry);
+    deadletter_index (self->addresses, entry->address, entry);
+    deadletter_index (self->errors, entry->error, entry);
+}
+
+static deadletter_entry_t *
+deadletter_insert (deadletter_t *self, uint64_t id, int64_t time, long offset, size_t size,
+                   const char *type, const char *address, const char *error) {
+    deadletter_entry_t *entry = (deadletter_entry_t *) zmalloc (sizeof (deadletter_entry_t));
+    entry->id = id;
+    entry->time = time;
+    entry->offset = offset;
+    entry->size = size;
+    entry->type = strdup (type);
+    entry->address = strdup (address);
+    entry->error = strdup (error);
+
+    zlistx_add_end (self->entries, entry);
+    deadletter_index_entry (self, entry);
+
+    if (id >= self->next_id)
+        self->next_id = id + 1;
+
+    return entry;
+}
+
+static deadletter_entry_t *
+deadletter_lookup (deadletter_t *self, uint64_t id) {
+    char key[32];
+    snprintf (key, sizeof (key), "%" PRIu64, id);
+    return (deadletter_entry_t *) zhashx_lookup (self->ids, key);
+}
+
+static void
+deadletter_load (deadletter_t *self) {
+    char *line = NULL;
+    size_t capacity = 0;
+    long offset = ftell (self->file);
+    ssize_t size;
+
+    while ((size = getline (&line, &capacity, self->file)) != -1) {
+        json_error_t error;
+        json_t *letter = json_loads (line, 0, &error);
+        json_t *id = json_object_get (letter, "id");
+        json_t *replayed = json_object_get (letter, "replayed");
+
+        if (json_is_integer (replayed)) {
+            deadletter_entry_t *entry = deadletter_lookup (self, (uint64_t) json_integer_value (replayed));
+            if (entry)
+                entry->replayed = true;
+        }
+        else {
+            const char *type = json_string_value (json_object_get (letter, "type"));
+            const char *address = json_string_value (json_object_get (letter, "address"));
+            const char *error_str = json_string_value (json_object_get (letter, "error"));
+
+            if (!json_is_integer (id) || !type || !address || !error_str)
+                zsys_warning ("Deadletter: skipping invalid letter at %ld", offset);
+            else
+                deadletter_insert (self, (uint64_t) json_integer_value (id),
+                                   json_integer_value (json_object_get (letter, "time")),
+                                   offset, (size_t) size, type, address, error_str);
+        }
+
+        if (letter)
+            json_decref (letter);
+        offset += size;
+    }
+
+    free (line);
+}
+
+deadletter_t *deadletter_new (const char *path) {
+    assert (path);
+
+    FILE *file = fopen (path, "a+");
+    if (file == NULL) {
+        zsys_error ("Deadletter: fail to open %s", path);
+        return NULL;
+    }
+
+    deadletter_t *self = (deadletter_t *) zmalloc (sizeof (deadletter_t));
+    assert (self);
+
+    self->path = strdup (path);
+    self->file = file;
+    self->next_id = 1;
+    self->entries = zlistx_new ();
+    zlistx_set_destructor (self->entries, (czmq_destructor *) deadletter_entry_destroy);
+    self->ids = zhashx_new ();
+    self->types = zhashx_new ();
+    zhashx_set_destructor (self->types, (czmq_destructor *) zlistx_destroy);
+    self->addresses = zhashx_new ();
+    zhashx_set_destructor (self->addresses, (czmq_destructor *) zlistx_destroy);
+    self->errors = zhashx_new ();
+    zhashx_set_destructor (self->errors, (czmq_destructor *) zlistx_destroy);
+    self->replaying = zlistx_new ();
+
+    rewind (self->file);
+    deadletter_load (self);
+
+    zsys_info ("Deadletter: %zu letters in %s", zlistx_size (self->entries), path);
+
+    return self;
+}
+
+void deadletter_destroy (deadletter_t **self_p) {
+    assert (self_p);
+    deadletter_t *self = *self_p;
+
+    if (self) {
+        zlistx_destroy (&self->replaying);
+        zhashx_destroy (&self->ids);
+        zhashx_destroy (&self->types);
+        zhashx_destroy (&self->addresses);
+        zhashx_destroy (&self->errors);
+        zlistx_destroy (&self->entries);
+        fclose (self->file);
+        zstr_free (&self->path);
+
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+uint64_t deadletter_add (deadletter_t *self, const char *type, const char *address, const char *from,
+                         const char *subject, const char *error, payload_t *body) {
+    assert (self);
+    assert (type);
+    assert (address);
+    assert (subject);
+    assert (error);
+
+    uint64_t id = self->next_id;
+    int64_t time = zclock_time ();
+
+    json_t *envelope = json_pack ("{sIsIssssssssss?}",
+                                  "id", (json_int_t) id, "time", (json_int_t) time,
+                                  "type", type, "address", address, "subject", subject, "error", error,
+                                  "from", from);
+    char *line = payload_wrap (body, envelope);
+    json_decref (envelope);
+    if (line == NULL) {
+        zsys_error ("Deadletter: fail to read the body of a letter of %s", address);
+        return 0;
+    }
+
+    //  Appended whatever the position, which is only moved to read
+    fseek (self->file, 0, SEEK_END);
+    long offset = ftell (self->file);
+    size_t size = strlen (line);
+
+    int rc = fprintf (self->file, "%s\n", line);
+    zstr_free (&line);
+    if (rc < 0 || fflush (self->file) != 0) {
+        zsys_error ("Deadletter: fail to write letter of %s", address);
+        return 0;
+    }
+
+    deadletter_insert (self, id, time, offset, size + 1, type, address, error);
+
+    return id;
+}
+
+static bool
+deadletter_match (deadletter_entry_t *entry, const char *type, const char *address, const char *error) {
+    return (!type || streq (entry->type, type))
+        && (!address || streq (entry->address, address))
+        && (!error || streq (entry->error, error));
+}
+
+//  The shortest list of letters which can match the filters, NULL if none can
+static zlistx_t *
+deadletter_candidates (deadletter_t *self, const char *type, const char *address, const char *error) {
+    zlistx_t *best = self->entries;
+
+    const char *keys[] = { address, type, error };
+    zhashx_t *indexes[] = { self->addresses, self->types, self->errors };
+
+    for (int index = 0; index < 3; index++) {
+        if (keys[index] == NULL)
+            continue;
+
+        zlistx_t *entries = (zlistx_t *) zhashx_lookup (indexes[index], keys[index]);
+        if (entries == NULL)
+            return NULL;
+        if (zlistx_size (entries) < zlistx_size (best))
+            best = entries;
+    }
+
+    return best;
+}
+
+json_t *deadletter_list (deadletter_t *self, const char *type, const char *address, const char *error,
+                         bool replayed, size_t limit) {
+    assert (self);
+
+    json_t *letters = json_array ();
+    zlistx_t *entries = deadletter_candidates (self, type, address, error);
+
+    for (deadletter_entry_t *entry = entries ? (deadletter_entry_t *) zlistx_first (entries) : NULL;
+         entry && json_array_size (letters) < limit; entry = (deadletter_entry_t *) zlistx_next (entries)) {
+        if ((replayed || !entry->replayed) && deadletter_match (entry, type, address, error))
+            json_array_append_new (letters, json_pack ("{sIsIsssssssb}",
+                                                       "id", (json_int_t) entry->id, "time", (json_int_t) entry->time,
+                                                       "type", entry->type, "address", entry->address,
+                                                       "error", entry->error, "replayed", entry->replayed));
+    }
+
+    return letters;
+}
+
+size_t deadletter_replay (deadletter_t *self, const char *type, const char *address, const char *error) {
+    assert (self);
+
+    size_t count = 0;
+    zlistx_t *entries = deadletter_candidates (self, type, address, error);
+
+    for (deadletter_entry_t *entry = entries ? (deadletter_entry_t *) zlistx_first (entries) : NULL;
+         entry; entry = (deadletter_entry_t *) zlistx_next (entries)) {
+        if (!entry->replayed && !entry->queued && deadletter_match (entry, type, address, error)) {
+            entry->queued = true;
+            zlistx_add_end (self->replaying, entry);
+            count++;
+        }
+    }
+
+    return count;
+}
+
+json_t *deadletter_next (deadletter_t *self) {
+    assert (self);
+
+    deadletter_entry_t *entry;
+    while ((entry = (deadletter_entry_t *) zlistx_detach (self->replaying, NULL))) {
+        entry->queued = false;
+
+        char *line = (char *) malloc (entry->size + 1);
+        assert (line);
+        json_t *letter = NULL;
+
+        if (fseek (self->file, entry->offset, SEEK_SET) == 0 && fread (line, 1, entry->size, self->file) == entry->size) {
+            line[entry->size] = '\0';
+            json_error_t error;
+            letter = json_loads (line, 0, &error);
+        }
+        free (line);
+
+        if (letter == NULL) {
+            zsys_error ("Deadletter: fail to read letter %" PRIu64, entry->id);
+            continue;
+        }
+
+        //  Marked before it is sent, a letter is replayed at most once
+        entry->replayed = true;
+        fseek (self->file, 0, SEEK_END);
+        fprintf (self->file, "{\"replayed\":%" PRIu64 "}\n", entry->id);
+        fflush (self->file);
+
+        return letter;
+    }
+
+    return NULL;
+}
+
+//  Copy the line of the letter at the end of the file, return its new offset, -1 on error
+static long
+deadletter_copy (deadletter_t *self, deadletter_entry_t *entry, char *line, FILE *file) {
+    long offset = ftell (file);
+    if (offset == -1
+    ||  fseek (self->file, entry->offset, SEEK_SET) != 0
+    ||  fread (line, 1, entry->size, self->file) != entry->size
+    ||  fwrite (line, 1, entry->size, file) != entry->size)
+        return -1;
+
+    return offset;
+}
+
+//  Whether compaction drops the letter, counted in dropped
+static bool
+deadletter_drop (deadletter_entry_t *entry, int64_t max_age, size_t excess, int64_t now, size_t *dropped) {
+    bool drop = !entry->queued && (entry->replayed || (max_age > 0 && entry->time < now - max_age) || *dropped < excess);
+    if (drop)
+        (*dropped)++;
+    return drop;
+}
+
+size_t deadletter_compact (deadletter_t *self, int64_t max_age, size_t max_letters, int64_t now) {
+    assert (self);
+
+    //  Oldest first, the letters beyond the limit go along with the replayed and expired ones
+    size_t size = zlistx_size (self->entries);
+    size_t excess = max_letters > 0 && size > max_letters ? size - max_letters : 0;
+    size_t dropped = 0;
+    size_t longest = 0;
+
+    for (deadletter_entry_t *entry = (deadletter_entry_t *) zlistx_first (self->entries); entry;
+         entry = (deadletter_entry_t *) zlistx_next (self->entries)) {
+        if (!deadletter_drop (entry, max_age, excess, now, &dropped) && entry->size > longest)
+            longest = entry->size;
+    }
+
+    if (dropped == 0)
+        return 0;
+
+    //  The letters kept are copied to a new file, which then replaces the old one
+    char *temp = zsys_sprintf ("%s.compact", self->path);
+    FILE *file = fopen (temp, "w");
+    long *offsets = (long *) zmalloc (sizeof (long) * (size - dropped + 1));
+    char *line = (char *) malloc (longest + 1);
+    size_t kept = 0;
+    int rc = file ? 0 : -1;
+
+    dropped = 0;
+    for (deadletter_entry_t *entry = (deadletter_entry_t *) zlistx_first (self->entries); entry && rc == 0;
+         entry = (deadletter_entry_t *) zlistx_next (self->entries)) {
+        if (deadletter_drop (entry, max_age, excess, now, &dropped))
+            continue;
+
+        offsets[kept] = deadletter_copy (self, entry, line, file);
+        if (offsets[kept++] == -1)
+            rc = -1;
+    }
+    free (line);
+
+    if (file && (fclose (file) != 0 || rc != 0 || rename (temp, self->path) != 0)) {
+        rc = -1;
+        unlink (temp);
+    }
+    zstr_free (&temp);
+
+    if (rc != 0) {
+        zsys_error ("Deadletter: fail to compact %s", self->path);
+        free (offsets);
+        return 0;
+    }
+
+    fclose (self->file);
+    self->file = fopen (self->path, "a+");
+    assert (self->file);
+
+    //  The dropped letters leave the indexes, which are rebuilt from the ones kept
+    zhashx_purge (self->ids);
+    zhashx_purge (self->types);
+    zhashx_purge (self->addresses);
+    zhashx_purge (self->errors);
+
+    zlistx_t *entries = zlistx_new ();
+    zlistx_set_destructor (entries, (czmq_destructor *) deadletter_entry_destroy);
+    kept = 0;
+    dropped = 0;
+
+    deadletter_entry_t *entry;
+    while ((entry = (deadletter_entry_t *) zlistx_detach (self->entries, NULL))) {
+        if (deadletter_drop (entry, max_age, excess, now, &dropped)) {
+            deadletter_entry_destroy (&entry);
+            continue;
+        }
+
+        entry->offset = offsets[kept++];
+        zlistx_add_end (entries, entry);
+        deadletter_index_entry (self, entry);
+    }
+    zlistx_destroy (&self->entries);
+    self->entries = entries;
+    free (offsets);
+
+    zsys_info ("Deadletter: compacted %s, %zu letters dropped, %zu kept", self->path, dropped, kept);
+
+    return dropped;
+}
+
+size_t deadletter_replaying (deadletter_t *self) {
+    assert (self);
+    return zlistx_size (self->replaying);
+}
+
+size_t deadletter_size (deadletter_t *self) {
+    assert (self);
+    return zlistx_size (self->entries);
+}
+
+#define SELFTEST_DIR_RW "src/selftest-rw"
+
+void deadletter_test (bool verbose) {
+    printf (" * deadletter: ");
+
+    const char *path = SELFTEST_DIR_RW "/deadletters.jsonl";
+    unlink (path);
+
+    deadletter_t *self = deadletter_new (path);
+    assert (self);
+    assert (deadletter_size (self) == 0);
+
+    payload_t *body = payload_new ("{\"n\":1}", 7);
+    assert (deadletter_add (self, "counter", "counter/1", "timer/1", "inc", "500", body) == 1);
+    assert (deadletter_add (self, "counter", "counter/2", NULL, "inc", "503", NULL) == 2);
+    assert (deadletter_add (self, "mailer", "mailer/1", "counter/1", "send", "500", body) == 3);
+    payload_decref (&body);
+
+    //  By actor type, address and error
+    json_t *letters = deadletter_list (self, "counter", NULL, NULL, false, 100);
+    assert (json_array_size (letters) == 2);
+    json_decref (letters);
+
+    letters = deadletter_list (self, "counter", NULL, "500", false, 100);
+    assert (json_array_size (letters) == 1);
+    assert (json_integer_value (json_object_get (json_array_get (letters, 0), "id")) == 1);
+    json_decref (letters);
+
+    letters = deadletter_list (self, NULL, "mailer/1", NULL, false, 100);
+    assert (json_array_size (letters) == 1);
+    json_decref (letters);
+
+    letters = deadletter_list (self, "none", NULL, NULL, false, 100);
+    assert (json_array_size (letters) == 0);
+    json_decref (letters);
+
+    letters = deadletter_list (self, NULL, NULL, NULL, false, 2);
+    assert (json_array_size (letters) == 2);
+    json_decref (letters);
+
+    //  Replay reads the letters back, once
+    assert (deadletter_replay (self, NULL, NULL, "500") == 2);
+    assert (deadletter_replay (self, NULL, NULL, "500") == 0);
+    assert (deadletter_replaying (self) == 2);
+
+    json_t *letter = deadletter_next (self);
+    assert (letter);
+    assert (streq (json_string_value (json_object_get (letter, "address")), "counter/1"));
+    assert (streq (json_string_value (json_object_get (letter, "from")), "timer/1"));
+    assert (streq (json_string_value (json_object_get (letter, "subject")), "inc"));
+    assert (json_integer_value (json_object_get (json_object_get (letter, "body"), "n")) == 1);
+    json_decref (letter);
+
+    //  Letters added while replaying don't disturb the reads
+    payload_t *ref = payload_new_ref ("sha256:00");
+    assert (deadletter_add (self, "mailer", "mailer/2", NULL, "send", "500", ref) == 4);
+    payload_decref (&ref);
+
+    letter = deadletter_next (self);
+    assert (streq (json_string_value (json_object_get (letter, "address")), "mailer/1"));
+    json_decref (letter);
+    assert (deadletter_next (self) == NULL);
+
+    letters = deadletter_list (self, NULL, NULL, NULL, false, 100);
+    assert (json_array_size (letters) == 2);
+    json_decref (letters);
+    deadletter_destroy (&self);
+
+    //  The index and the replayed marks are restored
+    self = deadletter_new (path);
+    assert (deadletter_size (self) == 4);
+    letters = deadletter_list (self, NULL, NULL, "500", true, 100);
+    assert (json_array_size (letters) == 3);
+    assert (json_is_true (json_object_get (json_array_get (letters, 0), "replayed")));
+    json_decref (letters);
+
+    assert (deadletter_replay (self, NULL, NULL, NULL) == 2);
+    letter = deadletter_next (self);
+    assert (json_integer_value (json_object_get (letter, "id")) == 2);
+    assert (json_is_null (json_object_get (letter, "body")));
+    json_decref (letter);
+    letter = deadletter_next (self);
+    assert (streq (json_string_value (json_object_get (letter, "body_ref")), "sha256:00"));
+    json_decref (letter);
+
+    assert (deadletter_add (self, "counter", "counter/3", NULL, "inc", "500", NULL) == 5);
+
+    //  Compaction drops the replayed letters, then the expired and the oldest ones
+    fseek (self->file, 0, SEEK_END);
+    long before = ftell (self->file);
+    assert (deadletter_compact (self, 0, 0, zclock_time ()) == 4);
+    assert (deadletter_size (self) == 1);
+    fseek (self->file, 0, SEEK_END);
+    assert (ftell (self->file) < before);
+    assert (deadletter_compact (self, 0, 0, zclock_time ()) == 0);
+
+    letters = deadletter_list (self, "counter", NULL, "500", true, 100);
+    assert (json_array_size (letters) == 1);
+    assert (json_integer_value (json_object_get (json_array_get (letters, 0), "id")) == 5);
+    json_decref (letters);
+    letters = deadletter_list (self, NULL, "counter/1", NULL, true, 100);
+    assert (json_array_size (letters) == 0);
+    json_decref (letters);
+
+    assert (deadletter_add (self, "counter", "counter/4", NULL, "inc", "500", NULL) == 6);
+    assert (deadletter_compact (self, 0, 2, zclock_time ()) == 0);
+    assert (deadletter_compact (self, 0, 1, zclock_time ()) == 1);
+    assert (deadletter_compact (self, 1000, 0, zclock_time () + 2000) == 1);
+    assert (deadletter_size (self) == 0);
+
+    //  Letters queued for replay are kept and read back from the new file
+    assert (deadletter_add (self, "counter", "counter/5", NULL, "inc", "500", NULL) == 7);
+    assert (deadletter_add (self, "counter", "counter/6", NULL, "inc", "500", NULL) == 8);
+    assert (deadletter_replay (self, NULL, "counter/6", NULL) == 1);
+    assert (deadletter_compact (self, 0, 1, zclock_time ()) == 1);
+    letter = deadletter_next (self);
+    assert (streq (json_string_value (json_object_get (letter, "address")), "counter/6"));
+    json_decref (letter);
+    deadletter_destroy (&self);
+
+    //  The compacted file is loaded as it was left
+    self = deadletter_new (path);
+    assert (deadletter_size (self) == 1);
+    letters = deadletter_list (self, NULL, NULL, NULL, true, 100);
+    assert (json_is_true (json_object_get (json_array_get (letters, 0), "replayed")));
+    json_decref (letters);
+    assert (deadletter_add (self, "counter", "counter/7", NULL, "inc", "500", NULL) == 9);
+
+    deadletter_destroy (&self);
+    assert (self == NULL);
+    unlink (path);
+
+    printf ("OK\n");
+}
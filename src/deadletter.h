@@ -0,0 +1,46 @@
+#ifndef DEADLETTER_H_INCLUDED
+#define DEADLETTER_H_INCLUDED
+
+#include "mql_classes.h"
+
+typedef struct _deadletter_t deadletter_t;
+
+//  Messages which failed without an http caller to tell, appended to a file
+//  of json lines and indexed in memory by actor type, address and error.
+//  Replayed letters are marked in the file too.
+
+//  Open the file, indexing the letters already in it, NULL on error
+deadletter_t *deadletter_new (const char *path);
+
+void deadletter_destroy (deadletter_t **self_p);
+
+//  Append a letter, return its id, zero if it can't be written
+uint64_t deadletter_add (deadletter_t *self, const char *type, const char *address, const char *from,
+                         const char *subject, const char *error, payload_t *body);
+
+//  Letters matching the filters, NULL ones match anything, oldest first,
+//  without their bodies
+json_t *deadletter_list (deadletter_t *self, const char *type, const char *address, const char *error,
+                         bool replayed, size_t limit);
+
+//  Queue the letters matching the filters and not replayed yet for replay,
+//  return how many were queued
+size_t deadletter_replay (deadletter_t *self, const char *type, const char *address, const char *error);
+
+//  Read the next letter queued for replay and mark it replayed, NULL if none
+json_t *deadletter_next (deadletter_t *self);
+
+//  Drop the replayed letters, the ones older than max_age milliseconds and
+//  the oldest beyond max_letters, zero for no limit, and rewrite the file
+//  with the letters kept. Letters queued for replay are kept. Return how
+//  many were dropped.
+size_t deadletter_compact (deadletter_t *self, int64_t max_age, size_t max_letters, int64_t now);
+
+//  Letters queued for replay
+size_t deadletter_replaying (deadletter_t *self);
+
+size_t deadletter_size (deadletter_t *self);
+
+void deadletter_test (bool verbose);
+
+#endif
@@ -0,0 +1,425 @@
+#include "mql_classes.h"
+
+#define DEDUP_BUCKET_SIZE 4
+#define DEDUP_MAX_KICKS 500
+
+typedef struct {
+    uint32_t *slots;            //  Fingerprints by bucket, zero is a free slot
+    size_t size;
+} dedup_filter_t;
+
+typedef struct _dedup_entry_t dedup_entry_t;
+
+struct _dedup_entry_t {
+    dedup_entry_t *prev;        //  Completed entries, oldest first
+    dedup_entry_t *next;
+    char *key;
+    uint64_t connection;        //  Connection of the original, zero once completed
+    uint64_t *waiting;          //  Connections of the duplicates
+    size_t waiting_size;
+    size_t waiting_capacity;
+    char *reply;
+    int64_t expiry;
+};
+
+struct _dedup_t {
+    dedup_filter_t filters[2];  //  The current generation and the previous one
+    int current;
+    size_t buckets;             //  Buckets of a filter, a power of two
+    int window;
+    int64_t rotate_at;
+    uint64_t random;            //  State of the victim selection
+    zhashx_t *entries;          //  Exact entries by key
+    zhashx_t *pending;          //  Pending entries by connection
+    dedup_entry_t *oldest;
+    dedup_entry_t *newest;
+    size_t completed;
+    size_t recent;              //  Completed entries kept
+};
+
+static uint64_t
+dedup_mix (uint64_t hash) {
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+    return hash;
+}
+
+static uint64_t
+dedup_hash (const char *key) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char *c = key; *c; c++) {
+        hash ^= (uint8_t) *c;
+        hash *= 1099511628211ULL;
+    }
+    return dedup_mix (hash);
+}
+
+//  The alternate bucket is derived from the fingerprint alone, so an evicted
+//  fingerprint can move without knowing its key
+static size_t
+dedup_alternate (dedup_t *self, size_t bucket, uint32_t fingerprint) {
+    return (bucket ^ (size_t) dedup_mix (fingerprint)) & (self->buckets - 1);
+}
+
+static bool
+dedup_bucket_insert (dedup_filter_t *filter, size_t bucket, uint32_t fingerprint) {
+    uint32_t *slots = filter->slots + bucket * DEDUP_BUCKET_SIZE;
+    for (int slot = 0; slot < DEDUP_BUCKET_SIZE; slot++) {
+        if (slots[slot] == 0) {
+            slots[slot] = fingerprint;
+            filter->size++;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool
+dedup_bucket_delete (dedup_filter_t *filter, size_t bucket, uint32_t fingerprint) {
+    uint32_t *slots = filter->slots + bucket * DEDUP_BUCKET_SIZE;
+    for (int slot = 0; slot < DEDUP_BUCKET_SIZE; slot++) {
+        if (slots[slot] == fingerprint) {
+            slots[slot] = 0;
+            filter->size--;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool
+dedup_bucket_contains (dedup_filter_t *filter, size_t bucket, uint32_t fingerprint) {
+    uint32_t *slots = filter->slots + bucket * DEDUP_BUCKET_SIZE;
+    for (int slot = 0; slot < DEDUP_BUCKET_SIZE; slot++)
+        if (slots[slot] == fingerprint)
+            return true;
+    return false;
+}
+
+static void
+dedup_fingerprint (dedup_t *self, const char *key, size_t *bucket, uint32_t *fingerprint) {
+    uint64_t hash = dedup_hash (key);
+    *fingerprint = (uint32_t) (hash >> 32);
+    if (*fingerprint == 0)
+        *fingerprint = 1;
+    *bucket = (size_t) hash & (self->buckets - 1);
+}
+
+static bool
+dedup_filter_contains (dedup_t *self, dedup_filter_t *filter, size_t bucket, uint32_t fingerprint) {
+    return dedup_bucket_contains (filter, bucket, fingerprint)
+        || dedup_bucket_contains (filter, dedup_alternate (self, bucket, fingerprint), fingerprint);
+}
+
+static bool
+dedup_filter_delete (dedup_t *self, dedup_filter_t *filter, size_t bucket, uint32_t fingerprint) {
+    return dedup_bucket_delete (filter, bucket, fingerprint)
+        || dedup_bucket_delete (filter, dedup_alternate (self, bucket, fingerprint), fingerprint);
+}
+
+//  Return false if the filter is full, one fingerprint was lost then
+static bool
+dedup_filter_insert (dedup_t *self, dedup_filter_t *filter, size_t bucket, uint32_t fingerprint) {
+    if (dedup_bucket_insert (filter, bucket, fingerprint))
+        return true;
+
+    bucket = dedup_alternate (self, bucket, fingerprint);
+    if (dedup_bucket_insert (filter, bucket, fingerprint))
+        return true;
+
+    //  Kick a random fingerprint to its alternate bucket, until one finds room
+    for (int kick = 0; kick < DEDUP_MAX_KICKS; kick++) {
+        self->random ^= self->random << 13;
+        self->random ^= self->random >> 7;
+        self->random ^= self->random << 17;
+
+        uint32_t *slot = filter->slots + bucket * DEDUP_BUCKET_SIZE + self->random % DEDUP_BUCKET_SIZE;
+        uint32_t victim = *slot;
+        *slot = fingerprint;
+        fingerprint = victim;
+
+        bucket = dedup_alternate (self, bucket, fingerprint);
+        if (dedup_bucket_insert (filter, bucket, fingerprint))
+            return true;
+    }
+
+    return false;
+}
+
+static void
+dedup_filter_clear (dedup_t *self, dedup_filter_t *filter) {
+    memset (filter->slots, 0, self->buckets * DEDUP_BUCKET_SIZE * sizeof (uint32_t));
+    filter->size = 0;
+}
+
+static void
+dedup_rotate (dedup_t *self, int64_t now) {
+    self->current = 1 - self->current;
+    dedup_filter_clear (self, &self->filters[self->current]);
+    self->rotate_at = now + self->window;
+}
+
+static void
+dedup_entry_destroy (dedup_entry_t **self_p) {
+    dedup_entry_t *self = *self_p;
+    zstr_free (&self->key);
+    zstr_free (&self->reply);
+    free (self->waiting);
+
+    free (self);
+    *self_p = NULL;
+}
+
+//  Drop the oldest replies, beyond the count kept or the window
+static void
+dedup_expire (dedup_t *self, int64_t now) {
+    while (self->oldest && (self->completed > self->recent || self->oldest->expiry <= now)) {
+        dedup_entry_t *entry = self->oldest;
+        self->oldest = entry->next;
+        if (self->oldest)
+            self->oldest->prev = NULL;
+        else
+            self->newest = NULL;
+
+        self->completed--;
+        zhashx_delete (self->entries, entry->key);
+    }
+}
+
+dedup_t *dedup_new (size_t capacity, int window, size_t recent, int64_t now) {
+    assert (window > 0);
+
+    dedup_t *self = (dedup_t *) zmalloc (sizeof (dedup_t));
+    assert (self);
+
+    self->buckets = 1;
+    while (self->buckets * DEDUP_BUCKET_SIZE < capacity)
+        self->buckets *= 2;
+
+    for (int index = 0; index < 2; index++) {
+        self->filters[index].slots = (uint32_t *) zmalloc (self->buckets * DEDUP_BUCKET_SIZE * sizeof (uint32_t));
+        assert (self->filters[index].slots);
+    }
+
+    self->window = window;
+    self->rotate_at = now + window;
+    self->random = 0x9e3779b97f4a7c15ULL;
+    self->recent = recent;
+    self->entries = zhashx_new ();
+    zhashx_set_destructor (self->entries, (czmq_destructor *) dedup_entry_destroy);
+    self->pending = zhashx_new ();
+
+    return self;
+}
+
+void dedup_destroy (dedup_t **self_p) {
+    assert (self_p);
+    dedup_t *self = *self_p;
+
+    if (self) {
+        zhashx_destroy (&self->pending);
+        zhashx_destroy (&self->entries);
+        free (self->filters[0].slots);
+        free (self->filters[1].slots);
+
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+dedup_state_t dedup_check (dedup_t *self, const char *key, uint64_t connection, int64_t now, const char **reply) {
+    assert (self);
+    assert (key);
+    assert (connection);
+
+    if (now >= self->rotate_at) {
+        //  Nothing in either generation is within the window anymore
+        if (now >= self->rotate_at + self->window)
+            dedup_rotate (self, now);
+        dedup_rotate (self, now);
+    }
+    dedup_expire (self, now);
+
+    dedup_entry_t *entry = (dedup_entry_t *) zhashx_lookup (self->entries, key);
+    if (entry && entry->connection) {
+        if (entry->waiting_size == entry->waiting_capacity) {
+            entry->waiting_capacity = entry->waiting_capacity ? entry->waiting_capacity * 2 : 4;
+            entry->waiting = (uint64_t *) realloc (entry->waiting, entry->waiting_capacity * sizeof (uint64_t));
+            assert (entry->waiting);
+        }
+        entry->waiting[entry->waiting_size++] = connection;
+        return DEDUP_PENDING;
+    }
+    else
+    if (entry) {
+        if (reply)
+            *reply = entry->reply;
+        return DEDUP_DONE;
+    }
+
+    size_t bucket;
+    uint32_t fingerprint;
+    dedup_fingerprint (self, key, &bucket, &fingerprint);
+
+    if (dedup_filter_contains (self, &self->filters[0], bucket, fingerprint)
+    ||  dedup_filter_contains (self, &self->filters[1], bucket, fingerprint))
+        return DEDUP_CONFLICT;
+
+    //  A full filter shortens the window rather than growing
+    if (!dedup_filter_insert (self, &self->filters[self->current], bucket, fingerprint)) {
+        zsys_warning ("dedup: filter full, rotating early");
+        dedup_rotate (self, now);
+        dedup_filter_insert (self, &self->filters[self->current], bucket, fingerprint);
+    }
+
+    entry = (dedup_entry_t *) zmalloc (sizeof (dedup_entry_t));
+    entry->key = strdup (key);
+    entry->connection = connection;
+    zhashx_insert (self->entries, entry->key, entry);
+
+    char handle[17];
+    snprintf (handle, sizeof (handle), "%" PRIx64, connection);
+    zhashx_insert (self->pending, handle, entry);
+
+    return DEDUP_NEW;
+}
+
+size_t dedup_complete (dedup_t *self, uint64_t connection, const char *reply, int64_t now, uint64_t **waiting_p) {
+    assert (self);
+    assert (waiting_p);
+    *waiting_p = NULL;
+
+    //  Most replies have no idempotency key
+    if (zhashx_size (self->pending) == 0)
+        return 0;
+
+    char handle[17];
+    snprintf (handle, sizeof (handle), "%" PRIx64, connection);
+    dedup_entry_t *entry = (dedup_entry_t *) zhashx_lookup (self->pending, handle);
+    if (!entry)
+        return 0;
+
+    zhashx_delete (self->pending, handle);
+
+    size_t waiting_size = entry->waiting_size;
+    *waiting_p = entry->waiting;
+    entry->waiting = NULL;
+    entry->waiting_size = entry->waiting_capacity = 0;
+
+    if (reply) {
+        entry->connection = 0;
+        entry->reply = strdup (reply);
+        entry->expiry = now + self->window;
+
+        entry->prev = self->newest;
+        if (self->newest)
+            self->newest->next = entry;
+        else
+            self->oldest = entry;
+        self->newest = entry;
+        self->completed++;
+
+        dedup_expire (self, now);
+    }
+    else {
+        //  Forget the key, so the caller can retry
+        size_t bucket;
+        uint32_t fingerprint;
+        dedup_fingerprint (self, entry->key, &bucket, &fingerprint);
+
+        if (!dedup_filter_delete (self, &self->filters[self->current], bucket, fingerprint))
+            dedup_filter_delete (self, &self->filters[1 - self->current], bucket, fingerprint);
+
+        zhashx_delete (self->entries, entry->key);
+    }
+
+    return waiting_size;
+}
+
+bool dedup_pending (dedup_t *self, uint64_t connection) {
+    assert (self);
+
+    if (zhashx_size (self->pending) == 0)
+        return false;
+
+    char handle[17];
+    snprintf (handle, sizeof (handle), "%" PRIx64, connection);
+    return zhashx_lookup (self->pending, handle) != NULL;
+}
+
+size_t dedup_size (dedup_t *self) {
+    assert (self);
+    return self->filters[0].size + self->filters[1].size;
+}
+
+void dedup_test (bool verbose) {
+    printf (" * dedup: ");
+
+    int64_t now = 1000;
+    dedup_t *self = dedup_new (1024, 100, 2, now);
+    const char *reply = NULL;
+    uint64_t *waiting = NULL;
+
+    //  Duplicates wait for the original
+    assert (dedup_check (self, "a", 1, now, &reply) == DEDUP_NEW);
+    assert (dedup_check (self, "a", 2, now, &reply) == DEDUP_PENDING);
+    assert (dedup_check (self, "a", 3, now, &reply) == DEDUP_PENDING);
+    assert (dedup_complete (self, 7, "other", now, &waiting) == 0);
+    assert (dedup_complete (self, 1, "{\"ok\":1}", now, &waiting) == 2);
+    assert (waiting[0] == 2 && waiting[1] == 3);
+    free (waiting);
+
+    //  Then get its reply
+    assert (dedup_check (self, "a", 4, now, &reply) == DEDUP_DONE);
+    assert (streq (reply, "{\"ok\":1}"));
+
+    //  A failed original can be retried
+    assert (dedup_check (self, "b", 5, now, &reply) == DEDUP_NEW);
+    assert (dedup_complete (self, 5, NULL, now, &waiting) == 0);
+    assert (dedup_check (self, "b", 6, now, &reply) == DEDUP_NEW);
+    assert (dedup_complete (self, 6, "b", now, &waiting) == 0);
+
+    //  An original whose caller timed out stays pending until it completes,
+    //  the retry waits for it and is answered with its reply
+    assert (dedup_check (self, "t", 20, now, &reply) == DEDUP_NEW);
+    assert (dedup_pending (self, 20));
+    assert (dedup_check (self, "t", 21, now, &reply) == DEDUP_PENDING);
+    assert (dedup_complete (self, 20, "{\"ran\":1}", now, &waiting) == 1);
+    assert (waiting[0] == 21);
+    free (waiting);
+    assert (!dedup_pending (self, 20));
+    assert (dedup_check (self, "t", 22, now, &reply) == DEDUP_DONE);
+    assert (streq (reply, "{\"ran\":1}"));
+
+    //  Once the reply is dropped only the filter knows the key
+    assert (dedup_check (self, "c", 7, now, &reply) == DEDUP_NEW);
+    assert (dedup_complete (self, 7, "c", now, &waiting) == 0);
+    assert (dedup_check (self, "a", 8, now, &reply) == DEDUP_CONFLICT);
+    assert (dedup_check (self, "c", 9, now, &reply) == DEDUP_DONE);
+    assert (dedup_size (self) == 4);
+
+    //  Keys are known for at least a window, and forgotten after two
+    now += 150;
+    assert (dedup_check (self, "a", 10, now, &reply) == DEDUP_CONFLICT);
+    now += 100;
+    assert (dedup_check (self, "a", 11, now, &reply) == DEDUP_NEW);
+    assert (dedup_complete (self, 11, NULL, now, &waiting) == 0);
+
+    //  Far more keys than the capacity, the memory stays fixed
+    for (int index = 0; index < 10000; index++) {
+        char key[16];
+        snprintf (key, sizeof (key), "key-%d", index);
+        dedup_state_t state = dedup_check (self, key, 100 + index, now, &reply);
+        assert (state == DEDUP_NEW || state == DEDUP_CONFLICT);
+        if (state == DEDUP_NEW)
+            dedup_complete (self, 100 + index, "x", now, &waiting);
+    }
+    assert (dedup_size (self) <= 2048);
+
+    dedup_destroy (&self);
+
+    printf ("OK\n");
+}
@@ -0,0 +1,44 @@
+#ifndef DEDUP_H_INCLUDED
+#define DEDUP_H_INCLUDED
+
+#include "mql_classes.h"
+
+typedef struct _dedup_t dedup_t;
+
+typedef enum {
+    DEDUP_NEW,                  //  First time the key is seen, pending on the connection
+    DEDUP_PENDING,              //  The original is in flight, the connection waits for its reply
+    DEDUP_DONE,                 //  The original was answered, its reply is still kept
+    DEDUP_CONFLICT              //  The key was seen within the window, its reply is gone
+} dedup_state_t;
+
+//  Idempotency keys seen within the window. Keys are remembered by a pair of
+//  cuckoo filters of fixed capacity, rotated every window, so a key is known
+//  for at least a window while the memory stays fixed. The replies of the
+//  most recent keys are kept in an exact map.
+
+dedup_t *dedup_new (size_t capacity, int window, size_t recent, int64_t now);
+
+void dedup_destroy (dedup_t **self_p);
+
+//  Look the key up and record a new key as pending on the connection. A
+//  duplicate of a pending key is attached to the original, the reply of a
+//  completed one is returned, valid until the dedup changes.
+dedup_state_t dedup_check (dedup_t *self, const char *key, uint64_t connection, int64_t now, const char **reply);
+
+//  Complete the key pending on the connection, if any, with its reply or
+//  NULL when it failed, so the key can be retried. Return the count of
+//  duplicates waiting for the reply, their connections are returned in an
+//  array freed by the caller.
+size_t dedup_complete (dedup_t *self, uint64_t connection, const char *reply, int64_t now, uint64_t **waiting_p);
+
+//  Return true if a key is pending on the connection, its reply is awaited
+//  by retries even once the connection itself is gone
+bool dedup_pending (dedup_t *self, uint64_t connection);
+
+//  Keys in the filters
+size_t dedup_size (dedup_t *self);
+
+void dedup_test (bool verbose);
+
+#endif
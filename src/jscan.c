@@ -0,0 +1,531 @@
+#include "mql_classes.h"
+#include <jansson.h>
+
+#if defined (__SSE2__)
+#include <immintrin.h>
+#endif
+
+//  AVX2 is picked at runtime, so a default x86-64 build still uses it
+#if defined (__x86_64__) && defined (__GNUC__)
+#define JSCAN_AVX2_DISPATCH
+#endif
+
+//  Same limit as the jansson parser
+#define JSCAN_MAX_DEPTH 2048
+
+//  Integers beyond this count of digits may not fit a json_int_t
+#define JSCAN_MAX_INTEGER_DIGITS 18
+
+#define JSCAN_OBJECT 1
+#define JSCAN_ARRAY 2
+
+static const char *
+jscan_skip_whitespace (const char *cursor, const char *end) {
+    while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\n' || *cursor == '\r'))
+        cursor++;
+    return cursor;
+}
+
+#if defined (JSCAN_AVX2_DISPATCH)
+static int jscan_avx2 = -1;
+
+//  Skip whole chunks of 32 plain bytes, the rest is left to the caller
+__attribute__ ((target ("avx2")))
+static const char *
+jscan_skip_plain_avx2 (const char *cursor, const char *end) {
+    const __m256i quote = _mm256_set1_epi8 ('"');
+    const __m256i backslash = _mm256_set1_epi8 ('\\');
+    const __m256i space = _mm256_set1_epi8 (0x20);
+
+    while (end - cursor >= 32) {
+        __m256i chunk = _mm256_loadu_si256 ((const __m256i *) cursor);
+
+        //  Signed compare, so bytes from 0x80 are below the space too
+        __m256i special = _mm256_or_si256 (
+            _mm256_or_si256 (_mm256_cmpeq_epi8 (chunk, quote), _mm256_cmpeq_epi8 (chunk, backslash)),
+            _mm256_cmpgt_epi8 (space, chunk));
+
+        uint32_t mask = (uint32_t) _mm256_movemask_epi8 (special);
+        if (mask)
+            return cursor + __builtin_ctz (mask);
+        cursor += 32;
+    }
+    return cursor;
+}
+#endif
+
+//  Skip to the next byte of the string which isn't plain ascii: a quote, a
+//  backslash, a control character or the start of a multi byte sequence
+static const char *
+jscan_skip_plain (const char *cursor, const char *end) {
+#if defined (JSCAN_AVX2_DISPATCH)
+    if (jscan_avx2 == -1)
+        jscan_avx2 = __builtin_cpu_supports ("avx2") ? 1 : 0;
+    if (jscan_avx2)
+        cursor = jscan_skip_plain_avx2 (cursor, end);
+#endif
+#if defined (__SSE2__)
+    const __m128i quote16 = _mm_set1_epi8 ('"');
+    const __m128i backslash16 = _mm_set1_epi8 ('\\');
+    const __m128i space16 = _mm_set1_epi8 (0x20);
+
+    while (end - cursor >= 16) {
+        __m128i chunk = _mm_loadu_si128 ((const __m128i *) cursor);
+        __m128i special = _mm_or_si128 (
+            _mm_or_si128 (_mm_cmpeq_epi8 (chunk, quote16), _mm_cmpeq_epi8 (chunk, backslash16)),
+            _mm_cmplt_epi8 (chunk, space16));
+
+        uint32_t mask = (uint32_t) _mm_movemask_epi8 (special);
+        if (mask)
+            return cursor + __builtin_ctz (mask);
+        cursor += 16;
+    }
+#endif
+    while (cursor < end) {
+        uint8_t c = (uint8_t) *cursor;
+        if (c == '"' || c == '\\' || c < 0x20 || c >= 0x80)
+            break;
+        cursor++;
+    }
+    return cursor;
+}
+
+//  Skip a multi byte sequence, rejecting overlong forms, surrogates and
+//  code points beyond U+10FFFF as jansson does
+static const char *
+jscan_skip_utf8 (const char *cursor, const char *end) {
+    uint8_t first = (uint8_t) cursor[0];
+    int length;
+    uint8_t low = 0x80, high = 0xBF;
+
+    if (first < 0xC2)
+        return NULL;
+    else
+    if (first < 0xE0)
+        length = 2;
+    else
+    if (first < 0xF0) {
+        length = 3;
+        if (first == 0xE0)
+            low = 0xA0;
+        else
+        if (first == 0xED)
+            high = 0x9F;
+    }
+    else
+    if (first < 0xF5) {
+        length = 4;
+        if (first == 0xF0)
+            low = 0x90;
+        else
+        if (first == 0xF4)
+            high = 0x8F;
+    }
+    else
+        return NULL;
+
+    if (end - cursor < length)
+        return NULL;
+
+    uint8_t second = (uint8_t) cursor[1];
+    if (second < low || second > high)
+        return NULL;
+
+    for (int index = 2; index < length; index++)
+        if (((uint8_t) cursor[index] & 0xC0) != 0x80)
+            return NULL;
+
+    return cursor + length;
+}
+
+static int
+jscan_hex (const char *cursor) {
+    int value = 0;
+    for (int index = 0; index < 4; index++) {
+        char c = cursor[index];
+        value <<= 4;
+        if (c >= '0' && c <= '9')
+            value |= c - '0';
+        else
+        if (c >= 'a' && c <= 'f')
+            value |= c - 'a' + 10;
+        else
+        if (c >= 'A' && c <= 'F')
+            value |= c - 'A' + 10;
+        else
+            return -1;
+    }
+    return value;
+}
+
+//  Skip the string starting at the opening quote, NULL if invalid
+static const char *
+jscan_skip_string (const char *cursor, const char *end) {
+    cursor++;
+
+    while (true) {
+        cursor = jscan_skip_plain (cursor, end);
+        if (cursor == end)
+            return NULL;
+
+        uint8_t c = (uint8_t) *cursor;
+        if (c == '"')
+            return cursor + 1;
+        else
+        if (c == '\\') {
+            if (end - cursor < 2)
+                return NULL;
+
+            char escape = cursor[1];
+            if (escape != 'u') {
+                if (!strchr ("\"\\/bfnrt", escape) || escape == '\0')
+                    return NULL;
+                cursor += 2;
+                continue;
+            }
+
+            if (end - cursor < 6)
+                return NULL;
+            int code = jscan_hex (cursor + 2);
+            cursor += 6;
+
+            //  No NUL without JSON_ALLOW_NUL, surrogates only in pairs
+            if (code <= 0 || (code >= 0xDC00 && code <= 0xDFFF))
+                return NULL;
+            if (code >= 0xD800 && code <= 0xDBFF) {
+                if (end - cursor < 6 || cursor[0] != '\\' || cursor[1] != 'u')
+                    return NULL;
+                int low = jscan_hex (cursor + 2);
+                if (low < 0xDC00 || low > 0xDFFF)
+                    return NULL;
+                cursor += 6;
+            }
+        }
+        else
+        if (c < 0x20)
+            return NULL;
+        else {
+            cursor = jscan_skip_utf8 (cursor, end);
+            if (!cursor)
+                return NULL;
+        }
+    }
+}
+
+static const char *
+jscan_skip_digits (const char *cursor, const char *end) {
+    while (cursor < end && *cursor >= '0' && *cursor <= '9')
+        cursor++;
+    return cursor;
+}
+
+//  Skip the number, NULL if invalid. Complex is set for the numbers which
+//  may overflow, only jansson knows if it takes them.
+static const char *
+jscan_skip_number (const char *cursor, const char *end, bool *complex) {
+    if (*cursor == '-')
+        cursor++;
+
+    const char *digits = cursor;
+    if (cursor == end || *cursor < '0' || *cursor > '9')
+        return NULL;
+    if (*cursor == '0')
+        cursor++;
+    else
+        cursor = jscan_skip_digits (cursor, end);
+    size_t integer_digits = cursor - digits;
+    bool real = false;
+
+    if (cursor < end && *cursor == '.') {
+        real = true;
+        const char *fraction = ++cursor;
+        cursor = jscan_skip_digits (cursor, end);
+        if (cursor == fraction)
+            return NULL;
+    }
+
+    if (cursor < end && (*cursor == 'e' || *cursor == 'E')) {
+        real = true;
+        cursor++;
+        if (cursor < end && (*cursor == '+' || *cursor == '-'))
+            cursor++;
+        const char *exponent = cursor;
+        cursor = jscan_skip_digits (cursor, end);
+        if (cursor == exponent)
+            return NULL;
+        if (cursor - exponent > 2)
+            *complex = true;
+    }
+
+    if (real ? integer_digits > 300 : integer_digits > JSCAN_MAX_INTEGER_DIGITS)
+        *complex = true;
+
+    return cursor;
+}
+
+static const char *
+jscan_skip_literal (const char *cursor, const char *end, const char *literal) {
+    size_t length = strlen (literal);
+    if ((size_t) (end - cursor) < length || memcmp (cursor, literal, length) != 0)
+        return NULL;
+    return cursor + length;
+}
+
+//  Scan the text, collecting the spans of the keys when the top level is an object
+static int
+jscan_scan (const char *data, size_t size, const char **keys, jscan_span_t *spans, size_t count, bool object) {
+    if (data == NULL)
+        return -1;
+
+    for (size_t index = 0; index < count; index++) {
+        spans[index].data = NULL;
+        spans[index].size = 0;
+    }
+
+    const char *cursor = jscan_skip_whitespace (data, data + size);
+    const char *end = data + size;
+    uint8_t stack[JSCAN_MAX_DEPTH];
+    int depth = 0;
+    int members = 0;
+    bool complex = false;
+
+    //  Member of the top level object whose value is being scanned
+    int member = -1;
+    const char *member_value = NULL;
+
+    if (cursor == end || (*cursor != '{' && (object || *cursor != '[')))
+        return -1;
+
+    while (true) {
+        //  A value
+        if (cursor == end)
+            return -1;
+
+        char c = *cursor;
+        if (c == '{' || c == '[') {
+            if (depth == JSCAN_MAX_DEPTH)
+                return JSCAN_COMPLEX;
+            stack[depth++] = c == '{' ? JSCAN_OBJECT : JSCAN_ARRAY;
+            cursor = jscan_skip_whitespace (cursor + 1, end);
+
+            if (cursor < end && *cursor == (c == '{' ? '}' : ']')) {
+                cursor++;
+                depth--;
+            }
+            else
+            if (c == '[')
+                continue;
+            else
+                goto key;
+        }
+        else
+        if (c == '"')
+            cursor = jscan_skip_string (cursor, end);
+        else
+        if (c == '-' || (c >= '0' && c <= '9'))
+            cursor = jscan_skip_number (cursor, end, &complex);
+        else
+        if (c == 't')
+            cursor = jscan_skip_literal (cursor, end, "true");
+        else
+        if (c == 'f')
+            cursor = jscan_skip_literal (cursor, end, "false");
+        else
+        if (c == 'n')
+            cursor = jscan_skip_literal (cursor, end, "null");
+        else
+            return -1;
+
+        if (!cursor)
+            return -1;
+
+        //  After a value, close the containers it ends
+        while (true) {
+            if (depth == 1 && member >= 0) {
+                spans[member].data = member_value;
+                spans[member].size = cursor - member_value;
+                member = -1;
+            }
+
+            cursor = jscan_skip_whitespace (cursor, end);
+            if (depth == 0) {
+                if (cursor != end)
+                    return -1;
+                return complex ? JSCAN_COMPLEX : members;
+            }
+            if (cursor == end)
+                return -1;
+
+            char closing = stack[depth - 1] == JSCAN_OBJECT ? '}' : ']';
+            if (*cursor == closing) {
+                cursor++;
+                depth--;
+                continue;
+            }
+            if (*cursor != ',')
+                return -1;
+
+            cursor = jscan_skip_whitespace (cursor + 1, end);
+            break;
+        }
+
+        if (stack[depth - 1] == JSCAN_ARRAY)
+            continue;
+
+      key:
+        if (cursor == end || *cursor != '"')
+            return -1;
+
+        const char *key = cursor + 1;
+        cursor = jscan_skip_string (cursor, end);
+        if (!cursor)
+            return -1;
+        size_t key_size = cursor - 1 - key;
+
+        cursor = jscan_skip_whitespace (cursor, end);
+        if (cursor == end || *cursor != ':')
+            return -1;
+        cursor = jscan_skip_whitespace (cursor + 1, end);
+
+        if (depth == 1) {
+            members++;
+            member_value = cursor;
+            for (size_t index = 0; index < count; index++) {
+                if (strlen (keys[index]) == key_size && memcmp (keys[index], key, key_size) == 0) {
+                    member = (int) index;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+int jscan_validate (const char *data, size_t size) {
+    int rc = jscan_scan (data, size, NULL, NULL, 0, false);
+
+    if (rc == JSCAN_COMPLEX) {
+        json_error_t error;
+        json_t *root = json_loadb (data, size, 0, &error);
+        rc = root ? 0 : -1;
+        json_decref (root);
+    }
+
+    return rc < 0 ? -1 : 0;
+}
+
+int jscan_object (const char *data, size_t size, const char **keys, jscan_span_t *spans, size_t count) {
+    return jscan_scan (data, size, keys, spans, count, true);
+}
+
+void jscan_test (bool verbose) {
+    printf (" * jscan: ");
+
+    const char *valid[] = {
+        "{}", "[]", " [1, -2, 3.5e-3, 0, -0.0, true, false, null] ",
+        "{\"a\": {\"b\": [\"c\", {}]}, \"d\": \"\\\"\\\\\\/\\b\\f\\n\\r\\t\\u00e9\\ud83d\\ude00\"}",
+        "[\"caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80\"]",
+        "[\"a string long enough to be skipped thirty two bytes at a time, or sixteen\"]",
+        "[1e100, 123456789012345678]",  //  Checked by jansson
+        NULL
+    };
+    for (int index = 0; valid[index]; index++) {
+        assert (jscan_validate (valid[index], strlen (valid[index])) == 0);
+        json_t *root = json_loads (valid[index], 0, NULL);
+        assert (root);
+        json_decref (root);
+    }
+
+    const char *invalid[] = {
+        "", "1", "\"top\"", "{", "[1,]", "{\"a\" 1}", "{\"a\": 1,}", "[01]", "[1.]", "[.5]", "[-]",
+        "[tru]", "[nul]", "{} {}", "{1: 2}", "[\"\\x\"]", "[\"\\u00\"]", "[\"\\u0000\"]",
+        "[\"\\ud83d\"]", "[\"\\ude00\"]", "[\"tab\tin string\"]", "[\"\xc0\xaf\"]", "[\"\xed\xa0\x80\"]",
+        "[\"\xf4\x90\x80\x80\"]", "[\"\xe2\x82\"]", "[\"unterminated", "[1e999]",
+        "[99999999999999999999999999]",
+        NULL
+    };
+    for (int index = 0; invalid[index]; index++) {
+        assert (jscan_validate (invalid[index], strlen (invalid[index])) == -1);
+        json_t *root = json_loads (invalid[index], 0, NULL);
+        assert (root == NULL);
+    }
+
+    //  Nesting beyond the limit of jansson
+    char deep[JSCAN_MAX_DEPTH * 2 + 3];
+    memset (deep, '[', JSCAN_MAX_DEPTH + 1);
+    memset (deep + JSCAN_MAX_DEPTH + 1, ']', JSCAN_MAX_DEPTH + 1);
+    deep[sizeof (deep) - 1] = '\0';
+    assert (jscan_validate (deep, strlen (deep)) == -1);
+
+    //  Raw values of the top level keys only
+    const char *keys[] = { "subject", "body", "missing" };
+    jscan_span_t spans[3];
+    const char *reply = "{\"body\": {\"subject\": 1, \"n\": [1, 2]} , \"subject\":\"done\"}";
+    assert (jscan_object (reply, strlen (reply), keys, spans, 3) == 2);
+    assert (spans[0].size == 6 && memcmp (spans[0].data, "\"done\"", 6) == 0);
+    assert (spans[1].size == 27 && memcmp (spans[1].data, "{\"subject\": 1, \"n\": [1, 2]}", 27) == 0);
+    assert (spans[2].data == NULL);
+
+    assert (jscan_object ("[1]", 3, keys, spans, 3) == -1);
+    assert (jscan_object ("{}", 2, keys, spans, 3) == 0);
+    assert (jscan_object ("{\"body\": 1e400}", 15, keys, spans, 3) == JSCAN_COMPLEX);
+
+    //  Special bytes at every offset of long strings, with and without AVX2
+    char text[160];
+    for (int mode = 0; mode < 2; mode++) {
+#if defined (JSCAN_AVX2_DISPATCH)
+        if (mode == 1)
+            jscan_avx2 = 0;
+#endif
+        for (int offset = 2; offset < 150; offset++) {
+            memset (text, 'a', sizeof (text));
+            memcpy (text, "[\"", 2);
+            memcpy (text + sizeof (text) - 2, "\"]", 2);
+            assert (jscan_validate (text, sizeof (text)) == 0);
+            text[offset] = '\t';
+            assert (jscan_validate (text, sizeof (text)) == -1);
+            text[offset] = '\x80';
+            assert (jscan_validate (text, sizeof (text)) == -1);
+            text[offset] = '"';
+            assert (jscan_validate (text, sizeof (text)) == -1);
+        }
+    }
+#if defined (JSCAN_AVX2_DISPATCH)
+    jscan_avx2 = -1;
+#endif
+
+    //  Throughput against jansson, on mostly ascii and mostly multi byte text
+    if (verbose) {
+        const char *fills[] = { "lorem ipsum dolor sit amet ", "\xc3\xa9t\xc3\xa9 \xe2\x82\xac " };
+        for (int index = 0; index < 2; index++) {
+            size_t size = 1024 * 1024;
+            char *body = (char *) zmalloc (size + 256);
+            size_t length = strlen ("{\"a\": [");
+            memcpy (body, "{\"a\": [", length);
+            while (length < size) {
+                length += snprintf (body + length, 256, "\"%s%s%s\", %d, ", fills[index], fills[index], fills[index],
+                                    (int) length);
+            }
+            length += snprintf (body + length, 64, "0]}");
+
+            int64_t start = zclock_usecs ();
+            for (int run = 0; run < 20; run++)
+                assert (jscan_validate (body, length) == 0);
+            int64_t scan = zclock_usecs () - start;
+
+            start = zclock_usecs ();
+            for (int run = 0; run < 20; run++) {
+                json_t *root = json_loadb (body, length, 0, NULL);
+                assert (root);
+                json_decref (root);
+            }
+            int64_t parse = zclock_usecs () - start;
+
+            printf ("\n   %s: jscan %.0f MB/s, jansson %.0f MB/s", index == 0 ? "ascii" : "utf-8",
+                    20.0 * length / scan, 20.0 * length / parse);
+            free (body);
+        }
+        printf ("\n   ");
+    }
+
+    printf ("OK\n");
+}
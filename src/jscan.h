@@ -0,0 +1,30 @@
+#ifndef JSCAN_H_INCLUDED
+#define JSCAN_H_INCLUDED
+
+#include "mql_classes.h"
+
+//  Single pass json validation, without building a tree. Strings, where
+//  most of the bytes of large bodies are, are skipped with SIMD compares
+//  when the target has them. Like json_loads, the text must be an object
+//  or an array with valid UTF-8 strings.
+
+//  Returned for numbers jansson may refuse, and nesting beyond its limit
+#define JSCAN_COMPLEX -2
+
+typedef struct {
+    const char *data;           //  First byte of the value, NULL when the key is missing
+    size_t size;
+} jscan_span_t;
+
+//  Return 0 if the text is valid json, -1 otherwise. Complex texts are
+//  checked with jansson.
+int jscan_validate (const char *data, size_t size);
+
+//  Validate an object and find the raw values of the keys at its top level.
+//  Return the count of members of the object, -1 if invalid or not an
+//  object, or JSCAN_COMPLEX if only jansson can tell.
+int jscan_object (const char *data, size_t size, const char **keys, jscan_span_t *spans, size_t count);
+
+void jscan_test (bool verbose);
+
+#endif
@@ -0,0 +1,239 @@
+#include "mql_classes.h"
+#include <jansson.h>
+
+//  Limits kept in the history, at most one per second
+#define LIMITER_HISTORY 60
+
+typedef struct {
+    int64_t time;
+    double limit;
+} limiter_sample_t;
+
+struct _limiter_t {
+    double limit;
+    double min;
+    double max;
+    double tolerance;           //  Ratio of the latency to its baseline taken for congestion
+    size_t inflight;
+    double latency;             //  Moving average of the recent invocations
+    double baseline;            //  Moving average of many invocations, the latency without congestion
+    int64_t decreased;          //  Time of the last decrease
+    limiter_sample_t history[LIMITER_HISTORY];
+    size_t history_head;        //  Most recent sample
+    size_t history_size;
+};
+
+limiter_t *limiter_new (double initial, double min, double max, double tolerance) {
+    assert (min >= 1);
+    assert (max >= min);
+
+    limiter_t *self = (limiter_t *) zmalloc (sizeof (limiter_t));
+    assert (self);
+
+    self->min = min;
+    self->max = max;
+    self->limit = initial < min ? min : initial > max ? max : initial;
+    self->tolerance = tolerance > 1 ? tolerance : 2;
+
+    return self;
+}
+
+void limiter_destroy (limiter_t **self_p) {
+    assert (self_p);
+    limiter_t *self = *self_p;
+
+    if (self) {
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+bool limiter_acquire (limiter_t *self) {
+    assert (self);
+
+    if (self->inflight >= limiter_limit (self))
+        return false;
+
+    self->inflight++;
+    return true;
+}
+
+//  Invocations in flight together see the same congestion, so the limit
+//  decreases once per round of invocations
+static void
+limiter_decrease (limiter_t *self, double factor, int64_t now) {
+    if (now - self->decreased < (int64_t) self->latency)
+        return;
+
+    self->limit *= factor;
+    if (self->limit < self->min)
+        self->limit = self->min;
+    self->decreased = now;
+}
+
+static void
+limiter_record (limiter_t *self, int64_t now) {
+    limiter_sample_t *last = &self->history[self->history_head];
+
+    if (self->history_size > 0 && last->time / 1000 == now / 1000) {
+        last->limit = self->limit;
+        return;
+    }
+
+    self->history_head = (self->history_head + 1) % LIMITER_HISTORY;
+    self->history[self->history_head].time = now;
+    self->history[self->history_head].limit = self->limit;
+    if (self->history_size < LIMITER_HISTORY)
+        self->history_size++;
+}
+
+void limiter_release (limiter_t *self, int64_t latency, bool throttled, int64_t now) {
+    assert (self);
+    assert (self->inflight > 0);
+
+    bool saturated = self->inflight >= limiter_limit (self) / 2;
+    self->inflight--;
+
+    if (throttled)
+        limiter_decrease (self, 0.5, now);
+    else {
+        self->latency = self->latency > 0 ? self->latency * 0.8 + latency * 0.2 : latency;
+        self->baseline = self->baseline > 0 ? self->baseline * 0.99 + latency * 0.01 : latency;
+
+        if (self->latency > self->baseline * self->tolerance)
+            limiter_decrease (self, 0.9, now);
+        else
+        //  Only a limit in use grows, an idle function keeps its limit
+        if (saturated) {
+            self->limit += 1 / self->limit;
+            if (self->limit > self->max)
+                self->limit = self->max;
+        }
+    }
+
+    limiter_record (self, now);
+}
+
+void limiter_cancel (limiter_t *self) {
+    assert (self);
+    assert (self->inflight > 0);
+    self->inflight--;
+}
+
+size_t limiter_available (limiter_t *self) {
+    assert (self);
+    size_t limit = limiter_limit (self);
+    return self->inflight < limit ? limit - self->inflight : 0;
+}
+
+size_t limiter_limit (limiter_t *self) {
+    assert (self);
+    return (size_t) self->limit;
+}
+
+size_t limiter_inflight (limiter_t *self) {
+    assert (self);
+    return self->inflight;
+}
+
+json_t *limiter_status (limiter_t *self, int64_t now) {
+    assert (self);
+
+    json_t *history = json_array ();
+    for (size_t index = 0; index < self->history_size; index++) {
+        limiter_sample_t *sample = &self->history[(self->history_head + LIMITER_HISTORY - index) % LIMITER_HISTORY];
+        json_array_append_new (history, json_pack ("[Ii]", (json_int_t) (now - sample->time), (int) sample->limit));
+    }
+
+    return json_pack ("{sisisisfsfso}",
+                      "limit", (int) limiter_limit (self),
+                      "min", (int) self->min,
+                      "inflight", (int) self->inflight,
+                      "latency", self->latency,
+                      "baseline", self->baseline,
+                      "history", history);
+}
+
+void limiter_test (bool verbose) {
+    printf (" * limiter: ");
+
+    int64_t now = 1000;
+    limiter_t *self = limiter_new (4, 2, 8, 2);
+    assert (limiter_limit (self) == 4);
+
+    //  Up to the limit
+    for (int index = 0; index < 4; index++)
+        assert (limiter_acquire (self));
+    assert (!limiter_acquire (self));
+    assert (limiter_available (self) == 0);
+    limiter_cancel (self);
+    assert (limiter_available (self) == 1);
+    assert (limiter_acquire (self));
+
+    //  Grows by about one per round while saturated and the latency is stable
+    for (int round = 0; round < 6; round++) {
+        size_t limit = limiter_limit (self);
+        assert (limit >= (size_t) (round < 4 ? 4 + round : 8) - 1);
+        for (size_t index = 0; index < limit; index++) {
+            now += 10;
+            limiter_release (self, 100, false, now);
+            assert (limiter_acquire (self));
+        }
+        while (limiter_acquire (self));
+    }
+    assert (limiter_limit (self) == 8);
+    assert (limiter_inflight (self) == 8);
+
+    //  Capped to the maximum
+    for (int index = 0; index < 8; index++) {
+        now += 10;
+        limiter_release (self, 100, false, now);
+        assert (limiter_acquire (self));
+    }
+    assert (limiter_limit (self) == 8);
+
+    //  Throttles halve the limit once per round, not once per invocation
+    now += 1000;
+    limiter_release (self, 0, true, now);
+    limiter_release (self, 0, true, now + 1);
+    assert (limiter_limit (self) == 4);
+    assert (limiter_inflight (self) == 6);
+    assert (limiter_available (self) == 0);
+
+    //  Never below the minimum
+    now += 1000;
+    limiter_release (self, 0, true, now);
+    now += 1000;
+    limiter_release (self, 0, true, now);
+    assert (limiter_limit (self) == 2);
+
+    //  Rising latency decreases it too
+    while (limiter_inflight (self) > 0) {
+        now += 10;
+        limiter_release (self, 100, false, now);
+    }
+    limiter_destroy (&self);
+
+    self = limiter_new (10, 1, 100, 2);
+    for (int index = 0; index < 10; index++)
+        assert (limiter_acquire (self));
+    limiter_release (self, 100, false, now);
+    limiter_release (self, 100, false, now);
+    for (int index = 0; index < 6; index++) {
+        now += 2000;
+        limiter_release (self, 1000, false, now);
+    }
+    assert (limiter_limit (self) < 10);
+
+    json_t *status = limiter_status (self, now);
+    assert (json_integer_value (json_object_get (status, "limit")) == (json_int_t) limiter_limit (self));
+    assert (json_array_size (json_object_get (status, "history")) == 7);
+    json_t *latest = json_array_get (json_object_get (status, "history"), 0);
+    assert (json_integer_value (json_array_get (latest, 0)) == 0);
+    json_decref (status);
+
+    limiter_destroy (&self);
+    assert (self == NULL);
+
+    printf ("OK\n");
+}
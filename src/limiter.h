@@ -0,0 +1,39 @@
+#ifndef LIMITER_H_INCLUDED
+#define LIMITER_H_INCLUDED
+
+#include "mql_classes.h"
+
+typedef struct _limiter_t limiter_t;
+
+//  Concurrency limit of a function adapted to its behavior: it grows by one
+//  per round of invocations while the latency stays near its baseline, and
+//  shrinks multiplicatively when the latency rises or invocations are throttled
+
+limiter_t *limiter_new (double initial, double min, double max, double tolerance);
+
+void limiter_destroy (limiter_t **self_p);
+
+//  Count an invocation in flight, return false if the limit is reached
+bool limiter_acquire (limiter_t *self);
+
+//  Count the completion of an invocation which took latency milliseconds,
+//  throttled when the function refused it for its own concurrency
+void limiter_release (limiter_t *self, int64_t latency, bool throttled, int64_t now);
+
+//  Count an invocation acquired but never started, without feedback
+void limiter_cancel (limiter_t *self);
+
+//  Invocations which can still start
+size_t limiter_available (limiter_t *self);
+
+size_t limiter_limit (limiter_t *self);
+
+size_t limiter_inflight (limiter_t *self);
+
+//  Limit, latencies and history of the limit, each entry the age in
+//  milliseconds and the limit then, most recent first
+json_t *limiter_status (limiter_t *self, int64_t now);
+
+void limiter_test (bool verbose);
+
+#endif
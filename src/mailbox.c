@@ -2,82 +2,197 @@
 #include <string.h>
 #include <jansson.h>
 
-typedef struct {
+typedef struct _mailbox_item_t mailbox_item_t;
+
+struct _mailbox_item_t {
+    mailbox_item_t *next;       // Next message of the lane
     mailbox_t *parent;
-    char *from;
+    char *address;              // Actor of a shared stateless mailbox, NULL for the mailbox address
+    char *from;                 // Sender actor, NULL when sent by an http caller
+    uint64_t connection;        // Http caller waiting for the reply
     char *subject;
-    json_t *body;
-    void *connection;
-} mailbox_item_t;
+    payload_t *body;
+    size_t size;                // Bytes accounted against the quotas
+    actor_type_access_t access;
+    int priority;
+    int cache_ttl;              // Milliseconds the reply is cached, zero when the subject isn't cacheable
+    char *cache_key;            // Key of the reply of an http caller, set when invoked
+    uint64_t epoch;             // Epoch of the mailbox when invoked
+    int64_t started;            // Time the invocation started
+    int64_t expiry;             // Time the message is not worth invoking anymore, zero if never
+    char *coalesce_key;         // Key of the latest pending message of a coalesced subject
+    arena_t *arena;             // Arena of the json of the completion, left when destroyed
+};
+
+typedef struct {
+    mailbox_item_t *head;
+    mailbox_item_t *tail;
+} mailbox_lane_t;
 
 struct _mailbox_t {
     char *address;
-    char *actor_type;
-    zlistx_t *queue;
+    uint32_t id;                // Interned id of the mailbox, used by topic subscriptions
+    actor_type_t *type;
+    mailbox_lane_t lanes[ACTOR_TYPE_PRIORITIES];  // A queue per priority, zero is the highest
+    size_t length;
+    int lane;                   // Lane served by the weighted dequeue
+    int credit;                 // Messages the lane is still served before moving to the next one
+    quota_t *quota;
     mql_server_t *server;
-    aws_t *aws;
-    bool inprogress;
+    int running[ACTOR_TYPE_REENTRANT + 1];  // Invocations in progress by access
+    bool scheduled;
+    bool waiting;               // Waiting for the concurrency limiter of the type
+    zhashx_t *pending;          // Latest pending message by key, for the coalesced subjects
+    uint64_t epoch;             // Moves on every non-cacheable invocation, invalidating the cached replies
 };
 
 static void mailbox_item_callback (mailbox_item_t *self, zhttp_response_t *response);
 
+static bool mailbox_fits (mailbox_t *self, size_t size);
+
 static mailbox_item_t *lambda_request_new (mailbox_t *parent,
+                                           const char *address,
                                            const char *from,
+                                           uint64_t connection,
                                            const char *subject,
-                                           json_t *body) {
+                                           payload_t *body,
+                                           int priority,
+                                           int ttl) {
     mailbox_item_t *self = (mailbox_item_t *) zmalloc (sizeof (mailbox_item_t));
     self->parent = parent;
-    self->from = strdup (from);
+    self->address = actor_type_stateless (parent->type) ? strdup (address) : NULL;
+    self->from = from ? strdup (from) : NULL;
+    self->connection = connection;
     self->subject = strdup (subject);
     self->body = body;
+    self->size = body ? payload_size (body) : 0;
+    self->access = actor_type_access (parent->type, subject);
+    self->cache_ttl = actor_type_cache_ttl (parent->type, subject);
+
+    // Priority of the message itself, otherwise of its subject
+    if (priority < 0)
+        priority = actor_type_priority (parent->type, subject);
+    self->priority = priority < ACTOR_TYPE_PRIORITIES ? priority : ACTOR_TYPE_PRIORITIES - 1;
+
+    // Ttl of the message itself, otherwise of its subject
+    if (ttl < 0)
+        ttl = actor_type_ttl (parent->type, subject);
+    self->expiry = ttl > 0 ? zclock_mono () + ttl : 0;
 
     return self;
 }
 
 static void mailbox_item_destroy (mailbox_item_t **self_p) {
     mailbox_item_t *self = *self_p;
+    zstr_free (&self->address);
     zstr_free (&self->from);
     zstr_free (&self->subject);
+    zstr_free (&self->cache_key);
+    zstr_free (&self->coalesce_key);
 
-    if (self->body)
-        json_decref (self->body);
-    self->body = NULL;
+    payload_decref (&self->body);
+
+    if (self->arena)
+        arena_leave (self->arena);
 
     free (self);
     *self_p = NULL;
 }
 
-static char *
-mailbox_item_create_content (mailbox_item_t *self) {
+static const char *
+mailbox_item_address (mailbox_item_t *self) {
+    return self->address ? self->address : self->parent->address;
+}
+
+// Address the actor replies to, http callers are addressed by their connection handle
+static const char *
+mailbox_item_from (mailbox_item_t *self, char *buffer) {
+    if (self->from)
+        return self->from;
 
-    json_t *root = json_pack ("{ssssssso?}", "subject",
-        self->subject, "from", self->from, "address", self->parent->address, "body", self->body);
-    self->body = NULL;
+    conntable_format (self->connection, buffer);
+    return buffer;
+}
 
-    char *content = json_dumps (root, JSON_COMPACT);
+static char *
+mailbox_item_create_content (mailbox_item_t *self) {
+    char from[CONNTABLE_ADDRESS_LEN];
+    arena_t *arena = mql_server_arena (self->parent->server);
+    bool entered = arena_enter (arena);
+
+    json_t *root = json_pack ("{ssssss}", "subject",
+        self->subject, "from", mailbox_item_from (self, from), "address", mailbox_item_address (self));
+
+    // The body is already serialized, and possibly shared with other messages.
+    // It is kept until the completion for a dead letter.
+    char *content = payload_wrap (self->body, root);
+    if (self->connection != 0 || mql_server_deadletters (self->parent->server) == NULL)
+        payload_decref (&self->body);
     json_decref (root);
 
+    if (entered)
+        arena_leave (arena);
+
     return content;
 }
 
+// Replace the pending message of a coalesced subject by a newer one, its
+// caller is told it was superseded. Return -1, the pending message left
+// as it was, if the newer one doesn't fit in its place.
+static int
+mailbox_item_supersede (mailbox_item_t *self, const char *from, uint64_t connection, payload_t **body, int ttl) {
+    mailbox_t *parent = self->parent;
+
+    quota_remove (parent->quota, self->size);
+    quota_remove (actor_type_quota (parent->type), self->size);
+    quota_remove (mql_server_quota (parent->server), self->size);
+
+    if (!mailbox_fits (parent, *body ? payload_size (*body) : 0)) {
+        quota_add (parent->quota, self->size);
+        quota_add (actor_type_quota (parent->type), self->size);
+        quota_add (mql_server_quota (parent->server), self->size);
+        return -1;
+    }
+
+    mql_server_send_error (parent->server, self->connection, 409, "{\"body\": \"Superseded\"}");
+
+    zstr_free (&self->from);
+    self->from = from ? strdup (from) : NULL;
+    self->connection = connection;
+    payload_decref (&self->body);
+    self->body = *body;
+    *body = NULL;
+    self->size = self->body ? payload_size (self->body) : 0;
+
+    if (ttl < 0)
+        ttl = actor_type_ttl (parent->type, self->subject);
+    self->expiry = ttl > 0 ? zclock_mono () + ttl : 0;
+
+    quota_add (parent->quota, self->size);
+    quota_add (actor_type_quota (parent->type), self->size);
+    quota_add (mql_server_quota (parent->server), self->size);
+
+    return 0;
+}
+
+// Tell the http caller the message failed, or keep it as a dead letter
+static void
+mailbox_item_fail (mailbox_item_t *self, uint32_t status_code, const char *content) {
+    mql_server_fail (self->parent->server, self->connection, status_code, content, actor_type_name (self->parent->type),
+                     mailbox_item_address (self), self->from, self->subject, self->body);
+}
+
 mailbox_t *
-mailbox_new (const char *address, aws_t *aws, mql_server_t *server) {
+mailbox_new (const char *address, uint32_t id, actor_type_t *type, mql_server_t *server) {
     mailbox_t *self = (mailbox_t *) zmalloc (sizeof (mailbox_t));
     assert (self);
     self->address = strdup (address);
+    self->id = id;
+    self->type = type;
 
-    const char *delimiter = strchr (address, '/');
-    assert (delimiter);
-
-    self->actor_type = (char *) zmalloc (delimiter - address + 1);
-    memcpy (self->actor_type, address, delimiter - address);
-
-    self->queue = zlistx_new ();
-    zlistx_set_destructor (self->queue, (zlistx_destructor_fn *) mailbox_item_destroy);
-
+    self->lane = ACTOR_TYPE_PRIORITIES - 1;
+    self->quota = actor_type_new_mailbox_quota (type);
     self->server = server;
-    self->aws = aws;
-    self->inprogress = false;
 
     return self;
 }
@@ -85,58 +200,383 @@ mailbox_new (const char *address, aws_t *aws, mql_server_t *server) {
 void mailbox_destroy (mailbox_t **self_p) {
     mailbox_t *self = *self_p;
     zstr_free (&self->address);
-    zstr_free (&self->actor_type);
-    zlistx_destroy (&self->queue);
+
+    for (int lane = 0; lane < ACTOR_TYPE_PRIORITIES; lane++) {
+        while (self->lanes[lane].head) {
+            mailbox_item_t *item = self->lanes[lane].head;
+            self->lanes[lane].head = item->next;
+            mailbox_item_destroy (&item);
+        }
+    }
+
+    quota_destroy (&self->quota);
+    zhashx_destroy (&self->pending);
 
     free (self);
     *self_p = NULL;
 }
 
+// Dispatch is deferred to the end of the server loop tick, so all the
+// messages and completions of a tick are coalesced into a single dispatch
+static void mailbox_schedule (mailbox_t *self) {
+    if (!self->scheduled) {
+        self->scheduled = true;
+        mql_server_schedule (self->server, self);
+    }
+}
+
+// A message counts against the mailbox, its actor type and the server
+static bool mailbox_fits (mailbox_t *self, size_t size) {
+    return quota_fits (self->quota, size)
+        && quota_fits (actor_type_quota (self->type), size)
+        && quota_fits (mql_server_quota (self->server), size);
+}
+
+static void mailbox_push (mailbox_t *self, mailbox_item_t *item) {
+    mailbox_lane_t *lane = &self->lanes[item->priority];
+    item->next = NULL;
+    if (lane->tail)
+        lane->tail->next = item;
+    else
+        lane->head = item;
+    lane->tail = item;
+    self->length++;
+
+    quota_add (self->quota, item->size);
+    quota_add (actor_type_quota (self->type), item->size);
+    quota_add (mql_server_quota (self->server), item->size);
+
+    // Under memory pressure the bodies of the newest messages wait on disk,
+    // they are the last ones needed
+    spill_t *spill = mql_server_spill (self->server);
+    if (spill && item->size >= SPILL_MIN_SIZE && spill_needed (spill, quota_bytes (mql_server_quota (self->server))))
+        payload_spill (item->body, spill);
+}
+
+// Lane of the next message, -1 if the mailbox is empty. Strict dequeue always
+// serves the highest priority first, weighted dequeue serves each lane in turn
+// for twice as many messages as the next lower one, so no lane starves.
+static int mailbox_lane (mailbox_t *self) {
+    if (self->length == 0)
+        return -1;
+
+    if (!actor_type_weighted (self->type)) {
+        int lane = 0;
+        while (self->lanes[lane].head == NULL)
+            lane++;
+        return lane;
+    }
+
+    while (self->credit == 0 || self->lanes[self->lane].head == NULL) {
+        self->lane = (self->lane + 1) % ACTOR_TYPE_PRIORITIES;
+        self->credit = 1 << (ACTOR_TYPE_PRIORITIES - 1 - self->lane);
+    }
+
+    return self->lane;
+}
+
+static mailbox_item_t *mailbox_peek (mailbox_t *self) {
+    int lane = mailbox_lane (self);
+    return lane == -1 ? NULL : self->lanes[lane].head;
+}
+
+static mailbox_item_t *mailbox_pop_lane (mailbox_t *self, int index) {
+    mailbox_lane_t *lane = &self->lanes[index];
+    mailbox_item_t *item = lane->head;
+
+    lane->head = item->next;
+    if (lane->head == NULL)
+        lane->tail = NULL;
+    item->next = NULL;
+    self->length--;
+
+    quota_remove (self->quota, item->size);
+    quota_remove (actor_type_quota (self->type), item->size);
+    quota_remove (mql_server_quota (self->server), item->size);
+
+    if (item->coalesce_key)
+        zhashx_delete (self->pending, item->coalesce_key);
+
+    return item;
+}
+
+static mailbox_item_t *mailbox_pop (mailbox_t *self) {
+    int lane = mailbox_lane (self);
+    if (lane == -1)
+        return NULL;
+
+    if (self->credit > 0)
+        self->credit--;
+
+    return mailbox_pop_lane (self, lane);
+}
+
+// Writes run alone, read-only invocations only alongside each other and
+// reentrant ones alongside anything, all within the parallelism of the type
+static bool mailbox_can_start (mailbox_t *self, actor_type_access_t access) {
+    int running = self->running[ACTOR_TYPE_WRITE] + self->running[ACTOR_TYPE_READONLY] + self->running[ACTOR_TYPE_REENTRANT];
+    if (running >= actor_type_parallelism (self->type))
+        return false;
+
+    if (access == ACTOR_TYPE_WRITE)
+        return self->running[ACTOR_TYPE_WRITE] == 0 && self->running[ACTOR_TYPE_READONLY] == 0;
+    else
+    if (access == ACTOR_TYPE_READONLY)
+        return self->running[ACTOR_TYPE_WRITE] == 0;
+    else
+        return true;
+}
+
+void mailbox_wake (actor_type_t *type) {
+    limiter_t *limiter = actor_type_limiter (type);
+    breaker_t *breaker = actor_type_breaker (type);
+
+    if (breaker && breaker_blocked (breaker, zclock_mono ()))
+        return;
+
+    for (size_t available = limiter ? limiter_available (limiter) : SIZE_MAX; available > 0; available--) {
+        mailbox_t *mailbox = (mailbox_t *) actor_type_next_waiting (type);
+        if (mailbox == NULL)
+            break;
+
+        mailbox->waiting = false;
+        mailbox_schedule (mailbox);
+    }
+}
+
 static void mailbox_next (mailbox_t *self) {
-    // Dequeue the next request
-    zlistx_first (self->queue);
-    mailbox_item_t *next = (mailbox_item_t *) zlistx_detach_cur (self->queue);
+    limiter_t *limiter = actor_type_limiter (self->type);
+    breaker_t *breaker = actor_type_breaker (self->type);
+    mailbox_item_t *next = mailbox_peek (self);
+
+    while (next) {
+        // Don't spend an invocation on a caller which already gave up
+        if (next->connection != 0 && !mql_server_connected (self->server, next->connection)) {
+            zsys_warning ("mailbox: dropping message of expired caller. address: %s, subject: %s", self->address, next->subject);
+            next = mailbox_pop (self);
+            mailbox_item_destroy (&next);
+            next = mailbox_peek (self);
+            continue;
+        }
+
+        // Messages past their ttl are not worth an invocation anymore, they
+        // are dropped as they reach the head of the queue
+        if (next->expiry != 0 && next->expiry <= zclock_mono ()) {
+            zsys_warning ("mailbox: dropping expired message. address: %s, subject: %s", self->address, next->subject);
+            next = mailbox_pop (self);
+            actor_type_count_expired (self->type);
+            mql_server_send_error (self->server, next->connection, 504, "{\"body\": \"Expired\"}");
+            mailbox_item_destroy (&next);
+            next = mailbox_peek (self);
+            continue;
+        }
+
+        // Messages start in order, so a write isn't starved by the reads behind it,
+        // only the order within a lane is kept
+        if (!mailbox_can_start (self, next->access))
+            break;
+
+        // Messages of a broken function wait for it to recover, or fail right away
+        if (breaker && breaker_blocked (breaker, zclock_mono ())) {
+            if (actor_type_fail_fast (self->type)) {
+                next = mailbox_pop (self);
+                zsys_warning ("mailbox: circuit open, failing message. address: %s, subject: %s", self->address, next->subject);
+                mailbox_item_fail (next, 503, "{\"body\": \"Circuit open\"}");
+                mailbox_item_destroy (&next);
+                next = mailbox_peek (self);
+                continue;
+            }
+
+            if (!self->waiting) {
+                self->waiting = true;
+                actor_type_wait (self->type, self);
+            }
+            break;
+        }
+
+        // All the mailboxes of the type share the concurrency of the function
+        if (limiter && !limiter_acquire (limiter)) {
+            if (!self->waiting) {
+                self->waiting = true;
+                actor_type_wait (self->type, self);
+            }
+            break;
+        }
+
+        // Read back now, so the cache key and the content below have the data
+        next = mailbox_pop (self);
+        if (next->body && payload_load (next->body) != 0) {
+            if (limiter)
+                limiter_cancel (limiter);
+            zsys_error ("mailbox: dropping message lost in the spill file. address: %s, subject: %s", self->address, next->subject);
+            payload_decref (&next->body);
+            mailbox_item_fail (next, 500, "{\"body\": \"Lost\"}");
+            mailbox_item_destroy (&next);
+            next = mailbox_peek (self);
+            continue;
+        }
+
+        // Once the breaker opened this is the probe
+        if (breaker)
+            breaker_allow (breaker, zclock_mono ());
+
+        zsys_info ("mailbox: invoking function. address: %s, subject: %s", mailbox_item_address (next), next->subject);
+        self->running[next->access]++;
+
+        // Replies cached before a non-cacheable subject may be stale once it starts
+        if (next->cache_ttl == 0)
+            self->epoch++;
+        else
+        if (next->connection != 0)
+            next->cache_key = cache_key (mailbox_item_address (next), next->subject,
+                                         next->body ? payload_data (next->body) : NULL,
+                                         next->body ? payload_size (next->body) : 0);
+        next->epoch = self->epoch;
+        next->started = zclock_mono ();
+        if (actor_type_warmer (self->type))
+            warmer_started (actor_type_warmer (self->type), next->started);
 
-    if (next) {
-        zsys_info ("mailbox: invoking function. address: %s, subject: %s", self->address, next->subject);
-        self->inprogress = true;
         char *content = mailbox_item_create_content (next);
 
-        aws_invoke_lambda (self->aws, self->actor_type, &content,
-                           (aws_lambda_callback_fn *) mailbox_item_callback, next);
-    } else
-        self->inprogress = false;
+        actor_type_invoke (self->type, &content, (aws_lambda_callback_fn *) mailbox_item_callback, next);
+
+        next = mailbox_peek (self);
+
+        // Start reading the next body back while this one runs
+        if (next && next->body)
+            payload_prefetch (next->body);
+    }
+
+    // Room this mailbox had no use for goes to the others
+    if (limiter || breaker)
+        mailbox_wake (self->type);
+}
+
+// The body of a message returned by an actor, or the blob it refers to
+static payload_t *mailbox_message_body (json_t *message) {
+    const char *ref = json_string_value (json_object_get (message, "body_ref"));
+    if (ref && blobstore_is_ref (ref))
+        return payload_new_ref (ref);
+
+    return payload_new_json (json_object_get (message, "body"));
 }
 
-static int mailbox_item_send_message (mailbox_item_t *self, json_t *message, const char *from) {
+static int mailbox_item_send_message (mailbox_item_t *self, json_t *message, const char *from, uint64_t connection) {
     if (!json_is_object (message)) {
-        zsys_warning ("Mailbox: Actor %s returned invalid message. subject = %s", self->parent->actor_type, self->subject);
-        mql_server_send_error (self->parent->server, self->from, 400, "{\"body\": \"Invalid message\"}");
+        zsys_warning ("Mailbox: Actor %s returned invalid message. subject = %s", actor_type_name (self->parent->type), self->subject);
+        mql_server_send_error (self->parent->server, self->connection, 400, "{\"body\": \"Invalid message\"}");
         return -1;
     }
 
     json_t *to = json_object_get (message, "to");
-    json_t *body = json_object_get (message, "body");
     json_t *subject = json_object_get (message, "subject");
+    json_t *priority = json_object_get (message, "priority");
+    json_t *ttl = json_object_get (message, "ttl");
 
     if (to == NULL || !json_is_string (to) || subject == NULL || !json_is_string (subject)) {
-        zsys_warning ("Mailbox: Actor %s returned invalid message. Subject = %s", self->parent->actor_type, self->subject);
-        mql_server_send_error (self->parent->server, self->from, 400, "{\"body\": \"Invalid message\"}");
+        zsys_warning ("Mailbox: Actor %s returned invalid message. Subject = %s", actor_type_name (self->parent->type), self->subject);
+        mql_server_send_error (self->parent->server, self->connection, 400, "{\"body\": \"Invalid message\"}");
         return -1;
     }
 
     const char *to_str = json_string_value (to);
     const char *subject_str = json_string_value (subject);
 
-    if (body)
-        json_incref (body);
+    payload_t *payload = mailbox_message_body (message);
+
+    // A message refused for back-pressure is not an error of the actor
+    mql_server_send (self->parent->server, to_str, from, connection, subject_str, &payload,
+                     json_is_integer (priority) ? (int) json_integer_value (priority) : -1,
+                     json_is_integer (ttl) ? (int) json_integer_value (ttl) : -1);
+
+    return 0;
+}
+
+static int mailbox_item_subscribe (mailbox_item_t *self, json_t *topics, bool subscribe) {
+    // Actors of a stateless type share the mailbox, so they have no subscriptions of their own
+    if (actor_type_stateless (self->parent->type)) {
+        zsys_warning ("Mailbox: stateless actor %s can't subscribe", mailbox_item_address (self));
+        return -1;
+    }
+
+    if (json_is_string (topics)) {
+        mql_server_subscribe (self->parent->server, json_string_value (topics), self->parent->id, subscribe);
+        return 0;
+    }
+
+    if (!json_is_array (topics))
+        return -1;
+
+    size_t index;
+    json_t *topic;
+    json_array_foreach (topics, index, topic) {
+        if (!json_is_string (topic))
+            return -1;
+
+        mql_server_subscribe (self->parent->server, json_string_value (topic), self->parent->id, subscribe);
+    }
+
+    return 0;
+}
+
+static int mailbox_item_publish (mailbox_item_t *self, json_t *message) {
+    json_t *topic = json_object_get (message, "topic");
+    json_t *subject = json_object_get (message, "subject");
+    json_t *priority = json_object_get (message, "priority");
+    json_t *ttl = json_object_get (message, "ttl");
+
+    if (!json_is_string (topic) || !json_is_string (subject))
+        return -1;
 
-    mql_server_send (self->parent->server, to_str, from, subject_str, &body);
+    // Serialized once for all the subscribers
+    payload_t *payload = mailbox_message_body (message);
+    mql_server_publish (self->parent->server, json_string_value (topic), mailbox_item_address (self),
+                        json_string_value (subject), &payload,
+                        json_is_integer (priority) ? (int) json_integer_value (priority) : -1,
+                        json_is_integer (ttl) ? (int) json_integer_value (ttl) : -1);
+
+    return 0;
+}
+
+static void mailbox_item_reply (mailbox_item_t *self, const char *subject, payload_t **payload) {
+    if (self->from)
+        mql_server_send (self->parent->server, self->from, mailbox_item_address (self), 0, subject, payload, -1, -1);
+    else
+    if (self->cache_key && self->epoch == self->parent->epoch)
+        mql_server_reply_cached (self->parent->server, self->connection, mailbox_item_address (self), subject, payload,
+                                 self->cache_key, self->epoch, self->cache_ttl);
+    else
+        mql_server_reply (self->parent->server, self->connection, mailbox_item_address (self), subject, payload);
+}
+
+// Most responses are a plain reply, their body is passed on as is without
+// building a tree. Return -1 when the response needs the full parser.
+static int mailbox_item_reply_raw (mailbox_item_t *self, const char *content) {
+    static const char *keys[] = { "subject", "body" };
+    jscan_span_t spans[2];
+
+    int members = jscan_object (content, content ? strlen (content) : 0, keys, spans, 2);
+    if (members < 1 || members != (spans[0].data != NULL) + (spans[1].data != NULL))
+        return -1;
+
+    // A subject with escapes is left to the full parser
+    jscan_span_t subject = spans[0];
+    if (subject.data == NULL || subject.data[0] != '"' || memchr (subject.data, '\\', subject.size))
+        return -1;
+
+    char *subject_str = strndup (subject.data + 1, subject.size - 2);
+    payload_t *payload = spans[1].data ? payload_new (spans[1].data, spans[1].size) : NULL;
+
+    mailbox_item_reply (self, subject_str, &payload);
+    zstr_free (&subject_str);
 
     return 0;
 }
 
 static int mailbox_item_parse_json (mailbox_item_t *self, zhttp_response_t *response) {
+    if (mailbox_item_reply_raw (self, zhttp_response_content (response)) == 0)
+        return 0;
+
     json_error_t error;
     json_t *root = json_loads (zhttp_response_content (response), 0, &error);
 
@@ -151,7 +591,7 @@ static int mailbox_item_parse_json (mailbox_item_t *self, zhttp_response_t *resp
     if (send) {
         // Send can either be an object or array
         if (json_is_object (send)) {
-            rc = mailbox_item_send_message (self, send, self->parent->address);
+            rc = mailbox_item_send_message (self, send, mailbox_item_address (self), 0);
             if (rc != 0) {
                 json_decref (root);
                 return rc;
@@ -160,14 +600,58 @@ static int mailbox_item_parse_json (mailbox_item_t *self, zhttp_response_t *resp
             size_t index;
             json_t *value;
             json_array_foreach (send, index, value) {
-                rc = mailbox_item_send_message (self, value, self->parent->address);
+                rc = mailbox_item_send_message (self, value, mailbox_item_address (self), 0);
                 if (rc != 0) {
                     json_decref (root);
                     return rc;
                 }
             }
         } else {
-            zsys_error ("Mailbox: Invalid send returned from actor. address: %s, subject: %s", self->parent->address,
+            zsys_error ("Mailbox: Invalid send returned from actor. address: %s, subject: %s", mailbox_item_address (self),
+                        self->subject);
+            json_decref (root);
+            return -1;
+        }
+    }
+
+    // Reminders the actor schedules, for itself or other actors
+    json_t *schedule = json_object_get (root, "schedule");
+    if (schedule) {
+        if (mql_server_remind (self->parent->server, mailbox_item_address (self), schedule) != 0) {
+            zsys_error ("Mailbox: Invalid schedule returned from actor. address: %s, subject: %s", mailbox_item_address (self),
+                        self->subject);
+            json_decref (root);
+            return -1;
+        }
+    }
+
+    json_t *subscribe = json_object_get (root, "subscribe");
+    json_t *unsubscribe = json_object_get (root, "unsubscribe");
+    if ((subscribe && mailbox_item_subscribe (self, subscribe, true) != 0)
+    ||  (unsubscribe && mailbox_item_subscribe (self, unsubscribe, false) != 0)) {
+        zsys_error ("Mailbox: Invalid subscription returned from actor. address: %s, subject: %s", mailbox_item_address (self),
+                    self->subject);
+        json_decref (root);
+        return -1;
+    }
+
+    json_t *publish = json_object_get (root, "publish");
+    if (publish) {
+        size_t index;
+        json_t *value;
+        rc = 0;
+
+        if (json_is_array (publish)) {
+            json_array_foreach (publish, index, value) {
+                if (mailbox_item_publish (self, value) != 0)
+                    rc = -1;
+            }
+        }
+        else
+            rc = mailbox_item_publish (self, publish);
+
+        if (rc != 0) {
+            zsys_error ("Mailbox: Invalid publish returned from actor. address: %s, subject: %s", mailbox_item_address (self),
                         self->subject);
             json_decref (root);
             return -1;
@@ -178,7 +662,7 @@ static int mailbox_item_parse_json (mailbox_item_t *self, zhttp_response_t *resp
 
     // Returned json can be forward or a reply, not both
     if (forward) {
-        rc = mailbox_item_send_message (self, forward, self->from);
+        rc = mailbox_item_send_message (self, forward, self->from, self->connection);
         if (rc != 0) {
             json_decref (root);
             return rc;
@@ -186,20 +670,20 @@ static int mailbox_item_parse_json (mailbox_item_t *self, zhttp_response_t *resp
     }
     else {
         json_t *body = json_object_get (root, "body");
+        if (body == NULL)
+            body = json_object_get (root, "body_ref");
         json_t *subject = json_object_get (root, "subject");
 
         // If body or subject it is an immediate reply
         if (subject) {
             const char *subject_str = json_string_value (subject);
 
-            if (body)
-                json_incref (body);
-
-            mql_server_send (self->parent->server, self->from, self->parent->address, subject_str, &body);
+            payload_t *payload = mailbox_message_body (root);
+            mailbox_item_reply (self, subject_str, &payload);
         }
 
         if (body && !subject) {
-            zsys_error ("Mailbox: subject is mandatory. address: %s", self->parent->address);
+            zsys_error ("Mailbox: subject is mandatory. address: %s", mailbox_item_address (self));
             json_decref (root);
             return -1;
         }
@@ -212,8 +696,12 @@ static int mailbox_item_parse_json (mailbox_item_t *self, zhttp_response_t *resp
 
 
 static void mailbox_item_callback (mailbox_item_t *self, zhttp_response_t *response) {
+    // Everything jansson allocates for the completion is released with the item
+    if (arena_enter (mql_server_arena (self->parent->server)))
+        self->arena = mql_server_arena (self->parent->server);
+
     zsys_info ("mailbox: function completed. address: %s, subject: %s, status code: %d",
-               self->parent->address,
+               mailbox_item_address (self),
                self->subject,
                zhttp_response_status_code (response));
 
@@ -221,44 +709,163 @@ static void mailbox_item_callback (mailbox_item_t *self, zhttp_response_t *respo
     bool has_error = zhash_lookup (headers, "X-Amz-Function-Error") != NULL || zhash_lookup (headers, "x-amz-function-error");
 
     uint32_t status_code = zhttp_response_status_code (response);
+
+    // Lambda refuses invocations beyond the concurrency of the function with 429
+    limiter_t *limiter = actor_type_limiter (self->parent->type);
+    if (limiter)
+        limiter_release (limiter, zclock_mono () - self->started, status_code == 429, zclock_mono ());
+
+    // Errors of the function and of lambda alike, throttles are left to the limiter
+    breaker_t *breaker = actor_type_breaker (self->parent->type);
+    if (breaker)
+        breaker_record (breaker, (status_code >= 300 && status_code != 429) || has_error, zclock_mono ());
+
+    if (limiter || breaker)
+        mailbox_wake (self->parent->type);
+
+    if (actor_type_warmer (self->parent->type))
+        warmer_completed (actor_type_warmer (self->parent->type), zclock_mono ());
     if (status_code >= 300 || has_error) {
         if (status_code >= 200 && status_code < 300)
             status_code = 400;
 
-        mql_server_send_error (self->parent->server, self->from, status_code, zhttp_response_content (response));
+        mailbox_item_fail (self, status_code, zhttp_response_content (response));
 
-        mailbox_next (self->parent);
+        if (self->cache_ttl == 0)
+            self->parent->epoch++;
+        self->parent->running[self->access]--;
+        mailbox_schedule (self->parent);
         mailbox_item_destroy (&self);
         return;
     }
 
+    // Reads which overlapped the invocation must not cache what they saw
+    if (self->cache_ttl == 0)
+        self->parent->epoch++;
+
     int rc = mailbox_item_parse_json (self, response);
 
     if (rc != 0) {
+        char from[CONNTABLE_ADDRESS_LEN];
         zsys_error ("Mailbox: Invalid json returned from actor. address: %s, from: %s, subject: %s",
-                    self->parent->address, self->from, self->subject);
-        mql_server_send_error (self->parent->server, self->from, 400, "{\"body\": \"Invalid json\"}");
+                    mailbox_item_address (self), mailbox_item_from (self, from), self->subject);
+        mailbox_item_fail (self, 400, "{\"body\": \"Invalid json\"}");
     }
 
-    mailbox_next (self->parent);
+    self->parent->running[self->access]--;
+    mailbox_schedule (self->parent);
     mailbox_item_destroy (&self);
 }
 
+// Refuse a message which doesn't fit, with 429 or as dropped by the overflow policy
+static void
+mailbox_refuse (mailbox_t *self, const char *address, const char *from, uint64_t connection,
+                const char *subject, payload_t **body) {
+    actor_type_overflow_t overflow = actor_type_overflow (self->type);
+    zsys_warning ("mailbox: full, refusing message. address: %s, subject: %s", self->address, subject);
+
+    if (overflow == ACTOR_TYPE_REJECT && connection != 0)
+        mql_server_send_overloaded (self->server, connection);
+    else
+        mql_server_fail (self->server, connection, overflow == ACTOR_TYPE_REJECT ? 429 : 503, "{\"body\": \"Dropped\"}",
+                         actor_type_name (self->type), address, from, subject, *body);
+
+    payload_decref (body);
+}
+
 int mailbox_send (
         mailbox_t *self,
+        const char *address,
         const char *from,
+        uint64_t connection,
         const char *subject,
-        json_t **body) {
+        payload_t **body,
+        int priority,
+        int ttl) {
+
+    // Large bodies are queued and passed to the actor by reference
+    mql_server_offload (self->server, body);
+
+    // Latest wins, the pending message of the actor and subject takes the
+    // new body in place instead of queuing another invocation
+    char *coalesce_key = NULL;
+    if (actor_type_coalesced (self->type, subject)) {
+        coalesce_key = zsys_sprintf ("%s\n%s", address, subject);
+        mailbox_item_t *pending = self->pending ? (mailbox_item_t *) zhashx_lookup (self->pending, coalesce_key) : NULL;
+
+        // Nothing is dropped to make room, the message in place is kept if
+        // the newer one doesn't fit
+        if (pending) {
+            int rc = mailbox_item_supersede (pending, from, connection, body, ttl);
+            if (rc == -1)
+                mailbox_refuse (self, address, from, connection, subject, body);
+            zstr_free (&coalesce_key);
+            return rc;
+        }
+    }
+
+    size_t size = *body ? payload_size (*body) : 0;
+
+    if (!mailbox_fits (self, size)) {
+        actor_type_overflow_t overflow = actor_type_overflow (self->type);
+
+        // Make room by dropping the oldest messages of this mailbox, lowest priority first
+        while (overflow == ACTOR_TYPE_DROP_OLDEST && !mailbox_fits (self, size) && self->length > 0) {
+            int lane = ACTOR_TYPE_PRIORITIES - 1;
+            while (self->lanes[lane].head == NULL)
+                lane--;
+
+            mailbox_item_t *oldest = mailbox_pop_lane (self, lane);
+            zsys_warning ("mailbox: full, dropping oldest message. address: %s, subject: %s", self->address, oldest->subject);
+            mailbox_item_fail (oldest, 503, "{\"body\": \"Dropped\"}");
+            mailbox_item_destroy (&oldest);
+        }
 
-    mailbox_item_t *item = lambda_request_new (self, from, subject, *body);
-    zlistx_add_end (self->queue, item);
+        if (!mailbox_fits (self, size)) {
+            mailbox_refuse (self, address, from, connection, subject, body);
+            zstr_free (&coalesce_key);
+            return -1;
+        }
+    }
+
+    mailbox_item_t *item = lambda_request_new (self, address, from, connection, subject, *body, priority, ttl);
+    mailbox_push (self, item);
+
+    if (coalesce_key) {
+        if (!self->pending)
+            self->pending = zhashx_new ();
+        item->coalesce_key = coalesce_key;
+        zhashx_insert (self->pending, coalesce_key, item);
+    }
 
-    zsys_info ("mailbox: new message. address: %s, from: %s, subject: %s", self->address, from, subject);
+    char from_buffer[CONNTABLE_ADDRESS_LEN];
+    zsys_info ("mailbox: new message. address: %s, from: %s, subject: %s", address,
+               mailbox_item_from (item, from_buffer), subject);
 
-    if (!self->inprogress)
-        mailbox_next (self);
+    mailbox_schedule (self);
 
     *body = NULL;
 
     return 0;
-}
\ No newline at end of file
+}
+
+const char *mailbox_address (mailbox_t *self) {
+    return self->address;
+}
+
+actor_type_t *mailbox_type (mailbox_t *self) {
+    return self->type;
+}
+
+uint64_t mailbox_epoch (mailbox_t *self) {
+    return self->epoch;
+}
+
+bool mailbox_full (mailbox_t *self, size_t size) {
+    return actor_type_overflow (self->type) == ACTOR_TYPE_REJECT && !mailbox_fits (self, size);
+}
+
+void mailbox_dispatch (mailbox_t *self) {
+    self->scheduled = false;
+    mailbox_next (self);
+}
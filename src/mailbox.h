@@ -5,14 +5,45 @@
 
 typedef struct _mailbox_t mailbox_t;
 
-mailbox_t* mailbox_new (const char *address, aws_t *aws, mql_server_t *server);
+//  Id is the interned id of the mailbox, unique within the server
+mailbox_t* mailbox_new (const char *address, uint32_t id, actor_type_t *type, mql_server_t *server);
 
 void mailbox_destroy (mailbox_t  **self_p);
 
+//  Address is the actor the message is sent to, it differs from the mailbox
+//  address for the shared mailbox of a stateless actor type. From is the
+//  sender actor, or NULL when connection is the http caller. A negative
+//  priority takes the priority of the subject, a negative ttl the ttl of
+//  the subject, in milliseconds, zero never expires.
+//  Return -1 if the mailbox is full and the message was refused or dropped,
+//  the http caller, if any, was already answered.
 int mailbox_send (mailbox_t *self,
+                  const char *address,
                   const char *from,
+                  uint64_t connection,
                   const char *subject,
-                  json_t **body);
+                  payload_t **body,
+                  int priority,
+                  int ttl);
+
+const char *mailbox_address (mailbox_t *self);
+
+actor_type_t *mailbox_type (mailbox_t *self);
+
+//  Epoch of the cached replies of the mailbox, a reply cached in an older
+//  epoch is stale
+uint64_t mailbox_epoch (mailbox_t *self);
+
+//  Return true if a message of the size would be refused, so the caller can
+//  be pushed back before the message is even parsed
+bool mailbox_full (mailbox_t *self, size_t size);
+
+//  Invoke the next message, called by the server for scheduled mailboxes
+void mailbox_dispatch (mailbox_t *self);
+
+//  Schedule the mailboxes of the type waiting for its concurrency limit or
+//  its circuit breaker, as many as can start
+void mailbox_wake (actor_type_t *type);
 
 #endif
 
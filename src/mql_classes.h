@@ -33,6 +33,94 @@ typedef struct _aws_sign_t aws_sign_t;
 typedef struct _mailbox_t mailbox_t;
 #define MAILBOX_T_DEFINED
 #endif
+#ifndef ACTOR_TYPE_T_DEFINED
+typedef struct _actor_type_t actor_type_t;
+#define ACTOR_TYPE_T_DEFINED
+#endif
+#ifndef NATIVE_T_DEFINED
+typedef struct _native_t native_t;
+#define NATIVE_T_DEFINED
+#endif
+#ifndef RUNTIME_T_DEFINED
+typedef struct _runtime_t runtime_t;
+#define RUNTIME_T_DEFINED
+#endif
+#ifndef CONNTABLE_T_DEFINED
+typedef struct _conntable_t conntable_t;
+#define CONNTABLE_T_DEFINED
+#endif
+#ifndef TIMEWHEEL_T_DEFINED
+typedef struct _timewheel_t timewheel_t;
+#define TIMEWHEEL_T_DEFINED
+#endif
+#ifndef QUOTA_T_DEFINED
+typedef struct _quota_t quota_t;
+#define QUOTA_T_DEFINED
+#endif
+#ifndef CRON_T_DEFINED
+typedef struct _cron_t cron_t;
+#define CRON_T_DEFINED
+#endif
+#ifndef SCHEDULER_T_DEFINED
+typedef struct _scheduler_t scheduler_t;
+#define SCHEDULER_T_DEFINED
+#endif
+#ifndef PAYLOAD_T_DEFINED
+typedef struct _payload_t payload_t;
+#define PAYLOAD_T_DEFINED
+#endif
+#ifndef TOPIC_T_DEFINED
+typedef struct _topic_t topic_t;
+#define TOPIC_T_DEFINED
+#endif
+#ifndef CACHE_T_DEFINED
+typedef struct _cache_t cache_t;
+#define CACHE_T_DEFINED
+#endif
+#ifndef DEDUP_T_DEFINED
+typedef struct _dedup_t dedup_t;
+#define DEDUP_T_DEFINED
+#endif
+#ifndef BUCKET_T_DEFINED
+typedef struct _bucket_t bucket_t;
+#define BUCKET_T_DEFINED
+#endif
+#ifndef JSCAN_T_DEFINED
+typedef struct _jscan_t jscan_t;
+#define JSCAN_T_DEFINED
+#endif
+#ifndef ARENA_T_DEFINED
+typedef struct _arena_t arena_t;
+#define ARENA_T_DEFINED
+#endif
+#ifndef SPILL_T_DEFINED
+typedef struct _spill_t spill_t;
+#define SPILL_T_DEFINED
+#endif
+#ifndef BLOBSTORE_T_DEFINED
+typedef struct _blobstore_t blobstore_t;
+#define BLOBSTORE_T_DEFINED
+#endif
+#ifndef LIMITER_T_DEFINED
+typedef struct _limiter_t limiter_t;
+#define LIMITER_T_DEFINED
+#endif
+#ifndef WARMER_T_DEFINED
+typedef struct _warmer_t warmer_t;
+#define WARMER_T_DEFINED
+#endif
+#ifndef ROUTER_T_DEFINED
+typedef struct _router_t router_t;
+#define ROUTER_T_DEFINED
+#endif
+#ifndef BREAKER_T_DEFINED
+typedef struct _breaker_t breaker_t;
+#define BREAKER_T_DEFINED
+#endif
+#ifndef DEADLETTER_T_DEFINED
+typedef struct _deadletter_t deadletter_t;
+#define DEADLETTER_T_DEFINED
+#endif
 
 //  Extra headers
 #include "mql_private.h"
@@ -42,6 +130,28 @@ typedef struct _mailbox_t mailbox_t;
 #include "aws.h"
 #include "aws_sign.h"
 #include "mailbox.h"
+#include "actor_type.h"
+#include "native.h"
+#include "runtime.h"
+#include "conntable.h"
+#include "timewheel.h"
+#include "quota.h"
+#include "cron.h"
+#include "scheduler.h"
+#include "payload.h"
+#include "topic.h"
+#include "cache.h"
+#include "dedup.h"
+#include "bucket.h"
+#include "jscan.h"
+#include "arena.h"
+#include "spill.h"
+#include "blobstore.h"
+#include "limiter.h"
+#include "warmer.h"
+#include "router.h"
+#include "breaker.h"
+#include "deadletter.h"
 
 //  *** To avoid double-definitions, only define if building without draft ***
 #ifndef MQL_BUILD_DRAFT_API
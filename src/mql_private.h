@@ -4,9 +4,66 @@
 #include "mql_classes.h"
 
 MQL_PRIVATE int
-    mql_server_send (mql_server_t *self, const char *to, const char *from, const char *subject, json_t **body);
+    mql_server_send (mql_server_t *self, const char *to, const char *from, uint64_t connection, const char *subject, payload_t **body,
+                     int priority, int ttl);
 
 MQL_PRIVATE int
-    mql_server_send_error (mql_server_t *self, const char *to, uint32_t status_code, const char* body);
+    mql_server_reply (mql_server_t *self, uint64_t connection, const char *from, const char *subject, payload_t **body);
+
+//  Reply and keep the reply in the cache for ttl milliseconds, under the key
+//  and epoch of the mailbox of the actor
+MQL_PRIVATE int
+    mql_server_reply_cached (mql_server_t *self, uint64_t connection, const char *from, const char *subject, payload_t **body,
+                             const char *cache_key, uint64_t epoch, int ttl);
+
+MQL_PRIVATE void
+    mql_server_subscribe (mql_server_t *self, const char *topic, uint32_t mailbox_id, bool subscribe);
+
+//  Send the message to all the subscribers of the topic, return their count
+MQL_PRIVATE size_t
+    mql_server_publish (mql_server_t *self, const char *topic, const char *from, const char *subject, payload_t **body,
+                        int priority, int ttl);
+
+//  Return false once nobody waits for the reply of the connection, the
+//  caller is gone and the message has no idempotency key pending on it
+MQL_PRIVATE bool
+    mql_server_connected (mql_server_t *self, uint64_t connection);
+
+MQL_PRIVATE void
+    mql_server_schedule (mql_server_t *self, mailbox_t *mailbox);
+
+MQL_PRIVATE int
+    mql_server_send_error (mql_server_t *self, uint64_t connection, uint32_t status_code, const char* body);
+
+MQL_PRIVATE int
+    mql_server_send_overloaded (mql_server_t *self, uint64_t connection);
+
+MQL_PRIVATE int
+    mql_server_remind (mql_server_t *self, const char *from, json_t *schedule);
+
+MQL_PRIVATE quota_t *
+    mql_server_quota (mql_server_t *self);
+
+MQL_PRIVATE arena_t *
+    mql_server_arena (mql_server_t *self);
+
+//  Spill files of the queued bodies, NULL if not configured
+MQL_PRIVATE spill_t *
+    mql_server_spill (mql_server_t *self);
+
+//  Move a body above the threshold to the blob store, replacing it by a
+//  reference. The body is left as is without a store.
+MQL_PRIVATE void
+    mql_server_offload (mql_server_t *self, payload_t **body);
+
+//  Answer the http caller of a failed message with the error, or keep the
+//  message as a dead letter when there is no caller
+MQL_PRIVATE void
+    mql_server_fail (mql_server_t *self, uint64_t connection, uint32_t status_code, const char *content,
+                     const char *type, const char *address, const char *from, const char *subject, payload_t *body);
+
+//  Dead letters of the messages without a caller, NULL if not configured
+MQL_PRIVATE deadletter_t *
+    mql_server_deadletters (mql_server_t *self);
 
 #endif
\ No newline at end of file
@@ -30,6 +30,50 @@ mql_private_selftest (bool verbose, const char *subtest)
         aws_test (verbose);
     if (streq (subtest, "$ALL") || streq (subtest, "aws_sign_test"))
         aws_sign_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "actor_type_test"))
+        actor_type_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "native_test"))
+        native_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "runtime_test"))
+        runtime_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "conntable_test"))
+        conntable_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "timewheel_test"))
+        timewheel_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "quota_test"))
+        quota_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "cron_test"))
+        cron_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "scheduler_test"))
+        scheduler_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "payload_test"))
+        payload_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "topic_test"))
+        topic_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "cache_test"))
+        cache_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "dedup_test"))
+        dedup_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "bucket_test"))
+        bucket_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "jscan_test"))
+        jscan_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "arena_test"))
+        arena_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "spill_test"))
+        spill_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "blobstore_test"))
+        blobstore_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "limiter_test"))
+        limiter_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "warmer_test"))
+        warmer_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "router_test"))
+        router_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "breaker_test"))
+        breaker_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "deadletter_test"))
+        deadletter_test (verbose);
 }
 /*
 ################################################################################
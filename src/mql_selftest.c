@@ -34,6 +34,28 @@ all_tests [] = {
 // Now built only with --enable-drafts, so even stable builds are hidden behind the flag
     { "aws", NULL, true, false, "aws_test" },
     { "aws_sign", NULL, true, false, "aws_sign_test" },
+    { "actor_type", NULL, true, false, "actor_type_test" },
+    { "native", NULL, true, false, "native_test" },
+    { "runtime", NULL, true, false, "runtime_test" },
+    { "conntable", NULL, true, false, "conntable_test" },
+    { "timewheel", NULL, true, false, "timewheel_test" },
+    { "quota", NULL, true, false, "quota_test" },
+    { "cron", NULL, true, false, "cron_test" },
+    { "scheduler", NULL, true, false, "scheduler_test" },
+    { "payload", NULL, true, false, "payload_test" },
+    { "topic", NULL, true, false, "topic_test" },
+    { "cache", NULL, true, false, "cache_test" },
+    { "dedup", NULL, true, false, "dedup_test" },
+    { "bucket", NULL, true, false, "bucket_test" },
+    { "jscan", NULL, true, false, "jscan_test" },
+    { "arena", NULL, true, false, "arena_test" },
+    { "spill", NULL, true, false, "spill_test" },
+    { "blobstore", NULL, true, false, "blobstore_test" },
+    { "limiter", NULL, true, false, "limiter_test" },
+    { "warmer", NULL, true, false, "warmer_test" },
+    { "router", NULL, true, false, "router_test" },
+    { "breaker", NULL, true, false, "breaker_test" },
+    { "deadletter", NULL, true, false, "deadletter_test" },
     { "private_classes", NULL, false, false, "$ALL" }, // compat option for older projects
 #endif // MQL_BUILD_DRAFT_API
     {NULL, NULL, 0, 0, NULL}          //  Sentinel
@@ -17,30 +17,160 @@
 #include "mql_classes.h"
 #include <jansson.h>
 
+// Milliseconds between two tries to pass the replies waiting for room on the
+// socket of a client
+#define SERVER_BACKLOG_RETRY 10
+
+// Thread connected from within the process, its messages and their replies
+// go over a pair socket of its own
+typedef struct {
+    zsock_t *socket;            // NULL once disconnected
+    char *endpoint;
+    zlistx_t *backlog;          // Replies waiting for room on the socket
+    bool polled;                // Messages are read only while no reply waits
+} server_client_t;
+
+// Completion of a message from within the process
+typedef struct {
+    mql_server_reply_fn *callback;
+    void *arg;
+} server_completion_t;
+
 struct _mql_server_t {
     zsock_t* pipe;
     zhttp_server_options_t *http_options;
     zhttp_server_t *http_server;
     zhttp_request_t *request;
     zhttp_response_t *response;
-    uint64_t next_id;
-    zhashx_t *connections;
+    conntable_t *connections;   // Pending callers, their client stands for the in process ones
+    zhashx_t *clients;          // Threads connected from within the process, by address of the client
+    zhashx_t *completions;      // Completions of the in process callers, by address of the connection
+    timewheel_t *timers;        // Deadlines of the http callers and reminders
+    int timeout;                // Default milliseconds a caller waits, zero to wait forever
+    scheduler_t *scheduler;
+    quota_t *quota;             // Bytes queued in all the mailboxes
+    char *retry_after;          // Seconds an overloaded caller should wait
+    cache_t *cache;             // Replies of the cacheable subjects
+    dedup_t *dedup;             // Idempotency keys of the recent messages
+    arena_t *arena;             // Jansson memory of the message being handled
+    spill_t *spill;             // Queued bodies beyond the memory watermark, if configured
+    blobstore_t *blobs;         // Bodies above the threshold, if configured
+    size_t blob_threshold;
+    int64_t blob_ttl;           // Seconds a blob is kept
+    char *blob_token;           // Bearer token of the actors reading and storing blobs
+    size_t max_body;            // Largest body accepted from a caller
+    deadletter_t *deadletters;  // Failed messages without a caller, if configured
+    bucket_t *replay_rate;      // Dead letters replayed per second
+    int64_t deadletter_ttl;     // Seconds a dead letter is kept, zero for ever
+    size_t deadletter_max;      // Dead letters kept, zero for no limit
+    char *tenant_header;        // Header naming the tenant of a request, as sent and in lower case
+    char *tenant_header_lower;
+    zhashx_t *tenants;          // Rates of the configured tenants
+    zhashx_t *other_tenants;    // Rates of the other tenants, created on demand
+    double tenant_rate;         // Rate of the other tenants, zero is unlimited
+    double tenant_burst;
     zsock_t* http_worker;
     char endpoint[256];
 
+    zconfig_t *config;
+    zhashx_t *actor_types;
+    size_t implicit_types;      // Actor types created for names missing from the config
+    size_t max_implicit_types;
     zhashx_t *mailboxes;
+    mailbox_t **interned;       // Mailboxes by id, mailboxes live as long as the server
+    uint32_t interned_size;
+    uint32_t interned_capacity;
+    zhashx_t *topics;
     aws_t    *aws;
+    native_t *native;
+    runtime_t *runtime;
     zpoller_t *poller;
     ztimerset_t *timerset;
+    zlistx_t *scheduled;        // Mailboxes to dispatch at the end of the tick
+
+    bool warming;               // Some functions are kept warm
+    bool breaking;              // Some functions have a circuit breaker
+
+    int batch;                  // Messages handled per socket before moving to the next one
+    int budget;                 // Messages handled per tick before running the timers again
+    bool busy_poll;
 
     bool terminated;
 };
 
 static void s_refresh_credentials_interval (int timer_id, mql_server_t *self);
 
+static void s_runtime_expire_interval (int timer_id, mql_server_t *self);
+
+static void s_sweep_tenants_interval (int timer_id, mql_server_t *self);
+
+static void s_expire_blobs_interval (int timer_id, mql_server_t *self);
+
+static void s_warm_interval (int timer_id, mql_server_t *self);
+
+static void s_breakers_interval (int timer_id, mql_server_t *self);
+
+static void s_replay_interval (int timer_id, mql_server_t *self);
+
+static void s_compact_deadletters_interval (int timer_id, mql_server_t *self);
+
+static void s_deliver_reminder (mql_server_t *self, const char *to, const char *from, const char *subject, payload_t *body);
+
+static actor_type_t *
+s_get_actor_type (mql_server_t *self, const char *name);
+
 static mailbox_t *
 s_get_mailbox (mql_server_t *self, const char *address);
 
+static bool
+s_is_runtime (mql_server_t *self, const char *name);
+
+static void
+server_destroy (mql_server_t **self_p);
+
+static server_client_t *
+server_client_new (const char *endpoint) {
+    zsock_t *socket = zsock_new_pair (NULL);
+    assert (socket);
+    if (zsock_connect (socket, "%s", endpoint) != 0) {
+        zsys_warning ("Server: can't connect the client at %s", endpoint);
+        zsock_destroy (&socket);
+        return NULL;
+    }
+
+    server_client_t *self = (server_client_t *) zmalloc (sizeof (server_client_t));
+    assert (self);
+
+    self->socket = socket;
+    self->endpoint = strdup (endpoint);
+    self->backlog = zlistx_new ();
+    zlistx_set_destructor (self->backlog, (zlistx_destructor_fn *) zmsg_destroy);
+    self->polled = true;
+
+    return self;
+}
+
+static void
+server_client_destroy (server_client_t **self_p) {
+    assert (self_p);
+    server_client_t *self = *self_p;
+
+    if (self) {
+        zsock_destroy (&self->socket);
+        zstr_free (&self->endpoint);
+        zlistx_destroy (&self->backlog);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+static void
+server_completion_destroy (server_completion_t **self_p) {
+    assert (self_p);
+    free (*self_p);
+    *self_p = NULL;
+}
+
 static mql_server_t *
 server_new (zconfig_t* config, zsock_t *pipe) {
     assert (config);
@@ -49,6 +179,10 @@ server_new (zconfig_t* config, zsock_t *pipe) {
     assert (self);
 
     self->pipe = pipe;
+    self->config = config;
+
+    // Json trees of a message are allocated from the arena and released at once
+    self->arena = arena_new (strtoull (zconfig_get (config, "server/arena_chunk", "65536"), NULL, 10));
     self->http_options = zhttp_server_options_new ();
     char* port_str = zconfig_get (config, "server/port", "34543");
     int port = atoi (port_str);
@@ -58,20 +192,125 @@ server_new (zconfig_t* config, zsock_t *pipe) {
     zsock_connect (self->http_worker, "%s", zhttp_server_options_backend_address (self->http_options));
     self->request = zhttp_request_new ();
     self->response = zhttp_response_new ();
-    self->next_id =  (((uint64_t) rand() <<  0) & 0x00000000FFFFFFFFull) |
-                     (((uint64_t) rand() << 32) & 0xFFFFFFFF00000000ull);
-    self->connections = zhashx_new ();
-    zhashx_set_key_duplicator (self->connections, NULL); // Connection takes ownership of the key
+    self->connections = conntable_new ();
+    self->clients = zhashx_new ();
+    zhashx_set_destructor (self->clients, (czmq_destructor *) server_client_destroy);
+    self->completions = zhashx_new ();
+    zhashx_set_destructor (self->completions, (czmq_destructor *) server_completion_destroy);
+    self->timers = timewheel_new (zclock_mono ());
+    self->scheduler = scheduler_new (self->timers, (scheduler_fn *) s_deliver_reminder, self);
+    self->actor_types = zhashx_new ();
+    zhashx_set_destructor (self->actor_types, (czmq_destructor *) actor_type_destroy);
     self->mailboxes = zhashx_new ();
     zhashx_set_destructor (self->mailboxes, (czmq_destructor *) mailbox_destroy);
+    self->topics = zhashx_new ();
+    zhashx_set_destructor (self->topics, (czmq_destructor *) topic_destroy);
     self->timerset = ztimerset_new ();
+    self->scheduled = zlistx_new ();
+
+    self->batch = atoi (zconfig_get (config, "server/batch", "32"));
+    self->budget = atoi (zconfig_get (config, "server/budget", "1024"));
+    if (self->batch < 1) {
+        zsys_warning ("Server: server/batch must be at least 1, using 1");
+        self->batch = 1;
+    }
+    if (self->budget < 1) {
+        zsys_warning ("Server: server/budget must be at least 1, using 1");
+        self->budget = 1;
+    }
+    self->busy_poll = atoi (zconfig_get (config, "server/busy_poll", "0")) != 0;
+    self->timeout = atoi (zconfig_get (config, "server/timeout", "0"));
+    self->quota = quota_new (0, strtoull (zconfig_get (config, "server/queue_bytes", "0"), NULL, 10));
+    self->retry_after = zconfig_get (config, "server/retry_after", "1");
+
+    char *spill_dir = zconfig_get (config, "server/spill_dir", NULL);
+    if (spill_dir)
+        self->spill = spill_new (spill_dir,
+                                 strtoull (zconfig_get (config, "server/spill_watermark", "1073741824"), NULL, 10),
+                                 strtoull (zconfig_get (config, "server/spill_segment", "67108864"), NULL, 10));
+
+    // Without a store a body is limited by the synchronous invocation payload of lambda
+    char *blob_dir = zconfig_get (config, "server/blob_dir", NULL);
+    if (blob_dir) {
+        self->blobs = blobstore_new (blob_dir);
+        self->blob_threshold = strtoull (zconfig_get (config, "server/blob_threshold", "1048576"), NULL, 10);
+        self->blob_ttl = strtoll (zconfig_get (config, "server/blob_ttl", "86400"), NULL, 10);
+        self->blob_token = zconfig_get (config, "server/blob_token", NULL);
+        if (self->blob_token == NULL)
+            zsys_warning ("Server: server/blob_token isn't set, actors can't read or store blobs over http");
+        ztimerset_add (self->timerset, 1000 * 60 * 60, (ztimerset_fn *) s_expire_blobs_interval, self);
+    }
+    self->max_body = strtoull (zconfig_get (config, "server/max_body", blob_dir ? "268435456" : "6291456"), NULL, 10);
+    self->max_implicit_types = strtoull (zconfig_get (config, "server/implicit_types", "1024"), NULL, 10);
+
+    char *deadletters = zconfig_get (config, "server/deadletters", NULL);
+    if (deadletters) {
+        self->deadletters = deadletter_new (deadletters);
+        if (self->deadletters == NULL) {
+            zsys_error ("Server: can't open the dead letters %s", deadletters);
+            server_destroy (&self);
+            return NULL;
+        }
+        double rate = atof (zconfig_get (config, "server/replay_rate", "10"));
+        self->replay_rate = bucket_new (rate, rate / 10);
+        ztimerset_add (self->timerset, 100, (ztimerset_fn *) s_replay_interval, self);
+
+        self->deadletter_ttl = strtoll (zconfig_get (config, "server/deadletter_ttl", "604800"), NULL, 10);
+        self->deadletter_max = strtoull (zconfig_get (config, "server/deadletter_max", "100000"), NULL, 10);
+        s_compact_deadletters_interval (0, self);
+        ztimerset_add (self->timerset, 1000 * 60 * 60, (ztimerset_fn *) s_compact_deadletters_interval, self);
+    }
+
+    self->cache = cache_new (strtoull (zconfig_get (config, "server/cache_bytes", "16777216"), NULL, 10));
+    self->dedup = dedup_new (strtoull (zconfig_get (config, "server/dedup_capacity", "262144"), NULL, 10),
+                             atoi (zconfig_get (config, "server/dedup_window", "60000")),
+                             strtoull (zconfig_get (config, "server/dedup_recent", "4096"), NULL, 10),
+                             zclock_mono ());
+
+    self->tenant_header = zconfig_get (config, "server/tenant_header", "X-Mql-Tenant");
+    self->tenant_header_lower = strdup (self->tenant_header);
+    for (char *c = self->tenant_header_lower; *c; c++)
+        *c = (char) tolower (*c);
+
+    self->tenants = zhashx_new ();
+    zhashx_set_destructor (self->tenants, (czmq_destructor *) bucket_destroy);
+    self->other_tenants = zhashx_new ();
+    zhashx_set_destructor (self->other_tenants, (czmq_destructor *) bucket_destroy);
+
+    zconfig_t *tenants = zconfig_locate (config, "tenants");
+    for (zconfig_t *tenant = tenants ? zconfig_child (tenants) : NULL; tenant; tenant = zconfig_next (tenant)) {
+        double rate = atof (zconfig_get (tenant, "rate", "0"));
+        if (rate > 0)
+            zhashx_insert (self->tenants, zconfig_name (tenant),
+                           bucket_new (rate, atof (zconfig_get (tenant, "burst", zconfig_get (tenant, "rate", "0")))));
+    }
+
+    // Buckets of the other tenants are dropped once refilled, so a flood of
+    // made up tenant names doesn't grow the server
+    self->tenant_rate = atof (zconfig_get (config, "server/tenant_rate", "0"));
+    self->tenant_burst = atof (zconfig_get (config, "server/tenant_burst", zconfig_get (config, "server/tenant_rate", "0")));
+    if (self->tenant_rate > 0)
+        ztimerset_add (self->timerset, 1000 * 60, (ztimerset_fn *) s_sweep_tenants_interval, self);
+
+    // Without a journal reminders are lost on restart
+    char *reminders = zconfig_get (config, "server/reminders", NULL);
+    if (reminders && scheduler_load (self->scheduler, reminders) != 0) {
+        zsys_error ("Server: can't open the reminders journal %s", reminders);
+        server_destroy (&self);
+        return NULL;
+    }
 
     self->aws = aws_new ();
 
     char* access_key = zconfig_get (config, "aws/access_key", NULL);
     char* secret = zconfig_get (config, "aws/secret", NULL);
     char* region = zconfig_get (config, "aws/region", NULL);
-    char* aws_endpoint = zconfig_get (config, "aws/endpoint", NULL);
+    // A comma separated list of endpoints, the first one is the primary
+    char* aws_endpoints = zconfig_get (config, "aws/endpoint", NULL);
+    char* aws_endpoint = aws_endpoints ? strdup (aws_endpoints) : NULL;
+    char* saveptr = NULL;
+    if (aws_endpoint)
+        strtok_r (aws_endpoint, ",", &saveptr);
 
     if (region && access_key && secret) {
         aws_set (self->aws, region, access_key, secret, aws_endpoint);
@@ -95,12 +334,34 @@ server_new (zconfig_t* config, zsock_t *pipe) {
         snprintf (self->endpoint, 255, "http://%s:%d", aws_private_ip_address (self->aws), port);
     }
 
+    // The same functions deployed behind other endpoints or in other regions
+    for (char *endpoint = aws_endpoint ? strtok_r (NULL, ",", &saveptr) : NULL; endpoint; endpoint = strtok_r (NULL, ",", &saveptr)) {
+        if (aws_add_endpoint (self->aws, NULL, region ? region : "us-east-1", endpoint) == -1)
+            zsys_error ("Server: invalid aws endpoint %s, skipped", endpoint);
+    }
+    zstr_free (&aws_endpoint);
+
+    zconfig_t *endpoints = zconfig_locate (config, "aws/endpoints");
+    for (zconfig_t *endpoint = endpoints ? zconfig_child (endpoints) : NULL; endpoint; endpoint = zconfig_next (endpoint)) {
+        if (aws_add_endpoint (self->aws, zconfig_name (endpoint), zconfig_get (endpoint, "region", "us-east-1"),
+                              zconfig_get (endpoint, "endpoint", NULL)) == -1)
+            zsys_error ("Server: invalid aws endpoint %s, skipped", zconfig_name (endpoint));
+    }
+
     zsys_info ("Server: server endpoint is %s", self->endpoint);
 
     self->poller = zpoller_new (pipe, self->http_worker, aws_get_socket (self->aws), NULL);
     zpoller_set_nonstop (self->poller, true);
     self->terminated = false;
 
+    // Load the configured actor types now, so a broken native library fails on startup
+    zconfig_t *actors = zconfig_locate (config, "actors");
+    for (zconfig_t *actor = actors ? zconfig_child (actors) : NULL; actor; actor = zconfig_next (actor))
+        if (s_get_actor_type (self, zconfig_name (actor)) == NULL) {
+            server_destroy (&self);
+            return NULL;
+        }
+
     return self;
 }
 
@@ -115,12 +376,36 @@ server_destroy (mql_server_t **self_p) {
         zsock_destroy (&self->http_worker);
         zhttp_server_destroy (&self->http_server);
         zhttp_server_options_destroy (&self->http_options);
-        zhashx_destroy (&self->connections);
+        conntable_destroy (&self->connections);
+        zhashx_destroy (&self->completions);
+        zhashx_destroy (&self->clients);
+        scheduler_destroy (&self->scheduler);
+        timewheel_destroy (&self->timers);
 
         ztimerset_destroy (&self->timerset);
+        zlistx_destroy (&self->scheduled);
+        zhashx_destroy (&self->topics);
         zhashx_destroy (&self->mailboxes);
+        spill_destroy (&self->spill);
+        blobstore_destroy (&self->blobs);
+        deadletter_destroy (&self->deadletters);
+        bucket_destroy (&self->replay_rate);
+        free (self->interned);
+        zhashx_destroy (&self->actor_types);
+        quota_destroy (&self->quota);
+        cache_destroy (&self->cache);
+        dedup_destroy (&self->dedup);
+        arena_destroy (&self->arena);
+        zstr_free (&self->tenant_header_lower);
+        zhashx_destroy (&self->tenants);
+        zhashx_destroy (&self->other_tenants);
+        native_destroy (&self->native);
+        runtime_destroy (&self->runtime);
         aws_destroy (&self->aws);
         zpoller_destroy (&self->poller);
+
+        free (self);
+        *self_p = NULL;
     }
 }
 
@@ -130,71 +415,778 @@ void s_refresh_credentials_interval (int timer_id, mql_server_t *self) {
     aws_refresh_credentials (self->aws);
 }
 
+void s_runtime_expire_interval (int timer_id, mql_server_t *self) {
+    runtime_expire (self->runtime);
+}
+
+void s_sweep_tenants_interval (int timer_id, mql_server_t *self) {
+    int64_t now = zclock_mono ();
+    zlistx_t *full = zlistx_new ();
+
+    for (bucket_t *bucket = (bucket_t *) zhashx_first (self->other_tenants); bucket;
+         bucket = (bucket_t *) zhashx_next (self->other_tenants)) {
+        if (bucket_full (bucket, now))
+            zlistx_add_end (full, (void *) zhashx_cursor (self->other_tenants));
+    }
+
+    for (const char *name = (const char *) zlistx_first (full); name; name = (const char *) zlistx_next (full))
+        zhashx_delete (self->other_tenants, name);
+
+    zlistx_destroy (&full);
+}
+
+void s_expire_blobs_interval (int timer_id, mql_server_t *self) {
+    size_t expired = blobstore_expire (self->blobs, self->blob_ttl);
+    if (expired > 0)
+        zsys_info ("Server: expired %zu blobs", expired);
+}
+
+//  A warm invocation in flight, counted by the limiter of its type
+typedef struct {
+    actor_type_t *type;
+    int64_t started;
+} s_warm_t;
+
+static void
+s_warmed (s_warm_t *warm, zhttp_response_t *response) {
+    actor_type_t *type = warm->type;
+    uint32_t status_code = zhttp_response_status_code (response);
+    if (status_code >= 300)
+        zsys_warning ("Server: warming %s failed with %d", actor_type_name (type), status_code);
+
+    // Warm invocations share the concurrency of the function with the messages
+    limiter_t *limiter = actor_type_limiter (type);
+    if (limiter) {
+        limiter_release (limiter, zclock_mono () - warm->started, status_code == 429, zclock_mono ());
+        mailbox_wake (type);
+    }
+
+    warmer_warmed (actor_type_warmer (type), zclock_mono ());
+    free (warm);
+}
+
+// Warm the containers the queued messages will need, before they are invoked
+void s_warm_interval (int timer_id, mql_server_t *self) {
+    int64_t now = zclock_mono ();
+
+    for (actor_type_t *type = (actor_type_t *) zhashx_first (self->actor_types); type;
+         type = (actor_type_t *) zhashx_next (self->actor_types)) {
+        warmer_t *warmer = actor_type_warmer (type);
+        if (warmer == NULL)
+            continue;
+
+        // A failing function is left to the probe of the breaker
+        breaker_t *breaker = actor_type_breaker (type);
+        if (breaker && breaker_state (breaker) != BREAKER_CLOSED)
+            continue;
+
+        limiter_t *limiter = actor_type_limiter (type);
+        size_t limit = limiter ? limiter_available (limiter) : SIZE_MAX;
+        size_t count = warmer_plan (warmer, quota_length (actor_type_quota (type)), limit, now);
+        if (count == 0)
+            continue;
+
+        char *address = zsys_sprintf ("%s/%s", actor_type_name (type), WARMER_SUBJECT);
+        for (size_t index = 0; index < count; index++) {
+            if (limiter)
+                limiter_acquire (limiter);
+
+            json_t *root = json_pack ("{sssnsssn}", "subject", WARMER_SUBJECT, "from", "address", address, "body");
+            char *content = json_dumps (root, JSON_COMPACT);
+            json_decref (root);
+
+            s_warm_t *warm = (s_warm_t *) zmalloc (sizeof (s_warm_t));
+            warm->type = type;
+            warm->started = now;
+            actor_type_invoke (type, &content, (aws_lambda_callback_fn *) s_warmed, warm);
+        }
+        zstr_free (&address);
+    }
+}
+
+// Mailboxes paused by an open breaker send the probe once its time elapsed
+void s_breakers_interval (int timer_id, mql_server_t *self) {
+    for (actor_type_t *type = (actor_type_t *) zhashx_first (self->actor_types); type;
+         type = (actor_type_t *) zhashx_next (self->actor_types)) {
+        if (actor_type_breaker (type))
+            mailbox_wake (type);
+    }
+}
+
+// Send the dead letters queued for replay back at the replay rate
+void s_replay_interval (int timer_id, mql_server_t *self) {
+    json_t *letter;
+    while (deadletter_replaying (self->deadletters) > 0 && bucket_take (self->replay_rate, zclock_mono ())
+       &&  (letter = deadletter_next (self->deadletters))) {
+        const char *ref = json_string_value (json_object_get (letter, "body_ref"));
+        payload_t *body = ref ? payload_new_ref (ref) : payload_new_json (json_object_get (letter, "body"));
+
+        mql_server_send (self, json_string_value (json_object_get (letter, "address")),
+                         json_string_value (json_object_get (letter, "from")), 0,
+                         json_string_value (json_object_get (letter, "subject")), &body, -1, -1);
+        json_decref (letter);
+    }
+}
+
+// Drop the replayed, expired and oldest dead letters beyond the limit
+void s_compact_deadletters_interval (int timer_id, mql_server_t *self) {
+    deadletter_compact (self->deadletters, self->deadletter_ttl * 1000, self->deadletter_max, zclock_time ());
+}
+
+static int
+s_hex_value (char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// Value of the parameter of the query string of the url, URL decoded, NULL if missing
+static char *
+s_query_param (const char *url, const char *name) {
+    const char *query = strchr (url, '?');
+    size_t size = strlen (name);
+
+    while (query) {
+        query++;
+        if (strncmp (query, name, size) == 0 && query[size] == '=') {
+            char *value = strndup (query + size + 1, strcspn (query + size + 1, "&"));
+
+            // Decoded in place, the value only shrinks
+            char *target = value;
+            for (const char *source = value; *source; source++) {
+                if (*source == '%' && s_hex_value (source[1]) != -1 && s_hex_value (source[2]) != -1) {
+                    *target++ = (char) (s_hex_value (source[1]) * 16 + s_hex_value (source[2]));
+                    source += 2;
+                }
+                else
+                    *target++ = *source == '+' ? ' ' : *source;
+            }
+            *target = '\0';
+
+            return value;
+        }
+        query = strchr (query, '&');
+    }
+
+    return NULL;
+}
+
+// Bucket of the tenant named by the headers of the request, NULL if not limited
+static bucket_t *
+s_get_tenant_bucket (mql_server_t *self, zhash_t *headers) {
+    const char *name = headers ? (const char *) zhash_lookup (headers, self->tenant_header) : NULL;
+    if (name == NULL && headers)
+        name = (const char *) zhash_lookup (headers, self->tenant_header_lower);
+    if (name == NULL)
+        return NULL;
+
+    bucket_t *bucket = (bucket_t *) zhashx_lookup (self->tenants, name);
+    if (bucket || self->tenant_rate <= 0)
+        return bucket;
+
+    bucket = (bucket_t *) zhashx_lookup (self->other_tenants, name);
+    if (!bucket) {
+        bucket = bucket_new (self->tenant_rate, self->tenant_burst);
+        zhashx_insert (self->other_tenants, name, bucket);
+    }
+
+    return bucket;
+}
+
+void s_deliver_reminder (mql_server_t *self, const char *to, const char *from, const char *subject, payload_t *body) {
+    mql_server_send (self, to, from, 0, subject, &body, -1, -1);
+}
+
+static void
+s_disconnect (mql_server_t *self, server_client_t *client);
+
 static void
 server_recv_api (mql_server_t* self) {
-    char* command = zstr_recv (self->pipe);
+    zmsg_t *msg = zmsg_recv (self->pipe);
 
     // Interrupted
-    if (!command)
+    if (!msg)
         return;
 
-    if (streq (command, "$TERM"))
+    char *command = zmsg_popstr (msg);
+
+    if (command && streq (command, "$TERM"))
         self->terminated = true;
+    else
+    if (command && streq (command, "CONNECT")) {
+        char *endpoint = zmsg_popstr (msg);
+        server_client_t *client = endpoint ? server_client_new (endpoint) : NULL;
+        if (client) {
+            char key[32];
+            snprintf (key, sizeof (key), "%p", (void *) client);
+            zhashx_insert (self->clients, key, client);
+            zpoller_add (self->poller, client->socket);
+        }
+        zsock_signal (self->pipe, client ? 0 : 1);
+        zstr_free (&endpoint);
+    }
+    else
+    if (command && streq (command, "DISCONNECT")) {
+        char *endpoint = zmsg_popstr (msg);
+        for (server_client_t *client = (server_client_t *) zhashx_first (self->clients); client && endpoint;
+             client = (server_client_t *) zhashx_next (self->clients))
+            if (client->endpoint && streq (client->endpoint, endpoint)) {
+                s_disconnect (self, client);
+                break;
+            }
+        zsock_signal (self->pipe, 0);
+        zstr_free (&endpoint);
+    }
+    else
+        zsys_warning ("Server: invalid command on the pipe");
+
+    zstr_free (&command);
+    zmsg_destroy (&msg);
 }
 
 
-int
-mql_server_send_error (mql_server_t *self, const char *to, uint32_t status_code, const char* body) {
-    const char *delimiter = strchr (to, '/');
+// Free the connection slot and cancel the deadline of the caller
+static void *
+s_remove_connection (mql_server_t *self, uint64_t connection_handle) {
+    timewheel_timer_t *timer = (timewheel_timer_t *) conntable_timer (self->connections, connection_handle);
+    timewheel_cancel (self->timers, &timer);
 
-    // We only forward errors to http requests
-    if (delimiter == NULL) {
-        void *connection = zhashx_lookup (self->connections, to);
+    return conntable_remove (self->connections, connection_handle);
+}
+
+// Return the client of the connection, NULL for an http caller
+static server_client_t *
+s_client_lookup (mql_server_t *self, void *connection) {
+    char key[32];
+    snprintf (key, sizeof (key), "%p", connection);
+    return (server_client_t *) zhashx_lookup (self->clients, key);
+}
 
-        if (connection == NULL) {
-            return -1;
+// Pass the replies waiting for room on the socket of the client. Its
+// messages are read only once no reply waits, so a caller which doesn't
+// receive its replies ends up blocked sending more, nothing is dropped
+static void
+s_flush_client (mql_server_t *self, server_client_t *client) {
+    if (client->socket == NULL)
+        return;
+
+    while (zlistx_size (client->backlog) > 0 && (zsock_events (client->socket) & ZMQ_POLLOUT)) {
+        zmsg_t *msg = (zmsg_t *) zlistx_detach (client->backlog, NULL);
+        if (zmsg_send (&msg, client->socket) == -1) {
+            zsys_warning ("Server: fail to send a reply to the client at %s", client->endpoint);
+            zmsg_destroy (&msg);
         }
+    }
+
+    bool polled = zlistx_size (client->backlog) == 0;
+    if (polled != client->polled) {
+        if (polled)
+            zpoller_add (self->poller, client->socket);
+        else
+            zpoller_remove (self->poller, client->socket);
+        client->polled = polled;
+    }
+}
 
-        // TODO: build the response
+// Flush the clients, return true if replies still wait for room
+static bool
+s_flush_clients (mql_server_t *self) {
+    bool waiting = false;
+    for (server_client_t *client = (server_client_t *) zhashx_first (self->clients); client;
+         client = (server_client_t *) zhashx_next (self->clients)) {
+        s_flush_client (self, client);
+        if (zlistx_size (client->backlog) > 0)
+            waiting = true;
+    }
+
+    return waiting;
+}
 
+// The replies to a client which disconnected are dropped, the client is kept
+// as long as the server for the callers still pending
+static void
+s_disconnect (mql_server_t *self, server_client_t *client) {
+    if (client->polled)
+        zpoller_remove (self->poller, client->socket);
+    client->polled = false;
+    zsock_destroy (&client->socket);
+    zlistx_purge (client->backlog);
+}
+
+// Answer the caller of the connection with the content, over the socket of
+// its client for the in process callers, along with their completion
+static void
+s_respond (mql_server_t *self, uint64_t connection_handle, void **connection_p, uint32_t status_code, char **content) {
+    server_client_t *client = s_client_lookup (self, *connection_p);
+    if (client == NULL) {
         zhttp_response_set_status_code (self->response, status_code);
-        zhttp_response_set_content_const (self->response, body);
-        zhttp_response_send (self->response, self->http_worker, &connection);
+        zhttp_response_set_content (self->response, content);
+        zhttp_response_send (self->response, self->http_worker, connection_p);
+        return;
+    }
+
+    char address[CONNTABLE_ADDRESS_LEN];
+    conntable_format (connection_handle, address);
+    server_completion_t *completion = (server_completion_t *) zhashx_lookup (self->completions, address);
+    assert (completion);
+
+    if (client->socket) {
+        zmsg_t *msg = zmsg_new ();
+        zmsg_addstr (msg, "REPLY");
+        zmsg_addptr (msg, (void *) completion->callback);
+        zmsg_addptr (msg, completion->arg);
+        zmsg_addstrf (msg, "%u", status_code);
+        zmsg_addmem (msg, *content, strlen (*content));
+        zlistx_add_end (client->backlog, msg);
+        s_flush_client (self, client);
+    }
+    else
+        zsys_debug ("Server: dropping the reply to a disconnected client");
+
+    zhashx_delete (self->completions, address);
+    zstr_free (content);
+    *connection_p = NULL;
+}
+
+// Answer the duplicates which waited for the original caller, a failed
+// original is forgotten so the caller can retry
+static void
+s_answer_duplicates (mql_server_t *self, uint64_t connection_handle, uint32_t status_code, const char *content) {
+    uint64_t *waiting;
+    size_t size = dedup_complete (self->dedup, connection_handle, status_code == 200 ? content : NULL, zclock_mono (), &waiting);
+
+    for (size_t index = 0; index < size; index++) {
+        void *connection = s_remove_connection (self, waiting[index]);
+        if (connection == NULL)
+            continue;
+
+        char *reply = strdup (content);
+        s_respond (self, waiting[index], &connection, status_code, &reply);
+    }
+
+    free (waiting);
+}
+
+static void
+s_deadline_expired (mql_server_t *self, uint64_t connection_handle) {
+    // The timer is released by the wheel once we return
+    conntable_set_timer (self->connections, connection_handle, NULL);
+
+    zsys_warning ("Server: http caller deadline expired");
+
+    // The message may still run, so its idempotency key stays pending and
+    // a retry waits for its reply instead of running it a second time
+    void *connection = s_remove_connection (self, connection_handle);
+    if (connection) {
+        char *content = strdup ("{\"body\": \"Timeout\"}");
+        s_respond (self, connection_handle, &connection, 504, &content);
+    }
+}
+
+bool
+mql_server_connected (mql_server_t *self, uint64_t connection) {
+    return conntable_lookup (self->connections, connection) != NULL
+        || dedup_pending (self->dedup, connection);
+}
+
+void
+mql_server_schedule (mql_server_t *self, mailbox_t *mailbox) {
+    zlistx_add_end (self->scheduled, mailbox);
+}
+
+int
+mql_server_send_error (mql_server_t *self, uint64_t connection_handle, uint32_t status_code, const char* body) {
+    // We only forward errors to http requests
+    if (connection_handle == 0)
+        return -1;
+
+    s_answer_duplicates (self, connection_handle, status_code, body);
+    void *connection = s_remove_connection (self, connection_handle);
+
+    if (connection == NULL)
+        return -1;
+
+    char *content = strdup (body);
+    s_respond (self, connection_handle, &connection, status_code, &content);
+
+    return 0;
+}
+
+static void
+s_send_overloaded (mql_server_t *self, void **connection) {
+    zhash_update (zhttp_response_headers (self->response), "Retry-After", self->retry_after);
+
+    zhttp_response_set_status_code (self->response, 429);
+    zhttp_response_set_content_const (self->response, "{\"body\": \"Too many requests\"}");
+    zhttp_response_send (self->response, self->http_worker, connection);
+
+    zhash_delete (zhttp_response_headers (self->response), "Retry-After");
+}
+
+int
+mql_server_send_overloaded (mql_server_t *self, uint64_t connection_handle) {
+    s_answer_duplicates (self, connection_handle, 429, "{\"body\": \"Too many requests\"}");
+    void *connection = s_remove_connection (self, connection_handle);
+
+    if (connection == NULL)
+        return -1;
+
+    if (s_client_lookup (self, connection)) {
+        char *content = strdup ("{\"body\": \"Too many requests\"}");
+        s_respond (self, connection_handle, &connection, 429, &content);
+    }
+    else
+        s_send_overloaded (self, &connection);
+
+    return 0;
+}
+
+// Check the idempotency key of the message, return true if the caller was
+// answered, or waits for the original, instead of the message running again
+static bool
+s_deduplicate (mql_server_t *self, const char *address, const char *idempotency_key, uint64_t connection_handle) {
+    char *key = zsys_sprintf ("%s\n%s", address, idempotency_key);
+    const char *reply = NULL;
+    dedup_state_t state = dedup_check (self->dedup, key, connection_handle, zclock_mono (), &reply);
+    zstr_free (&key);
+
+    if (state == DEDUP_DONE) {
+        char *content = strdup (reply);
+        void *connection = s_remove_connection (self, connection_handle);
+        s_respond (self, connection_handle, &connection, 200, &content);
+    }
+    else
+    if (state == DEDUP_CONFLICT)
+        mql_server_send_error (self, connection_handle, 409, "{\"body\": \"Duplicate idempotency key\"}");
+
+    // A pending duplicate is answered along with the original
+    return state != DEDUP_NEW;
+}
+
+int
+mql_server_remind (mql_server_t *self, const char *from, json_t *schedule) {
+    return scheduler_add (self->scheduler, from, schedule);
+}
+
+quota_t *
+mql_server_quota (mql_server_t *self) {
+    return self->quota;
+}
+
+arena_t *
+mql_server_arena (mql_server_t *self) {
+    return self->arena;
+}
+
+spill_t *
+mql_server_spill (mql_server_t *self) {
+    return self->spill;
+}
+
+void
+mql_server_offload (mql_server_t *self, payload_t **body) {
+    if (self->blobs == NULL || *body == NULL || payload_ref (*body) || payload_size (*body) <= self->blob_threshold)
+        return;
+
+    // A body lost in the spill file is failed once it reaches the head of its mailbox
+    const char *data = payload_data (*body);
+    if (data == NULL)
+        return;
+
+    char ref[BLOBSTORE_REF_LEN];
+    if (blobstore_put (self->blobs, data, payload_size (*body), ref) != 0) {
+        zsys_warning ("Server: can't store a body of %zu bytes, passing it as is", payload_size (*body));
+        return;
+    }
+
+    payload_decref (body);
+    *body = payload_new_ref (ref);
+}
+
+void
+mql_server_fail (mql_server_t *self, uint64_t connection, uint32_t status_code, const char *content,
+                 const char *type, const char *address, const char *from, const char *subject, payload_t *body) {
+    if (connection != 0) {
+        mql_server_send_error (self, connection, status_code, content);
+        return;
+    }
+
+    if (self->deadletters == NULL) {
+        zsys_warning ("Server: dropping failed message. address: %s, subject: %s", address, subject);
+        return;
+    }
+
+    char error[16];
+    snprintf (error, sizeof (error), "%u", status_code);
+    deadletter_add (self->deadletters, type, address, from, subject, error, body);
+}
+
+deadletter_t *
+mql_server_deadletters (mql_server_t *self) {
+    return self->deadletters;
+}
 
-        zhashx_delete (self->connections, to);
+int
+mql_server_reply (mql_server_t *self, uint64_t connection_handle, const char *from, const char *subject, payload_t **body) {
+    return mql_server_reply_cached (self, connection_handle, from, subject, body, NULL, 0, 0);
+}
+
+int
+mql_server_reply_cached (mql_server_t *self, uint64_t connection_handle, const char *from, const char *subject, payload_t **body,
+                         const char *cache_key, uint64_t epoch, int ttl) {
+    // Callers get the body itself, references only travel between actors
+    if (*body && payload_ref (*body)) {
+        size_t size;
+        char *data = self->blobs ? blobstore_get (self->blobs, payload_ref (*body), &size) : NULL;
+        payload_decref (body);
+
+        if (data == NULL) {
+            zsys_warning ("Server: reply from %s refers to a missing blob", from);
+            return mql_server_send_error (self, connection_handle, 500, "{\"body\": \"Lost\"}");
+        }
+
+        *body = payload_new (data, size);
+        free (data);
+    }
+
+    json_t *root = json_pack ("{ssss}", "from", from, "subject", subject);
+    char *content = payload_wrap (*body, root);
+    payload_decref (body);
+    json_decref (root);
+
+    if (content == NULL) {
+        zsys_warning ("Server: can't read the reply from %s", from);
+        return mql_server_send_error (self, connection_handle, 500, "{\"body\": \"Lost\"}");
+    }
+
+    // Cached even if the caller is gone, the next caller gets it
+    if (cache_key)
+        cache_insert (self->cache, cache_key, content, epoch, zclock_mono () + ttl);
+
+    s_answer_duplicates (self, connection_handle, 200, content);
+
+    void *connection = s_remove_connection (self, connection_handle);
+
+    if (connection == NULL) {
+        zsys_warning ("Sever: reply to dead http connection from %s", from);
+        zstr_free (&content);
+        return -1;
     }
+
+    s_respond (self, connection_handle, &connection, 200, &content);
+
+    return 0;
 }
 
 int
-mql_server_send (mql_server_t *self, const char *to, const char *from, const char *subject, json_t **body) {
+mql_server_send (mql_server_t *self, const char *to, const char *from, uint64_t connection, const char *subject, payload_t **body,
+                 int priority, int ttl) {
 
     // Check if an http connection
-    if (strncmp ("$http/", to, 6) == 0) {
-        void *connection = zhashx_lookup (self->connections, to);
+    if (strncmp (CONNTABLE_ADDRESS_PREFIX, to, strlen (CONNTABLE_ADDRESS_PREFIX)) == 0)
+        return mql_server_reply (self, conntable_parse (to), from, subject, body);
+
+    mailbox_t *mailbox = s_get_mailbox (self, to);
+    if (mailbox == NULL) {
+        mql_server_send_error (self, connection, 400, "{\"body\": \"Invalid address\"}");
+        payload_decref (body);
+        return -1;
+    }
+
+    return mailbox_send (mailbox, to, from, connection, subject, body, priority, ttl);
+}
+
+void
+mql_server_subscribe (mql_server_t *self, const char *name, uint32_t mailbox_id, bool subscribe) {
+    topic_t *topic = (topic_t *) zhashx_lookup (self->topics, name);
 
-        if (connection == NULL) {
-            zsys_warning ("Sever: reply to dead http connection from %s", from);
-            json_decref (*body);
-            return -1;
+    if (subscribe) {
+        if (!topic) {
+            topic = topic_new ();
+            zhashx_insert (self->topics, name, topic);
         }
 
-        json_t *root = json_pack ("{ssssso?}", "from", from, "subject", subject, "body", *body);
-        *body = NULL;
+        topic_subscribe (topic, mailbox_id);
+    }
+    else
+    if (topic) {
+        topic_unsubscribe (topic, mailbox_id);
+        if (topic_size (topic) == 0)
+            zhashx_delete (self->topics, name);
+    }
+}
 
-        char *content = json_dumps (root, JSON_COMPACT);
-        json_decref (root);
+size_t
+mql_server_publish (mql_server_t *self, const char *name, const char *from, const char *subject, payload_t **body,
+                    int priority, int ttl) {
+    topic_t *topic = (topic_t *) zhashx_lookup (self->topics, name);
+    size_t size = topic ? topic_size (topic) : 0;
+    const uint32_t *ids = topic ? topic_ids (topic) : NULL;
+
+    // Stored once for all the subscribers
+    if (size > 0)
+        mql_server_offload (self, body);
+
+    // Every subscriber gets a reference to the same serialized body
+    for (size_t index = 0; index < size; index++) {
+        mailbox_t *mailbox = self->interned[ids[index]];
+        payload_t *payload = payload_incref (*body);
+        mailbox_send (mailbox, mailbox_address (mailbox), from, 0, subject, &payload, priority, ttl);
+    }
 
-        zhttp_response_set_status_code (self->response, 200);
-        zhttp_response_set_content (self->response, &content);
-        zhttp_response_send (self->response, self->http_worker, &connection);
+    payload_decref (body);
 
-        zhashx_delete (self->connections, to);
+    return size;
+}
+
+// Message of an in process caller, checked and queued as one from http,
+// the reply goes back over the socket of its client
+static void
+s_recv_request (mql_server_t *self, server_client_t *client) {
+    zmsg_t *request = zmsg_recv (client->socket);
+
+    // Interrupted
+    if (!request)
+        return;
+
+    char *command = zmsg_popstr (request);
+    char *address = zmsg_popstr (request);
+    char *subject = zmsg_popstr (request);
+    server_completion_t *completion = (server_completion_t *) zmalloc (sizeof (server_completion_t));
+    assert (completion);
+    completion->callback = (mql_server_reply_fn *) zmsg_popptr (request);
+    completion->arg = zmsg_popptr (request);
+    zframe_t *headers_frame = zmsg_pop (request);
+    zframe_t *frame = zmsg_pop (request);
+    zmsg_destroy (&request);
+
+    if (!command || !streq (command, "REQUEST") || !address || !subject || !headers_frame || !frame) {
+        zsys_warning ("Server: invalid request from a client");
+        zstr_free (&command);
+        zstr_free (&address);
+        zstr_free (&subject);
+        free (completion);
+        zframe_destroy (&headers_frame);
+        zframe_destroy (&frame);
+        return;
+    }
+    zstr_free (&command);
+
+    // The headers of POST /send, packed by the caller, empty when none
+    zhash_t *headers = zframe_size (headers_frame) > 0 ? zhash_unpack (headers_frame) : NULL;
+    zframe_destroy (&headers_frame);
+
+    uint64_t connection_handle = conntable_insert (self->connections, client);
+    char completion_key[CONNTABLE_ADDRESS_LEN];
+    conntable_format (connection_handle, completion_key);
+    zhashx_insert (self->completions, completion_key, completion);
+
+    // The tenant, the actor type and the subject each have their own rate,
+    // the one of the tenant is checked before anything is looked up
+    bucket_t *tenant = s_get_tenant_bucket (self, headers);
+    bool throttled = tenant && !bucket_take (tenant, zclock_mono ());
+
+    mailbox_t *mailbox = throttled ? NULL : s_get_mailbox (self, address);
+    actor_type_t *type = mailbox ? mailbox_type (mailbox) : NULL;
+    const char *content = (const char *) zframe_data (frame);
+    size_t size = zframe_size (frame);
+
+    bucket_t *buckets[] = {
+        type ? actor_type_bucket (type, NULL) : NULL,
+        type ? actor_type_bucket (type, subject) : NULL
+    };
+
+    if (throttled) {
+        zsys_warning ("Server: rate limited tenant of a request of %s from a client", address);
+        mql_server_send_overloaded (self, connection_handle);
+    }
+    else
+    if (mailbox == NULL)
+        mql_server_send_error (self, connection_handle, 400, "{\"error\": \"invalid address\"}");
+    else
+    if (!bucket_take_all (buckets, 2, zclock_mono ())) {
+        zsys_warning ("Server: rate limited request of %s from a client", address);
+        mql_server_send_overloaded (self, connection_handle);
     }
+    else
+    if (size > self->max_body)
+        mql_server_send_error (self, connection_handle, 413, "{\"error\": \"body too large\"}");
+    else
+    if (jscan_validate (content, size) != 0)
+        mql_server_send_error (self, connection_handle, 400, "{\"error\": \"invalid json\"}");
+    else
+    if (mailbox_full (mailbox, size))
+        mql_server_send_overloaded (self, connection_handle);
     else {
-        mailbox_t *mailbox = s_get_mailbox (self, to);
+        char *cached = NULL;
+        if (actor_type_cache_ttl (type, subject) > 0) {
+            char *reply_key = cache_key (address, subject, content, size);
+            const char *reply = cache_lookup (self->cache, reply_key, mailbox_epoch (mailbox), zclock_mono ());
+            cached = reply ? strdup (reply) : NULL;
+            zstr_free (&reply_key);
+        }
+
+        const char *timeout_str = headers ? (const char *) zhash_lookup (headers, "X-Mql-Timeout") : NULL;
+        const char *priority_str = headers ? (const char *) zhash_lookup (headers, "X-Mql-Priority") : NULL;
+        const char *ttl_str = headers ? (const char *) zhash_lookup (headers, "X-Mql-Ttl") : NULL;
+        const char *idempotency_key = headers ? (const char *) zhash_lookup (headers, "Idempotency-Key") : NULL;
 
-        return mailbox_send (mailbox, from, subject, body);
+        if (cached) {
+            void *connection = s_remove_connection (self, connection_handle);
+            s_respond (self, connection_handle, &connection, 200, &cached);
+        }
+        else {
+            int timeout = timeout_str ? atoi (timeout_str) : actor_type_timeout (type);
+            if (timeout > 0) {
+                timewheel_timer_t *timer = timewheel_add (self->timers, zclock_mono () + timeout,
+                                                          (timewheel_fn *) s_deadline_expired, self, connection_handle);
+                conntable_set_timer (self->connections, connection_handle, timer);
+            }
+
+            // The body is queued as it came, without a copy
+            if (!idempotency_key || !s_deduplicate (self, address, idempotency_key, connection_handle)) {
+                payload_t *body = payload_new_frame (&frame);
+                mailbox_send (mailbox, address, NULL, connection_handle, subject, &body,
+                              priority_str ? atoi (priority_str) : -1,
+                              ttl_str ? atoi (ttl_str) : -1);
+            }
+        }
     }
+
+    zhash_destroy (&headers);
+    zframe_destroy (&frame);
+    zstr_free (&address);
+    zstr_free (&subject);
+}
+
+// Return true if the request carries the bearer token of the blobs
+static bool
+s_blob_authorized (mql_server_t *self) {
+    if (self->blob_token == NULL)
+        return false;
+
+    zhash_t *headers = zhttp_request_headers (self->request);
+    const char *authorization = (const char *) zhash_lookup (headers, "Authorization");
+    if (authorization == NULL)
+        authorization = (const char *) zhash_lookup (headers, "authorization");
+    if (authorization == NULL || strncmp (authorization, "Bearer ", strlen ("Bearer ")) != 0)
+        return false;
+
+    // Compared in constant time, the token is a secret
+    const char *token = authorization + strlen ("Bearer ");
+    size_t size = strlen (self->blob_token);
+    if (strlen (token) != size)
+        return false;
+
+    unsigned char difference = 0;
+    for (size_t index = 0; index < size; index++)
+        difference |= (unsigned char) (token[index] ^ self->blob_token[index]);
+
+    return difference == 0;
 }
 
 static void
@@ -207,39 +1199,287 @@ server_recv_http (mql_server_t* self) {
     char* actor_id;
     char* actor_type;
     char* subject;
+    char* request_id;
+    char* ref;
 
     zsys_info ("Server: new request %s %s", method, url);
 
     if (zhttp_request_match (self->request, "POST", "/send/%s/%s/%s", &actor_type, &actor_id, &subject)) {
+        // Refused before an actor type is looked up, or created, for the name
+        if (*actor_type == '\0' || strlen (actor_type) > MQL_ROUTING_KEY_MAX_LEN) {
+            zsys_warning ("Server: invalid actor type %s %s", method, url);
+            zhttp_response_set_status_code (self->response, 400);
+            zhttp_response_set_content_const (self->response, "{\"error\": \"invalid actor type\"}");
+            zhttp_response_send (self->response, self->http_worker, &connection);
+            return;
+        }
+
+        // The tenant, the actor type and the subject each have their own rate,
+        // the one of the tenant is checked before anything is looked up or
+        // created for the request
+        bucket_t *tenant = s_get_tenant_bucket (self, zhttp_request_headers (self->request));
+        if (tenant && !bucket_take (tenant, zclock_mono ())) {
+            zsys_warning ("Server: rate limited tenant %s %s", method, url);
+            s_send_overloaded (self, &connection);
+            return;
+        }
+
+        actor_type_t *type = s_get_actor_type (self, actor_type);
+        if (type == NULL) {
+            zhttp_response_set_status_code (self->response, 404);
+            zhttp_response_set_content_const (self->response, "{\"error\": \"unknown actor type\"}");
+            zhttp_response_send (self->response, self->http_worker, &connection);
+            return;
+        }
+
+        bucket_t *buckets[] = {
+            actor_type_bucket (type, NULL),
+            actor_type_bucket (type, subject)
+        };
+
+        if (!bucket_take_all (buckets, 2, zclock_mono ())) {
+            zsys_warning ("Server: rate limited %s %s", method, url);
+            s_send_overloaded (self, &connection);
+            return;
+        }
+
+        char *address = zsys_sprintf ("%s/%s", actor_type, actor_id);
+        mailbox_t *mailbox = s_get_mailbox (self, address);
+
+        const char *content = zhttp_request_content (self->request);
+        size_t size = content ? strlen (content) : 0;
+
+        // Refused now rather than by lambda, after queuing and signing
+        if (size > self->max_body) {
+            zsys_warning ("Server: body of %zu bytes too large", size);
+            zhttp_response_set_status_code (self->response, 413);
+            zhttp_response_set_content_const (self->response, "{\"error\": \"body too large\"}");
+            zhttp_response_send (self->response, self->http_worker, &connection);
+            zstr_free (&address);
+            return;
+        }
+
+        // Cached replies are answered without queuing, as long as no other
+        // subject ran on the actor since
+        if (actor_type_cache_ttl (type, subject) > 0) {
+            char *key = cache_key (address, subject, content, size);
+            const char *cached = cache_lookup (self->cache, key, mailbox_epoch (mailbox), zclock_mono ());
+            zstr_free (&key);
+
+            if (cached) {
+                char *reply = strdup (cached);
+                zhttp_response_set_status_code (self->response, 200);
+                zhttp_response_set_content (self->response, &reply);
+                zhttp_response_send (self->response, self->http_worker, &connection);
+                zstr_free (&address);
+                return;
+            }
+        }
 
-        json_error_t error;
-        json_t *body = json_loads (zhttp_request_content (self->request), 0, &error);
+        // Push back before paying for parsing a message which would be refused anyway
+        if (mailbox_full (mailbox, size)) {
+            s_send_overloaded (self, &connection);
+            zstr_free (&address);
+            return;
+        }
 
-        if (body == NULL) {
+        if (jscan_validate (content, size) != 0) {
             zsys_warning ("Server: invalid json received");
             zhttp_response_set_status_code (self->response, 400);
             zhttp_response_set_content_const (self->response, "{\"error\": \"invalid json\"}");
             zhttp_response_send (self->response, self->http_worker, &connection);
+            zstr_free (&address);
             return;
         }
 
-        char *address = zsys_sprintf ("%s/%s", actor_type, actor_id);
-        mailbox_t *mailbox = s_get_mailbox (self, address);
+        // Only validated, the body is passed on to the actor as is
+        payload_t *body = payload_new (content, size);
+
+        uint64_t connection_handle = conntable_insert (self->connections, connection);
+
+        // The caller can ask for a shorter or longer deadline than the actor type's
+        zhash_t *headers = zhttp_request_headers (self->request);
+        const char *timeout_str = (const char *) zhash_lookup (headers, "X-Mql-Timeout");
+        if (timeout_str == NULL)
+            timeout_str = (const char *) zhash_lookup (headers, "x-mql-timeout");
 
-        char *from = zsys_sprintf ("$http/%" PRIu64, self->next_id);
-        self->next_id++;
+        const char *priority_str = (const char *) zhash_lookup (headers, "X-Mql-Priority");
+        if (priority_str == NULL)
+            priority_str = (const char *) zhash_lookup (headers, "x-mql-priority");
 
-        // Insert the new connection, hash take ownership of the new from
-        zhashx_insert (self->connections, from, connection);
+        const char *ttl_str = (const char *) zhash_lookup (headers, "X-Mql-Ttl");
+        if (ttl_str == NULL)
+            ttl_str = (const char *) zhash_lookup (headers, "x-mql-ttl");
+
+        int timeout = timeout_str ? atoi (timeout_str) : actor_type_timeout (type);
+        if (timeout > 0) {
+            timewheel_timer_t *timer = timewheel_add (self->timers, zclock_mono () + timeout,
+                                                      (timewheel_fn *) s_deadline_expired, self, connection_handle);
+            conntable_set_timer (self->connections, connection_handle, timer);
+        }
+
+        // Retries of a message already accepted get its reply instead of running it again
+        const char *idempotency_key = (const char *) zhash_lookup (headers, "Idempotency-Key");
+        if (idempotency_key == NULL)
+            idempotency_key = (const char *) zhash_lookup (headers, "idempotency-key");
+
+        if (idempotency_key && s_deduplicate (self, address, idempotency_key, connection_handle)) {
+            payload_decref (&body);
+            zstr_free (&address);
+            return;
+        }
 
         //  Queuing the message on the worker, the worker is responsible to reply to the client through the return address
         mailbox_send (
                 mailbox,
-                from,
+                address,
+                NULL,
+                connection_handle,
                 subject,
-                &body);
+                &body,
+                priority_str ? atoi (priority_str) : -1,
+                ttl_str ? atoi (ttl_str) : -1);
+
+        zstr_free (&address);
+    }
+    else if (zhttp_request_match (self->request, "GET", "/admin/functions")) {
+        // Concurrency limits of the functions and how they moved
+        json_t *functions = json_object ();
+        int64_t now = zclock_mono ();
+
+        for (actor_type_t *type = (actor_type_t *) zhashx_first (self->actor_types); type;
+             type = (actor_type_t *) zhashx_next (self->actor_types)) {
+            limiter_t *limiter = actor_type_limiter (type);
+            warmer_t *warmer = actor_type_warmer (type);
+            breaker_t *breaker = actor_type_breaker (type);
+            if (!limiter && !warmer && !breaker && actor_type_expired (type) == 0)
+                continue;
+
+            json_t *status = limiter ? limiter_status (limiter, now) : json_object ();
+            if (warmer)
+                json_object_set_new (status, "warm", json_integer ((json_int_t) warmer_warm (warmer, now)));
+            if (actor_type_expired (type) > 0)
+                json_object_set_new (status, "expired", json_integer ((json_int_t) actor_type_expired (type)));
+            if (breaker) {
+                breaker_state_t state = breaker_state (breaker);
+                json_object_set_new (status, "breaker", json_string (state == BREAKER_OPEN ? "open" :
+                                                                     state == BREAKER_HALF_OPEN ? "half_open" : "closed"));
+            }
+            json_object_set_new (functions, actor_type_name (type), status);
+        }
+
+        char *content = json_dumps (functions, JSON_COMPACT);
+        json_decref (functions);
+
+        zhttp_response_set_status_code (self->response, 200);
+        zhttp_response_set_content (self->response, &content);
+        zhttp_response_send (self->response, self->http_worker, &connection);
+    }
+    else if (zhttp_request_match (self->request, "GET", "/admin/endpoints")) {
+        json_t *endpoints = aws_status (self->aws);
+        char *content = json_dumps (endpoints, JSON_COMPACT);
+        json_decref (endpoints);
+
+        zhttp_response_set_status_code (self->response, 200);
+        zhttp_response_set_content (self->response, &content);
+        zhttp_response_send (self->response, self->http_worker, &connection);
+    }
+    else if (self->deadletters && strncmp (url, "/admin/deadletters", strlen ("/admin/deadletters")) == 0) {
+        // Dead letters filtered by actor type, address and error, and their replay
+        const char *path = url + strlen ("/admin/deadletters");
+        char *type = s_query_param (url, "type");
+        char *address = s_query_param (url, "address");
+        char *error = s_query_param (url, "error");
+        char *content = NULL;
+
+        if (streq (method, "GET") && (*path == '\0' || *path == '?')) {
+            char *limit = s_query_param (url, "limit");
+            char *replayed = s_query_param (url, "replayed");
+            json_t *letters = deadletter_list (self->deadletters, type, address, error,
+                                               replayed && atoi (replayed) != 0, limit ? strtoull (limit, NULL, 10) : 100);
+            content = json_dumps (letters, JSON_COMPACT);
+            json_decref (letters);
+            zstr_free (&limit);
+            zstr_free (&replayed);
+        }
+        else
+        if (streq (method, "POST") && strncmp (path, "/replay", strlen ("/replay")) == 0) {
+            size_t count = deadletter_replay (self->deadletters, type, address, error);
+            content = zsys_sprintf ("{\"queued\": %zu}", count);
+        }
 
+        if (content) {
+            zhttp_response_set_status_code (self->response, 200);
+            zhttp_response_set_content (self->response, &content);
+        }
+        else {
+            zhttp_response_set_status_code (self->response, 404);
+            zhttp_response_set_content_const (self->response, "Not found");
+        }
+        zhttp_response_send (self->response, self->http_worker, &connection);
+
+        zstr_free (&type);
         zstr_free (&address);
+        zstr_free (&error);
+    }
+    else if (self->blobs && strncmp (url, "/blobs", strlen ("/blobs")) == 0 && !s_blob_authorized (self)) {
+        // Blobs are for the actors only, they hold the bodies of any caller
+        zsys_warning ("Server: unauthorized %s %s", method, url);
+        zhttp_response_set_status_code (self->response, 401);
+        zhttp_response_set_content_const (self->response, "{\"error\": \"unauthorized\"}");
+        zhttp_response_send (self->response, self->http_worker, &connection);
+    }
+    else if (self->blobs && zhttp_request_match (self->request, "GET", "/blobs/%s", &ref)) {
+        // Actors read the bodies passed by reference
+        size_t size;
+        char *data = blobstore_get (self->blobs, ref, &size);
+        if (data) {
+            zhttp_response_set_status_code (self->response, 200);
+            zhttp_response_set_content (self->response, &data);
+        }
+        else {
+            zhttp_response_set_status_code (self->response, 404);
+            zhttp_response_set_content_const (self->response, "{\"error\": \"blob not found\"}");
+        }
+        zhttp_response_send (self->response, self->http_worker, &connection);
+    }
+    else if (self->blobs && zhttp_request_match (self->request, "POST", "/blobs")) {
+        // Actors store large bodies and pass the reference on
+        const char *content = zhttp_request_content (self->request);
+        char ref[BLOBSTORE_REF_LEN];
+
+        if (content && jscan_validate (content, strlen (content)) == 0
+        &&  blobstore_put (self->blobs, content, strlen (content), ref) == 0) {
+            char *reply = zsys_sprintf ("{\"ref\": \"%s\"}", ref);
+            zhttp_response_set_status_code (self->response, 200);
+            zhttp_response_set_content (self->response, &reply);
+        }
+        else {
+            zhttp_response_set_status_code (self->response, 400);
+            zhttp_response_set_content_const (self->response, "{\"error\": \"invalid json\"}");
+        }
+        zhttp_response_send (self->response, self->http_worker, &connection);
+    }
+    else if (zhttp_request_match (self->request, "GET", "/runtime/%s/2018-06-01/runtime/invocation/next", &actor_type)) {
+        if (!s_is_runtime (self, actor_type)) {
+            zhttp_response_set_status_code (self->response, 404);
+            zhttp_response_set_content_const (self->response, "{\"errorMessage\": \"not a runtime function\"}");
+            zhttp_response_send (self->response, self->http_worker, &connection);
+            return;
+        }
+
+        // Long poll, the runtime holds the connection until an invocation is available
+        runtime_next (self->runtime, actor_type, connection);
+    }
+    else if (zhttp_request_match (self->request, "POST", "/runtime/%s/2018-06-01/runtime/invocation/%s/response", &actor_type, &request_id) && s_is_runtime (self, actor_type))
+        runtime_complete (self->runtime, request_id, zhttp_request_content (self->request), false, connection);
+    else if (zhttp_request_match (self->request, "POST", "/runtime/%s/2018-06-01/runtime/invocation/%s/error", &actor_type, &request_id) && s_is_runtime (self, actor_type))
+        runtime_complete (self->runtime, request_id, zhttp_request_content (self->request), true, connection);
+    else if (zhttp_request_match (self->request, "POST", "/runtime/%s/2018-06-01/runtime/init/error", &actor_type)) {
+        zsys_error ("Server: runtime of %s failed to initialize %s", actor_type, zhttp_request_content (self->request));
+        zhttp_response_set_status_code (self->response, 202);
+        zhttp_response_set_content_const (self->response, "{\"status\": \"OK\"}");
+        zhttp_response_send (self->response, self->http_worker, &connection);
     }
     else {
         zsys_warning ("Server: not found %s %s", method, url);
@@ -254,30 +1494,364 @@ mql_server_actor (zsock_t *pipe, void *arg) {
     mql_server_t *self = server_new (arg, pipe);
     zsock_signal (pipe, 0);
 
+    // Tell the caller whether the server could start
+    zstr_send (pipe, self ? "STARTED" : "FAILED");
+    if (!self)
+        return;
+
     zsys_info ("Server: listening on port %d", zhttp_server_port (self->http_server));
 
     while (!self->terminated) {
-        void* which = zpoller_wait (self->poller, ztimerset_timeout (self->timerset));
-        ztimerset_execute (self->timerset);
+        int timeout = ztimerset_timeout (self->timerset);
+        int deadline = timewheel_timeout (self->timers, zclock_mono ());
+        if (deadline != -1 && (timeout == -1 || deadline < timeout))
+            timeout = deadline;
 
-        if (which == pipe)
-            server_recv_api (self);
-        else if (which == self->http_worker)
-            server_recv_http (self);
-        else if (which == aws_get_socket (self->aws))
-            aws_execute (self->aws);
+        // Invocations which failed before they were sent are answered right away
+        if (aws_has_failed (self->aws))
+            timeout = 0;
+
+        // Replies waiting for room on the socket of a client are tried again soon
+        if (s_flush_clients (self) && (timeout == -1 || timeout > SERVER_BACKLOG_RETRY))
+            timeout = SERVER_BACKLOG_RETRY;
+
+        zpoller_wait (self->poller, self->busy_poll ? 0 : timeout);
+        ztimerset_execute (self->timerset);
+        timewheel_execute (self->timers, zclock_mono ());
+
+        // Drain all the ready sockets, a batch from each in turn, so a flood of
+        // requests can't starve the lambda completions or the other way around
+        int handled = 0;
+        int round;
+        do {
+            round = 0;
+
+            for (int i = 0; i < self->batch && zsock_has_in (pipe) && !self->terminated; i++, round++)
+                server_recv_api (self);
+
+            for (int i = 0; i < self->batch && zsock_has_in (self->http_worker); i++, round++)
+                server_recv_http (self);
+
+            for (server_client_t *client = (server_client_t *) zhashx_first (self->clients); client;
+                 client = (server_client_t *) zhashx_next (self->clients))
+                for (int i = 0; i < self->batch && client->polled && zsock_has_in (client->socket); i++, round++)
+                    s_recv_request (self, client);
+
+            int rc = aws_execute (self->aws, self->batch);
+            if (rc > 0)
+                round += rc;
+
+            if (self->native) {
+                rc = native_execute (self->native, self->batch);
+                if (rc > 0)
+                    round += rc;
+            }
+
+            handled += round;
+        } while (round > 0 && handled < self->budget && !self->terminated);
+
+        mailbox_t *mailbox = (mailbox_t *) zlistx_first (self->scheduled);
+        while (mailbox) {
+            zlistx_detach_cur (self->scheduled);
+            mailbox_dispatch (mailbox);
+            mailbox = (mailbox_t *) zlistx_first (self->scheduled);
+        }
     }
 
     server_destroy (&self);
 }
 
+// Limit of the actor type, falling back to the default of all the actor types
+static const char *
+s_get_limit (mql_server_t *self, const char *name, const char *key, const char *default_value) {
+    char *path = zsys_sprintf ("actors/%s/%s", name, key);
+    const char *value = zconfig_get (self->config, path, NULL);
+    zstr_free (&path);
+
+    if (value)
+        return value;
+
+    path = zsys_sprintf ("limits/%s", key);
+    value = zconfig_get (self->config, path, default_value);
+    zstr_free (&path);
+
+    return value;
+}
+
+// Declare the comma separated subjects of the actor type config key
+static void
+s_set_access (mql_server_t *self, actor_type_t *actor_type, const char *key, actor_type_access_t access) {
+    char *path = zsys_sprintf ("actors/%s/%s", actor_type_name (actor_type), key);
+    char *subjects = strdup (zconfig_get (self->config, path, ""));
+    zstr_free (&path);
+
+    char *saveptr = NULL;
+    for (char *subject = strtok_r (subjects, ", ", &saveptr); subject; subject = strtok_r (NULL, ", ", &saveptr))
+        actor_type_set_access (actor_type, subject, access);
+
+    zstr_free (&subjects);
+}
+
+static actor_type_t *
+s_get_actor_type (mql_server_t *self, const char *name) {
+    actor_type_t *actor_type = (actor_type_t *) zhashx_lookup (self->actor_types, name);
+    if (actor_type)
+        return actor_type;
+
+    // Any name is a lambda function, but callers can make up names, so only
+    // so many actor types are created for names missing from the config
+    char *path = zsys_sprintf ("actors/%s", name);
+    bool configured = zconfig_locate (self->config, path) != NULL;
+    zstr_free (&path);
+
+    if (!configured) {
+        if (self->implicit_types >= self->max_implicit_types) {
+            zsys_warning ("Server: unknown actor type %.64s", name);
+            return NULL;
+        }
+        self->implicit_types++;
+    }
+
+    path = zsys_sprintf ("actors/%s/library", name);
+    char *library = zconfig_get (self->config, path, NULL);
+    zstr_free (&path);
+
+    path = zsys_sprintf ("actors/%s/backend", name);
+    char *backend = zconfig_get (self->config, path, library ? "native" : "lambda");
+    zstr_free (&path);
+
+    if (streq (backend, "runtime")) {
+        // Workers pull the invocations through the lambda runtime api
+        if (!self->runtime) {
+            int timeout = atoi (zconfig_get (self->config, "runtime/timeout", "60000"));
+            int poll_timeout = atoi (zconfig_get (self->config, "runtime/poll_timeout", "30000"));
+            self->runtime = runtime_new (self->http_worker, timeout, poll_timeout);
+            ztimerset_add (self->timerset, 1000, (ztimerset_fn *) s_runtime_expire_interval, self);
+        }
+
+        actor_type = actor_type_new (name, (actor_type_invoke_fn *) runtime_invoke, self->runtime);
+    }
+    else if (streq (backend, "native")) {
+        if (library == NULL) {
+            zsys_error ("Server: native actor type %s has no library", name);
+            return NULL;
+        }
+
+        // Native actors run in process on the worker pool instead of lambda
+        if (!self->native) {
+            int workers = atoi (zconfig_get (self->config, "native/workers", "4"));
+            self->native = native_new (workers);
+            zpoller_add (self->poller, native_get_socket (self->native));
+        }
+
+        if (native_load (self->native, name, library) != 0) {
+            zsys_error ("Server: can't load the native actor type %s", name);
+            return NULL;
+        }
+
+        actor_type = actor_type_new (name, (actor_type_invoke_fn *) native_invoke, self->native);
+    }
+    else {
+        actor_type = actor_type_new (name, (actor_type_invoke_fn *) aws_invoke_lambda, self->aws);
+
+        path = zsys_sprintf ("actors/%s/endpoints", name);
+        char *endpoints = zconfig_get (self->config, path, NULL);
+        zstr_free (&path);
+
+        // A bad restriction leaves the function on all the endpoints
+        if (endpoints && aws_set_endpoints (self->aws, name, endpoints) == -1)
+            zsys_warning ("Server: ignoring the endpoints of %s", name);
+    }
+
+    path = zsys_sprintf ("actors/%s/timeout", name);
+    char *timeout = zconfig_get (self->config, path, NULL);
+    actor_type_set_timeout (actor_type, timeout ? atoi (timeout) : self->timeout);
+    zstr_free (&path);
+
+    const char *overflow = s_get_limit (self, name, "overflow", "reject");
+    actor_type_set_limits (actor_type,
+                           strtoull (s_get_limit (self, name, "mailbox_length", "0"), NULL, 10),
+                           strtoull (s_get_limit (self, name, "mailbox_bytes", "0"), NULL, 10),
+                           strtoull (s_get_limit (self, name, "queue_length", "0"), NULL, 10),
+                           strtoull (s_get_limit (self, name, "queue_bytes", "0"), NULL, 10),
+                           streq (overflow, "drop_oldest") ? ACTOR_TYPE_DROP_OLDEST :
+                           streq (overflow, "drop_newest") ? ACTOR_TYPE_DROP_NEWEST : ACTOR_TYPE_REJECT);
+
+    path = zsys_sprintf ("actors/%s/stateless", name);
+    actor_type_set_stateless (actor_type, atoi (zconfig_get (self->config, path, "0")) != 0);
+    zstr_free (&path);
+
+    path = zsys_sprintf ("actors/%s/parallelism", name);
+    int parallelism = atoi (zconfig_get (self->config, path, "1"));
+    zstr_free (&path);
+    if (parallelism < 1) {
+        zsys_warning ("Server: parallelism of %s must be at least 1, using 1", name);
+        parallelism = 1;
+    }
+    actor_type_set_parallelism (actor_type, parallelism);
+
+    path = zsys_sprintf ("actors/%s/dequeue", name);
+    actor_type_set_weighted (actor_type, streq (zconfig_get (self->config, path, "strict"), "weighted"));
+    zstr_free (&path);
+
+    path = zsys_sprintf ("actors/%s/priorities", name);
+    zconfig_t *priorities = zconfig_locate (self->config, path);
+    zstr_free (&path);
+
+    for (zconfig_t *priority = priorities ? zconfig_child (priorities) : NULL; priority; priority = zconfig_next (priority)) {
+        int value = atoi (zconfig_value (priority));
+        if (value >= 0 && value < ACTOR_TYPE_PRIORITIES)
+            actor_type_set_priority (actor_type, zconfig_name (priority), value);
+        else
+            zsys_warning ("Server: priority of %s %s must be between 0 and %d, using the default",
+                          name, zconfig_name (priority), ACTOR_TYPE_PRIORITIES - 1);
+    }
+
+    s_set_access (self, actor_type, "readonly", ACTOR_TYPE_READONLY);
+    s_set_access (self, actor_type, "reentrant", ACTOR_TYPE_REENTRANT);
+
+    // Rate of the messages of http callers, of the whole type and of its subjects
+    double rate = atof (s_get_limit (self, name, "rate", "0"));
+    if (rate > 0)
+        actor_type_set_rate (actor_type, NULL, rate, atof (s_get_limit (self, name, "burst", s_get_limit (self, name, "rate", "0"))));
+
+    path = zsys_sprintf ("actors/%s/rates", name);
+    zconfig_t *rates = zconfig_locate (self->config, path);
+    zstr_free (&path);
+
+    for (zconfig_t *subject = rates ? zconfig_child (rates) : NULL; subject; subject = zconfig_next (subject)) {
+        double subject_rate = atof (zconfig_value (subject));
+        if (subject_rate > 0)
+            actor_type_set_rate (actor_type, zconfig_name (subject), subject_rate, subject_rate);
+        else
+            zsys_warning ("Server: rate of %s %s must be positive, not limited", name, zconfig_name (subject));
+    }
+
+    // Concurrency of the function adapted to its latency and throttles
+    if (atoi (s_get_limit (self, name, "adaptive", "0")) != 0) {
+        limiter_t *limiter = limiter_new (atof (s_get_limit (self, name, "concurrency_initial", "10")),
+                                          atof (s_get_limit (self, name, "concurrency_min", "1")),
+                                          atof (s_get_limit (self, name, "concurrency_max", "1000")),
+                                          atof (s_get_limit (self, name, "latency_tolerance", "2")));
+        actor_type_set_limiter (actor_type, &limiter);
+    }
+
+    // Circuit breaker of the function, opened by the error rate over the window
+    double breaker_errors = atof (s_get_limit (self, name, "breaker_errors", "0"));
+    if (breaker_errors > 0) {
+        breaker_t *breaker = breaker_new (breaker_errors,
+                                          strtoull (s_get_limit (self, name, "breaker_calls", "20"), NULL, 10),
+                                          strtoll (s_get_limit (self, name, "breaker_window", "10000"), NULL, 10),
+                                          strtoll (s_get_limit (self, name, "breaker_open", "5000"), NULL, 10));
+        actor_type_set_breaker (actor_type, &breaker, atoi (s_get_limit (self, name, "breaker_fail_fast", "0")) != 0);
+
+        if (!self->breaking) {
+            self->breaking = true;
+            ztimerset_add (self->timerset, 1000, (ztimerset_fn *) s_breakers_interval, self);
+        }
+    }
+
+    // Lambda containers kept warm ahead of the demand
+    double warm_budget = atof (s_get_limit (self, name, "warm_budget", "0"));
+    if (streq (backend, "lambda") && warm_budget > 0) {
+        warmer_t *warmer = warmer_new (strtoull (s_get_limit (self, name, "warm_min", "0"), NULL, 10), warm_budget,
+                                       strtoll (s_get_limit (self, name, "warm_keep", "300000"), NULL, 10), zclock_mono ());
+        actor_type_set_warmer (actor_type, &warmer);
+
+        if (!self->warming) {
+            self->warming = true;
+            ztimerset_add (self->timerset, 1000, (ztimerset_fn *) s_warm_interval, self);
+        }
+    }
+
+    // Replies of the cacheable subjects, with their ttl in milliseconds
+    path = zsys_sprintf ("actors/%s/cache", name);
+    zconfig_t *cache = zconfig_locate (self->config, path);
+    zstr_free (&path);
+
+    for (zconfig_t *subject = cache ? zconfig_child (cache) : NULL; subject; subject = zconfig_next (subject)) {
+        int ttl = atoi (zconfig_value (subject));
+        if (ttl > 0)
+            actor_type_set_cache_ttl (actor_type, zconfig_name (subject), ttl);
+        else
+            zsys_warning ("Server: cache ttl of %s %s must be positive, not cached", name, zconfig_name (subject));
+    }
+
+    // Milliseconds the messages of the subjects are worth invoking
+    path = zsys_sprintf ("actors/%s/ttl", name);
+    zconfig_t *ttls = zconfig_locate (self->config, path);
+    zstr_free (&path);
+
+    for (zconfig_t *subject = ttls ? zconfig_child (ttls) : NULL; subject; subject = zconfig_next (subject))
+        actor_type_set_ttl (actor_type, zconfig_name (subject), atoi (zconfig_value (subject)));
+
+    path = zsys_sprintf ("actors/%s/coalesce", name);
+    char *coalesce = strdup (zconfig_get (self->config, path, ""));
+    zstr_free (&path);
+
+    char *saveptr = NULL;
+    for (char *subject = strtok_r (coalesce, ", ", &saveptr); subject; subject = strtok_r (NULL, ", ", &saveptr))
+        actor_type_set_coalesced (actor_type, subject);
+    zstr_free (&coalesce);
+
+    zhashx_insert (self->actor_types, name, actor_type);
+
+    return actor_type;
+}
+
+static bool
+s_is_runtime (mql_server_t *self, const char *name) {
+    // Runtime actor types are all configured, so they were created on startup
+    actor_type_t *actor_type = (actor_type_t *) zhashx_lookup (self->actor_types, name);
+    return self->runtime && actor_type && actor_type_backend (actor_type) == self->runtime;
+}
+
+static mailbox_t *
+s_new_mailbox (mql_server_t *self, const char *address, actor_type_t *actor_type) {
+    if (self->interned_size == self->interned_capacity) {
+        self->interned_capacity = self->interned_capacity ? self->interned_capacity * 2 : 1024;
+        self->interned = (mailbox_t **) realloc (self->interned, self->interned_capacity * sizeof (mailbox_t *));
+        assert (self->interned);
+    }
+
+    uint32_t id = self->interned_size++;
+    mailbox_t *mailbox = mailbox_new (address, id, actor_type, self);
+    assert (mailbox);
+    self->interned[id] = mailbox;
+    zhashx_insert (self->mailboxes, address, mailbox);
+
+    return mailbox;
+}
+
 static mailbox_t *
 s_get_mailbox (mql_server_t *self, const char *address) {
     mailbox_t *mailbox = (mailbox_t *) zhashx_lookup (self->mailboxes, address);
     if (!mailbox) {
-        mailbox = mailbox_new (address, self->aws, self);
-        assert (mailbox);
-        zhashx_insert (self->mailboxes, address, mailbox);
+        // Addresses come from callers and actors, an invalid one, or one of
+        // an unknown actor type, is refused
+        const char *delimiter = strchr (address, '/');
+        if (delimiter == NULL || delimiter == address || delimiter - address > MQL_ROUTING_KEY_MAX_LEN) {
+            zsys_warning ("Server: invalid actor address %.64s", address);
+            return NULL;
+        }
+
+        char name[MQL_ROUTING_KEY_MAX_LEN + 1];
+        size_t name_len = delimiter - address;
+        memcpy (name, address, name_len);
+        name[name_len] = '\0';
+        actor_type_t *actor_type = s_get_actor_type (self, name);
+        if (actor_type == NULL)
+            return NULL;
+
+        // All the actors of a stateless type share the mailbox of the type, so
+        // the addresses aren't kept, names of types never clash with addresses
+        if (actor_type_stateless (actor_type)) {
+            mailbox = (mailbox_t *) zhashx_lookup (self->mailboxes, name);
+            if (!mailbox)
+                mailbox = s_new_mailbox (self, name, actor_type);
+        }
+        else
+            mailbox = s_new_mailbox (self, address, actor_type);
     }
 
     return mailbox;
@@ -290,7 +1864,18 @@ s_get_mailbox (mql_server_t *self, const char *address) {
 zactor_t *
 mql_server_new (zconfig_t *config)
 {
-    return zactor_new (mql_server_actor, config);
+    // Before the server thread uses jansson, the hooks stay for the process
+    arena_install_json ();
+    zactor_t *self = zactor_new (mql_server_actor, config);
+
+    char *status = zstr_recv (self);
+    bool started = status && streq (status, "STARTED");
+    zstr_free (&status);
+
+    if (!started)
+        zactor_destroy (&self);
+
+    return self;
 }
 
 
@@ -303,6 +1888,103 @@ mql_server_destroy (zactor_t **self_p)
     zactor_destroy (self_p);
 }
 
+//  --------------------------------------------------------------------------
+//  Connect the calling thread to the server
+
+zsock_t *
+mql_server_connect (zactor_t *self)
+{
+    assert (self);
+
+    zsock_t *client = zsock_new_pair (NULL);
+    assert (client);
+    int rc = zsock_bind (client, "inproc://mql-client-%p", (void *) client);
+    assert (rc == 0);
+
+    zstr_sendx (self, "CONNECT", zsock_endpoint (client), NULL);
+    if (zsock_wait (self) != 0)
+        zsock_destroy (&client);
+
+    return client;
+}
+
+//  --------------------------------------------------------------------------
+//  Disconnect the client from the server
+
+void
+mql_server_disconnect (zactor_t *self, zsock_t **client_p)
+{
+    assert (self);
+    assert (client_p);
+
+    if (*client_p) {
+        zstr_sendx (self, "DISCONNECT", zsock_endpoint (*client_p), NULL);
+        zsock_wait (self);
+        zsock_destroy (client_p);
+    }
+}
+
+//  --------------------------------------------------------------------------
+//  Send a message to an actor over the socket of the client
+
+int
+mql_server_request (zsock_t *client, const char *address, const char *subject, zhash_t *headers,
+                    zframe_t **body_p, mql_server_reply_fn *callback, void *arg)
+{
+    assert (client);
+    assert (address);
+    assert (subject);
+    assert (body_p && *body_p);
+
+    zmsg_t *msg = zmsg_new ();
+    zmsg_addstr (msg, "REQUEST");
+    zmsg_addstr (msg, address);
+    zmsg_addstr (msg, subject);
+    zmsg_addptr (msg, (void *) callback);
+    zmsg_addptr (msg, arg);
+    zframe_t *headers_frame = headers ? zhash_pack (headers) : zframe_new_empty ();
+    zmsg_append (msg, &headers_frame);
+    zmsg_append (msg, body_p);
+
+    int rc = zmsg_send (&msg, client);
+    zmsg_destroy (&msg);
+
+    return rc;
+}
+
+//  --------------------------------------------------------------------------
+//  Receive the next reply and complete its message
+
+int
+mql_server_recv_reply (zsock_t *client)
+{
+    assert (client);
+
+    zmsg_t *msg = zmsg_recv (client);
+    if (!msg)
+        return -1;
+
+    char *command = zmsg_popstr (msg);
+    mql_server_reply_fn *callback = (mql_server_reply_fn *) zmsg_popptr (msg);
+    void *arg = zmsg_popptr (msg);
+    char *status = zmsg_popstr (msg);
+    zframe_t *body = zmsg_pop (msg);
+    int status_code = -1;
+
+    if (command && streq (command, "REPLY") && status && body) {
+        status_code = atoi (status);
+        if (callback)
+            callback (status_code, &body, arg);
+    }
+
+    zstr_free (&command);
+    zstr_free (&status);
+    zframe_destroy (&body);
+    zmsg_destroy (&msg);
+
+    return status_code;
+}
+
 //  --------------------------------------------------------------------------
 //  Self test of this class
 
@@ -319,16 +2001,378 @@ mql_server_destroy (zactor_t **self_p)
 #define SELFTEST_DIR_RO "src/selftest-ro"
 #define SELFTEST_DIR_RW "src/selftest-rw"
 
+#define SELFTEST_PORT "34599"
+
+//  Long poll the next invocation of the function as a runtime worker does,
+//  return its content and its request id
+static char *
+s_test_next (zhttp_client_t *client, const char *function_name, char *request_id, size_t size) {
+    zhttp_request_t *request = zhttp_request_new ();
+    zhttp_response_t *response = zhttp_response_new ();
+
+    char *url = zsys_sprintf ("http://127.0.0.1:" SELFTEST_PORT "/runtime/%s/2018-06-01/runtime/invocation/next", function_name);
+    zhttp_request_set_url (request, url);
+    zhttp_request_set_method (request, "GET");
+    int rc = zhttp_request_send (request, client, 5000, NULL, NULL);
+    assert (rc == 0);
+
+    void *arg, *arg2;
+    rc = zhttp_response_recv (response, client, &arg, &arg2);
+    assert (rc == 0);
+    assert (zhttp_response_status_code (response) == 200);
+
+    zhash_t *headers = zhttp_response_headers (response);
+    const char *id = (const char *) zhash_lookup (headers, "Lambda-Runtime-Aws-Request-Id");
+    if (id == NULL)
+        id = (const char *) zhash_lookup (headers, "lambda-runtime-aws-request-id");
+    assert (id);
+    snprintf (request_id, size, "%s", id);
+    char *content = strdup (zhttp_response_content (response));
+
+    zstr_free (&url);
+    zhttp_request_destroy (&request);
+    zhttp_response_destroy (&response);
+
+    return content;
+}
+
+//  Complete the invocation with the content as the runtime worker
+static void
+s_test_complete (zhttp_client_t *client, const char *function_name, const char *request_id, const char *content) {
+    zhttp_request_t *request = zhttp_request_new ();
+    zhttp_response_t *response = zhttp_response_new ();
+
+    char *url = zsys_sprintf ("http://127.0.0.1:" SELFTEST_PORT "/runtime/%s/2018-06-01/runtime/invocation/%s/response",
+                              function_name, request_id);
+    zhttp_request_set_url (request, url);
+    zhttp_request_set_method (request, "POST");
+    zhttp_request_set_content_const (request, content);
+    int rc = zhttp_request_send (request, client, 5000, NULL, NULL);
+    assert (rc == 0);
+
+    void *arg, *arg2;
+    rc = zhttp_response_recv (response, client, &arg, &arg2);
+    assert (rc == 0);
+    assert (zhttp_response_status_code (response) == 202);
+
+    zstr_free (&url);
+    zhttp_request_destroy (&request);
+    zhttp_response_destroy (&response);
+}
+
+//  Get the content of the path
+static char *
+s_test_get (zhttp_client_t *client, const char *path) {
+    zhttp_request_t *request = zhttp_request_new ();
+    zhttp_response_t *response = zhttp_response_new ();
+
+    char *url = zsys_sprintf ("http://127.0.0.1:" SELFTEST_PORT "%s", path);
+    zhttp_request_set_url (request, url);
+    zhttp_request_set_method (request, "GET");
+    int rc = zhttp_request_send (request, client, 5000, NULL, NULL);
+    assert (rc == 0);
+
+    void *arg, *arg2;
+    rc = zhttp_response_recv (response, client, &arg, &arg2);
+    assert (rc == 0);
+    assert (zhttp_response_status_code (response) == 200);
+    char *content = strdup (zhttp_response_content (response));
+
+    zstr_free (&url);
+    zhttp_request_destroy (&request);
+    zhttp_response_destroy (&response);
+
+    return content;
+}
+
+//  Completion of the last reply received
+static const char *s_test_tracker;
+static int s_test_status;
+static char *s_test_body;
+
+static void
+s_test_completed (int status_code, zframe_t **body_p, void *arg) {
+    s_test_tracker = (const char *) arg;
+    s_test_status = status_code;
+    s_test_body = zframe_strdup (*body_p);
+}
+
+//  Send the message over the socket of the client, the tracker is the arg
+//  of its completion
+static void
+s_test_request (zsock_t *caller, const char *address, const char *subject, const char *tracker,
+                zhash_t *headers, const char *body) {
+    zframe_t *frame = zframe_new (body, strlen (body));
+    int rc = mql_server_request (caller, address, subject, headers, &frame, s_test_completed, (void *) tracker);
+    assert (rc == 0);
+    assert (frame == NULL);
+}
+
+//  Receive the next reply, check its tracker and status code, return its body
+static char *
+s_test_reply (zsock_t *caller, const char *tracker, int status_code) {
+    int rc = mql_server_recv_reply (caller);
+    assert (rc == status_code);
+    assert (s_test_status == status_code);
+    assert (streq (s_test_tracker, tracker));
+
+    char *content = s_test_body;
+    s_test_body = NULL;
+
+    return content;
+}
+
 void
 mql_server_test (bool verbose)
 {
     printf (" * mql_server: ");
 
     //  @selftest
-    //  Simple create/destroy test
-//    mql_server_t *self = mql_server_new ();
-//    assert (self);
-//    mql_server_destroy (&self);
+    //  Actors served by the runtime backend, the test is their worker
+    zconfig_t *config = zconfig_new ("root", NULL);
+    zconfig_put (config, "server/port", SELFTEST_PORT);
+    zconfig_put (config, "server/max_body", "64");
+    zconfig_put (config, "server/tenant_rate", "1");
+    zconfig_put (config, "server/implicit_types", "0");
+    zconfig_put (config, "aws/region", "us-east-1");
+    zconfig_put (config, "aws/access_key", "AKIDEXAMPLE");
+    zconfig_put (config, "aws/secret", "wJalrXUtnFEMI/K7MDENG+bPxRfiCYEXAMPLEKEY");
+    zconfig_put (config, "actors/echo/backend", "runtime");
+    zconfig_put (config, "actors/full/backend", "runtime");
+    zconfig_put (config, "actors/full/mailbox_length", "1");
+    zconfig_put (config, "actors/limited/backend", "runtime");
+    zconfig_put (config, "actors/limited/rates/ping", "1");
+    zconfig_put (config, "actors/sensor/backend", "runtime");
+    zconfig_put (config, "actors/sensor/ttl/tick", "1");
+    zconfig_put (config, "actors/tracker/backend", "runtime");
+    zconfig_put (config, "actors/tracker/coalesce", "position");
+    zconfig_put (config, "actors/tracker/mailbox_bytes", "20");
+
+    zactor_t *server = mql_server_new (config);
+    assert (server);
+    zsock_t *caller = mql_server_connect (server);
+    assert (caller);
+    zsock_set_rcvtimeo (caller, 5000);
+
+    zhttp_client_t *client = zhttp_client_new (verbose);
+    char request_id[32];
+    char other_id[32];
+    char *content;
+
+    //  Refused before they are queued
+    s_test_request (caller, "echo", "hello", "no type", NULL, "{}");
+    content = s_test_reply (caller, "no type", 400);
+    zstr_free (&content);
+
+    s_test_request (caller, "echo/1", "hello", "invalid", NULL, "{\"n\":");
+    content = s_test_reply (caller, "invalid", 400);
+    zstr_free (&content);
+
+    s_test_request (caller, "echo/1", "hello", "too large", NULL,
+                    "\"0123456789012345678901234567890123456789012345678901234567890123456789\"");
+    content = s_test_reply (caller, "too large", 413);
+    assert (strstr (content, "body too large"));
+    zstr_free (&content);
+
+    //  Replies come back in the order they complete, matched by their tracker
+    s_test_request (caller, "echo/1", "hello", "first", NULL, "{\"n\":1}");
+    s_test_request (caller, "echo/2", "hello", "second", NULL, "{\"n\":2}");
+
+    content = s_test_next (client, "echo", request_id, sizeof (request_id));
+    assert (strstr (content, "\"address\":\"echo/1\""));
+    assert (strstr (content, "\"n\":1"));
+    zstr_free (&content);
+    content = s_test_next (client, "echo", other_id, sizeof (other_id));
+    assert (strstr (content, "\"address\":\"echo/2\""));
+    zstr_free (&content);
+
+    s_test_complete (client, "echo", other_id, "{\"subject\":\"echoed\",\"body\":2}");
+    content = s_test_reply (caller, "second", 200);
+    assert (strstr (content, "\"from\":\"echo/2\""));
+    assert (strstr (content, "\"subject\":\"echoed\""));
+    zstr_free (&content);
+
+    s_test_complete (client, "echo", request_id, "{\"subject\":\"echoed\",\"body\":1}");
+    content = s_test_reply (caller, "first", 200);
+    assert (strstr (content, "\"from\":\"echo/1\""));
+    zstr_free (&content);
+
+    //  The retry of a message with an idempotency key waits for its reply
+    zhash_t *headers = zhash_new ();
+    zhash_insert (headers, "Idempotency-Key", "once");
+    s_test_request (caller, "echo/3", "hello", "original", headers, "{}");
+    s_test_request (caller, "echo/3", "hello", "retry", headers, "{}");
+    zhash_destroy (&headers);
+
+    content = s_test_next (client, "echo", request_id, sizeof (request_id));
+    zstr_free (&content);
+    s_test_complete (client, "echo", request_id, "{\"subject\":\"done\"}");
+
+    char *first = s_test_reply (caller, "retry", 200);
+    char *second = s_test_reply (caller, "original", 200);
+    assert (streq (first, second));
+    zstr_free (&first);
+    zstr_free (&second);
+
+    //  A caller which timed out and retries gets the reply of the first run,
+    //  the message runs once
+    headers = zhash_new ();
+    zhash_insert (headers, "Idempotency-Key", "slow");
+    zhash_insert (headers, "X-Mql-Timeout", "50");
+    s_test_request (caller, "echo/4", "hello", "impatient", headers, "{}");
+    content = s_test_next (client, "echo", request_id, sizeof (request_id));
+    zstr_free (&content);
+    content = s_test_reply (caller, "impatient", 504);
+    assert (strstr (content, "Timeout"));
+    zstr_free (&content);
+
+    zhash_delete (headers, "X-Mql-Timeout");
+    s_test_request (caller, "echo/4", "hello", "retried", headers, "{}");
+    zhash_destroy (&headers);
+    s_test_request (caller, "echo/4", "after", "after", NULL, "{}");
+
+    s_test_complete (client, "echo", request_id, "{\"subject\":\"done\",\"body\":4}");
+    content = s_test_reply (caller, "retried", 200);
+    assert (strstr (content, "\"subject\":\"done\""));
+    zstr_free (&content);
+
+    content = s_test_next (client, "echo", request_id, sizeof (request_id));
+    assert (strstr (content, "\"subject\":\"after\""));
+    zstr_free (&content);
+    s_test_complete (client, "echo", request_id, "{\"subject\":\"done\"}");
+    content = s_test_reply (caller, "after", 200);
+    zstr_free (&content);
+
+    //  Rate limits of the subject and of the tenant, then the mailbox quota
+    s_test_request (caller, "limited/1", "ping", "ping", NULL, "{}");
+    s_test_request (caller, "limited/1", "ping", "limited", NULL, "{}");
+    content = s_test_reply (caller, "limited", 429);
+    zstr_free (&content);
+
+    headers = zhash_new ();
+    zhash_insert (headers, "X-Mql-Tenant", "acme");
+    s_test_request (caller, "full/1", "hello", "tenant", headers, "{}");
+    s_test_request (caller, "full/1", "hello", "tenant limited", headers, "{}");
+    zhash_destroy (&headers);
+    content = s_test_reply (caller, "tenant limited", 429);
+    zstr_free (&content);
+
+    //  Without room for more actor types, only the configured ones are known
+    s_test_request (caller, "unknown/1", "hello", "unknown", NULL, "{}");
+    content = s_test_reply (caller, "unknown", 400);
+    zstr_free (&content);
+
+    //  One message runs, one waits, the next doesn't fit
+    s_test_request (caller, "full/1", "hello", "queued", NULL, "{}");
+    s_test_request (caller, "full/1", "hello", "full", NULL, "{}");
+    content = s_test_reply (caller, "full", 429);
+    zstr_free (&content);
+
+    //  A message waiting past the ttl of its subject expires instead of running
+    s_test_request (caller, "sensor/1", "busy", "busy", NULL, "{}");
+    s_test_request (caller, "sensor/1", "tick", "tick", NULL, "{}");
+    zclock_sleep (10);
+    content = s_test_next (client, "sensor", request_id, sizeof (request_id));
+    assert (strstr (content, "\"subject\":\"busy\""));
+    zstr_free (&content);
+    s_test_complete (client, "sensor", request_id, "{\"subject\":\"done\"}");
+    content = s_test_reply (caller, "busy", 200);
+    zstr_free (&content);
+    content = s_test_reply (caller, "tick", 504);
+    assert (strstr (content, "Expired"));
+    zstr_free (&content);
+
+    //  The ttl header of the caller wins over the ttl of the subject
+    headers = zhash_new ();
+    zhash_insert (headers, "X-Mql-Ttl", "0");
+    s_test_request (caller, "sensor/1", "busy", "busy", NULL, "{}");
+    s_test_request (caller, "sensor/1", "tick", "tick forever", headers, "{}");
+    zhash_update (headers, "X-Mql-Ttl", "1");
+    s_test_request (caller, "sensor/1", "read", "read", headers, "{}");
+    zhash_destroy (&headers);
+    zclock_sleep (10);
+
+    content = s_test_next (client, "sensor", request_id, sizeof (request_id));
+    zstr_free (&content);
+    s_test_complete (client, "sensor", request_id, "{\"subject\":\"done\"}");
+    content = s_test_reply (caller, "busy", 200);
+    zstr_free (&content);
+
+    content = s_test_next (client, "sensor", request_id, sizeof (request_id));
+    assert (strstr (content, "\"subject\":\"tick\""));
+    zstr_free (&content);
+    s_test_complete (client, "sensor", request_id, "{\"subject\":\"done\"}");
+    content = s_test_reply (caller, "tick forever", 200);
+    zstr_free (&content);
+    content = s_test_reply (caller, "read", 504);
+    zstr_free (&content);
+
+    //  So does the ttl of the envelope of a message sent by an actor
+    s_test_request (caller, "sensor/1", "busy", "busy", NULL, "{}");
+    content = s_test_next (client, "sensor", request_id, sizeof (request_id));
+    zstr_free (&content);
+
+    s_test_request (caller, "echo/9", "relay", "relay", NULL, "{}");
+    content = s_test_next (client, "echo", other_id, sizeof (other_id));
+    zstr_free (&content);
+    s_test_complete (client, "echo", other_id,
+                     "{\"send\":[{\"to\":\"sensor/1\",\"subject\":\"read\",\"ttl\":1,\"body\":{}},"
+                     "{\"to\":\"sensor/1\",\"subject\":\"tick\",\"ttl\":0,\"body\":{\"late\":true}}],"
+                     "\"subject\":\"relayed\"}");
+    content = s_test_reply (caller, "relay", 200);
+    zstr_free (&content);
+    zclock_sleep (10);
+
+    s_test_complete (client, "sensor", request_id, "{\"subject\":\"done\"}");
+    content = s_test_reply (caller, "busy", 200);
+    zstr_free (&content);
+    content = s_test_next (client, "sensor", request_id, sizeof (request_id));
+    assert (strstr (content, "\"subject\":\"tick\""));
+    assert (strstr (content, "\"late\":true"));
+    zstr_free (&content);
+    s_test_complete (client, "sensor", request_id, "{}");
+
+    content = s_test_get (client, "/admin/functions");
+    assert (strstr (content, "\"sensor\":{\"expired\":3}"));
+    zstr_free (&content);
+
+    //  The latest pending message of a coalesced subject takes the place of
+    //  the previous one, as long as it fits
+    s_test_request (caller, "tracker/1", "busy", "busy", NULL, "{}");
+    content = s_test_next (client, "tracker", request_id, sizeof (request_id));
+    zstr_free (&content);
+
+    s_test_request (caller, "tracker/1", "position", "position 1", NULL, "{\"x\":1}");
+    s_test_request (caller, "tracker/1", "position", "position 2", NULL, "{\"x\":2}");
+    content = s_test_reply (caller, "position 1", 409);
+    assert (strstr (content, "Superseded"));
+    zstr_free (&content);
+
+    s_test_request (caller, "echo/9", "relay", "relay", NULL, "{}");
+    content = s_test_next (client, "echo", other_id, sizeof (other_id));
+    zstr_free (&content);
+    s_test_complete (client, "echo", other_id,
+                     "{\"send\":{\"to\":\"tracker/1\",\"subject\":\"position\","
+                     "\"body\":{\"x\":\"0123456789abcdef\"}},\"subject\":\"relayed\"}");
+    content = s_test_reply (caller, "relay", 200);
+    zstr_free (&content);
+
+    s_test_complete (client, "tracker", request_id, "{\"subject\":\"done\"}");
+    content = s_test_reply (caller, "busy", 200);
+    zstr_free (&content);
+    content = s_test_next (client, "tracker", request_id, sizeof (request_id));
+    assert (strstr (content, "\"x\":2"));
+    zstr_free (&content);
+    s_test_complete (client, "tracker", request_id, "{\"subject\":\"moved\"}");
+    content = s_test_reply (caller, "position 2", 200);
+    zstr_free (&content);
+
+    zhttp_client_destroy (&client);
+    mql_server_disconnect (server, &caller);
+    assert (caller == NULL);
+    mql_server_destroy (&server);
+    zconfig_destroy (&config);
     //  @end
+
     printf ("OK\n");
 }
@@ -49,7 +49,7 @@ int main (int argc, char **argv) {
             puts ("     --aws-access-key <access-key>\tSet aws access key");
             puts ("     --aws-secret <secret>\t\tSet aws secret");
             puts ("     --aws-region <region>\t\tSet aws region");
-            puts ("     --aws-local <local-endpoint>\t\tConnect to local lambda server");
+            puts ("     --aws-local <local-endpoint>\t\tConnect to local lambda server, a comma separated list routes between them");
             puts (" -h, --help\t\t\t\tThis help text");
             puts (" Default config-file is 'mqless.cfg'");
 
@@ -87,6 +87,12 @@ int main (int argc, char **argv) {
         zconfig_put (config, "server/port", port);
 
     zactor_t *server = mql_server_new (config);
+    if (server == NULL) {
+        puts ("Error: fail to start the server");
+        zargs_destroy (&args);
+        zconfig_destroy (&config);
+        return 1;
+    }
 
     while (true) {
         char *message = zstr_recv (server);
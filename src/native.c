@@ -0,0 +1,306 @@
+#include "mql_classes.h"
+#include <dlfcn.h>
+
+typedef struct {
+    aws_lambda_callback_fn *callback;
+    void *arg;
+    mql_actor_handler_fn *handler;
+    char *content;
+} native_job_t;
+
+struct _native_t {
+    zsock_t *router;
+    char endpoint[64];
+    zlistx_t *workers;
+    zlistx_t *idle;             //  Routing ids of the workers waiting for a job
+    zlistx_t *jobs;             //  Jobs waiting for an idle worker
+    zhashx_t *handlers;
+    zlistx_t *libraries;
+    zhttp_response_t *response;
+};
+
+static void
+native_job_destroy (native_job_t **self_p) {
+    native_job_t *self = *self_p;
+    zstr_free (&self->content);
+
+    free (self);
+    *self_p = NULL;
+}
+
+static void
+native_library_destroy (void **handle_p) {
+    dlclose (*handle_p);
+    *handle_p = NULL;
+}
+
+//  Worker thread, asks for a job by sending the result of the previous one.
+//  The first message, with a NULL callback, only signals the worker is ready.
+
+static void
+native_worker_actor (zsock_t *pipe, void *arg) {
+    native_t *self = (native_t *) arg;
+
+    zsock_t *dealer = zsock_new_dealer (self->endpoint);
+    assert (dealer);
+    zpoller_t *poller = zpoller_new (pipe, dealer, NULL);
+
+    zsock_signal (pipe, 0);
+    zsock_send (dealer, "ppis", NULL, NULL, 0, "");
+
+    while (true) {
+        void *which = zpoller_wait (poller, -1);
+
+        if (which == dealer) {
+            void *callback;
+            void *callback_arg;
+            void *handler;
+            char *content;
+
+            if (zsock_recv (dealer, "ppps", &callback, &callback_arg, &handler, &content) == -1)
+                break;
+
+            char *response = ((mql_actor_handler_fn *) handler) (content);
+            zstr_free (&content);
+
+            zsock_send (dealer, "ppis", callback, callback_arg, response ? 200 : 500,
+                        response ? response : "{\"errorMessage\": \"native actor failed\"}");
+            free (response);
+        }
+        else
+        if (which == pipe) {
+            char *command = zstr_recv (pipe);
+            bool terminated = command == NULL || streq (command, "$TERM");
+            zstr_free (&command);
+
+            if (terminated)
+                break;
+        }
+        else
+            break;
+    }
+
+    zpoller_destroy (&poller);
+    zsock_destroy (&dealer);
+}
+
+native_t *native_new (int workers) {
+    assert (workers > 0);
+
+    native_t *self = (native_t *) zmalloc (sizeof (native_t));
+    assert (self);
+
+    snprintf (self->endpoint, sizeof (self->endpoint), "inproc://mql-native-%p", (void *) self);
+
+    char bind_endpoint[sizeof (self->endpoint) + 1];
+    snprintf (bind_endpoint, sizeof (bind_endpoint), "@%s", self->endpoint);
+    self->router = zsock_new_router (bind_endpoint);
+    assert (self->router);
+
+    self->idle = zlistx_new ();
+    zlistx_set_destructor (self->idle, (zlistx_destructor_fn *) zframe_destroy);
+    self->jobs = zlistx_new ();
+    zlistx_set_destructor (self->jobs, (zlistx_destructor_fn *) native_job_destroy);
+    self->handlers = zhashx_new ();
+    self->libraries = zlistx_new ();
+    zlistx_set_destructor (self->libraries, native_library_destroy);
+    self->response = zhttp_response_new ();
+
+    self->workers = zlistx_new ();
+    zlistx_set_destructor (self->workers, (zlistx_destructor_fn *) zactor_destroy);
+    for (int i = 0; i < workers; i++)
+        zlistx_add_end (self->workers, zactor_new (native_worker_actor, self));
+
+    return self;
+}
+
+void native_destroy (native_t **self_p) {
+    assert (self_p);
+    native_t *self = *self_p;
+
+    if (self) {
+        //  Workers must be gone before the libraries are unloaded
+        zlistx_destroy (&self->workers);
+        zlistx_destroy (&self->idle);
+        zlistx_destroy (&self->jobs);
+        zhashx_destroy (&self->handlers);
+        zlistx_destroy (&self->libraries);
+        zhttp_response_destroy (&self->response);
+        zsock_destroy (&self->router);
+
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+int native_load (native_t *self, const char *function_name, const char *path) {
+    assert (self);
+
+    void *library = dlopen (path, RTLD_NOW | RTLD_LOCAL);
+    if (library == NULL) {
+        zsys_error ("Native: fail to load %s: %s", path, dlerror ());
+        return -1;
+    }
+
+    mql_actor_handler_fn *handler = (mql_actor_handler_fn *) dlsym (library, MQL_ACTOR_HANDLER);
+    if (handler == NULL) {
+        zsys_error ("Native: %s doesn't export %s", path, MQL_ACTOR_HANDLER);
+        dlclose (library);
+        return -1;
+    }
+
+    zlistx_add_end (self->libraries, library);
+    native_register (self, function_name, handler);
+
+    zsys_info ("Native: loaded %s from %s", function_name, path);
+
+    return 0;
+}
+
+void native_register (native_t *self, const char *function_name, mql_actor_handler_fn *handler) {
+    assert (self);
+    assert (handler);
+
+    zhashx_update (self->handlers, function_name, (void *) handler);
+}
+
+static void
+native_send_job (native_t *self, zframe_t *worker, native_job_t *job) {
+    zsock_send (self->router, "fppps", worker, (void *) job->callback, job->arg, (void *) job->handler, job->content);
+    zframe_destroy (&worker);
+    native_job_destroy (&job);
+}
+
+int native_invoke (
+        native_t *self,
+        const char *function_name,
+        char **content,
+        aws_lambda_callback_fn callback,
+        void *arg) {
+    assert (self);
+
+    mql_actor_handler_fn *handler = (mql_actor_handler_fn *) zhashx_lookup (self->handlers, function_name);
+    assert (handler);
+
+    native_job_t *job = (native_job_t *) zmalloc (sizeof (native_job_t));
+    job->callback = callback;
+    job->arg = arg;
+    job->handler = handler;
+    job->content = *content;
+    *content = NULL;
+
+    zframe_t *worker = (zframe_t *) zlistx_first (self->idle);
+    if (worker) {
+        zlistx_detach_cur (self->idle);
+        native_send_job (self, worker, job);
+    }
+    else
+        zlistx_add_end (self->jobs, job);
+
+    return 0;
+}
+
+int native_execute (native_t *self, int budget) {
+    assert (self);
+    int count = 0;
+
+    while (count < budget && zsock_has_in (self->router)) {
+        zframe_t *worker;
+        void *callback;
+        void *arg;
+        int status_code;
+        char *content;
+
+        int rc = zsock_recv (self->router, "fppis", &worker, &callback, &arg, &status_code, &content);
+        if (rc == -1)
+            return rc;
+
+        //  The worker is free again, hand it the next job
+        native_job_t *job = (native_job_t *) zlistx_first (self->jobs);
+        if (job) {
+            zlistx_detach_cur (self->jobs);
+            native_send_job (self, worker, job);
+        }
+        else
+            zlistx_add_end (self->idle, worker);
+
+        count++;
+
+        if (callback == NULL) {
+            zstr_free (&content);
+            continue;
+        }
+
+        //  Failures are reported the same way lambda reports function errors
+        zhash_t *headers = zhttp_response_headers (self->response);
+        if (status_code != 200)
+            zhash_update (headers, "X-Amz-Function-Error", "Unhandled");
+        else
+            zhash_delete (headers, "X-Amz-Function-Error");
+
+        zhttp_response_set_status_code (self->response, status_code);
+        zhttp_response_set_content (self->response, &content);
+
+        ((aws_lambda_callback_fn *) callback) (arg, self->response);
+    }
+
+    return count;
+}
+
+zsock_t *native_get_socket (native_t *self) {
+    assert (self);
+    return self->router;
+}
+
+static char *
+native_test_handler (const char *request) {
+    if (streq (request, "fail"))
+        return NULL;
+
+    return strdup (request);
+}
+
+static void
+native_test_callback (void *arg, zhttp_response_t *response) {
+    int *completed = (int *) arg;
+    zhash_t *headers = zhttp_response_headers (response);
+
+    if (zhttp_response_status_code (response) == 200) {
+        assert (streq (zhttp_response_content (response), "{\"subject\": \"hello\"}"));
+        assert (zhash_lookup (headers, "X-Amz-Function-Error") == NULL);
+    }
+    else
+        assert (zhash_lookup (headers, "X-Amz-Function-Error") != NULL);
+
+    (*completed)++;
+}
+
+void native_test (bool verbose) {
+    printf (" * native: ");
+
+    native_t *self = native_new (2);
+    assert (self);
+
+    assert (native_load (self, "missing", "libmql-missing-actor.so") == -1);
+    native_register (self, "test", native_test_handler);
+
+    //  More invocations than workers, so some must wait for an idle worker
+    int completed = 0;
+    for (int i = 0; i < 4; i++) {
+        char *content = strdup (i == 3 ? "fail" : "{\"subject\": \"hello\"}");
+        native_invoke (self, "test", &content, native_test_callback, &completed);
+        assert (content == NULL);
+    }
+
+    zpoller_t *poller = zpoller_new (native_get_socket (self), NULL);
+    while (completed < 4) {
+        void *which = zpoller_wait (poller, 5000);
+        assert (which);
+        native_execute (self, 4);
+    }
+
+    zpoller_destroy (&poller);
+    native_destroy (&self);
+
+    printf ("OK\n");
+}
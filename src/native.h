@@ -0,0 +1,26 @@
+#ifndef NATIVE_H_INCLUDED
+#define NATIVE_H_INCLUDED
+
+#include "mql_classes.h"
+
+typedef struct _native_t native_t;
+
+native_t *native_new (int workers);
+
+void native_destroy (native_t **self_p);
+
+//  Load the handler of a function from a shared library
+int native_load (native_t *self, const char *function_name, const char *path);
+
+void native_register (native_t *self, const char *function_name, mql_actor_handler_fn *handler);
+
+int native_invoke (native_t *self, const char *function_name, char **content, aws_lambda_callback_fn callback, void *arg);
+
+//  Process up to budget completed invocations, return how many were processed
+int native_execute (native_t *self, int budget);
+
+zsock_t *native_get_socket (native_t *self);
+
+void native_test (bool verbose);
+
+#endif
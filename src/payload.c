@@ -0,0 +1,273 @@
+#include "mql_classes.h"
+#include <jansson.h>
+
+struct _payload_t {
+    size_t refcount;
+    size_t size;
+    char *data;                 //  NULL while spilled
+    zframe_t *frame;            //  Frame owning the data, if taken from one
+    char *ref;                  //  Reference of the blob standing for the body, if any
+    spill_t *spill;             //  Spill file holding the data, if spilled
+    uint32_t segment;
+    uint64_t offset;
+};
+
+static payload_t *
+payload_new_owned (char *data, size_t size) {
+    payload_t *self = (payload_t *) zmalloc (sizeof (payload_t));
+    assert (self);
+
+    self->refcount = 1;
+    self->size = size;
+    self->data = data;
+
+    return self;
+}
+
+payload_t *payload_new (const char *data, size_t size) {
+    assert (data);
+
+    char *copy = (char *) malloc (size + 1);
+    assert (copy);
+    memcpy (copy, data, size);
+    copy[size] = '\0';
+
+    return payload_new_owned (copy, size);
+}
+
+payload_t *payload_new_frame (zframe_t **frame_p) {
+    assert (frame_p && *frame_p);
+
+    payload_t *self = payload_new_owned ((char *) zframe_data (*frame_p), zframe_size (*frame_p));
+    self->frame = *frame_p;
+    *frame_p = NULL;
+
+    return self;
+}
+
+//  Release the data, whoever owns it
+static void
+payload_free_data (payload_t *self) {
+    if (self->frame)
+        zframe_destroy (&self->frame);
+    else
+        free (self->data);
+    self->data = NULL;
+}
+
+payload_t *payload_new_json (json_t *json) {
+    if (json == NULL)
+        return NULL;
+
+    //  Dumped into our own buffer, jansson may allocate from an arena
+    size_t size = json_dumpb (json, NULL, 0, JSON_COMPACT | JSON_ENCODE_ANY);
+    assert (size > 0);
+    char *data = (char *) malloc (size + 1);
+    assert (data);
+    json_dumpb (json, data, size, JSON_COMPACT | JSON_ENCODE_ANY);
+    data[size] = '\0';
+
+    return payload_new_owned (data, size);
+}
+
+payload_t *payload_new_ref (const char *ref) {
+    assert (ref);
+
+    char *data = zsys_sprintf ("\"%s\"", ref);
+    payload_t *self = payload_new_owned (data, strlen (data));
+    self->ref = strdup (ref);
+
+    return self;
+}
+
+const char *payload_ref (payload_t *self) {
+    assert (self);
+    return self->ref;
+}
+
+payload_t *payload_incref (payload_t *self) {
+    if (self)
+        self->refcount++;
+    return self;
+}
+
+void payload_decref (payload_t **self_p) {
+    assert (self_p);
+    payload_t *self = *self_p;
+
+    if (self) {
+        assert (self->refcount > 0);
+        if (--self->refcount == 0) {
+            if (self->spill)
+                spill_release (self->spill, self->segment, self->size);
+            payload_free_data (self);
+            free (self->ref);
+            free (self);
+        }
+        *self_p = NULL;
+    }
+}
+
+const char *payload_data (payload_t *self) {
+    assert (self);
+
+    if (self->data == NULL && payload_load (self) != 0)
+        return NULL;
+
+    return self->data;
+}
+
+size_t payload_size (payload_t *self) {
+    assert (self);
+    return self->size;
+}
+
+int payload_spill (payload_t *self, spill_t *spill) {
+    assert (self);
+    assert (spill);
+
+    if (self->data == NULL)
+        return 0;
+
+    if (spill_write (spill, self->data, self->size, &self->segment, &self->offset) != 0)
+        return -1;
+
+    self->spill = spill;
+    payload_free_data (self);
+
+    return 0;
+}
+
+bool payload_spilled (payload_t *self) {
+    assert (self);
+    return self->data == NULL;
+}
+
+void payload_prefetch (payload_t *self) {
+    assert (self);
+
+    if (self->data == NULL)
+        spill_prefetch (self->spill, self->segment, self->offset, self->size);
+}
+
+int payload_load (payload_t *self) {
+    assert (self);
+
+    if (self->data)
+        return 0;
+
+    char *data = (char *) malloc (self->size + 1);
+    assert (data);
+    if (spill_read (self->spill, self->segment, self->offset, data, self->size) != 0) {
+        free (data);
+        return -1;
+    }
+    data[self->size] = '\0';
+
+    spill_release (self->spill, self->segment, self->size);
+    self->spill = NULL;
+    self->data = data;
+
+    return 0;
+}
+
+char *payload_wrap (payload_t *self, json_t *envelope) {
+    assert (envelope);
+
+    size_t prefix_size = json_dumpb (envelope, NULL, 0, JSON_COMPACT);
+    assert (prefix_size > 1);
+    prefix_size--;                              //  Without the closing brace
+
+    const char *body = self ? payload_data (self) : "null";
+    if (body == NULL)
+        return NULL;
+    size_t body_size = self ? self->size : 4;
+    const char *key = self && self->ref ? "\"body_ref\":" : "\"body\":";
+    size_t key_size = strlen (key);
+    bool empty = prefix_size == 1;
+
+    //  The envelope is dumped in place, the brace is overwritten
+    char *content = (char *) malloc (prefix_size + 1 + key_size + body_size + 2);
+    assert (content);
+    json_dumpb (envelope, content, prefix_size + 1, JSON_COMPACT);
+    assert (content[prefix_size] == '}');
+
+    char *cursor = content + prefix_size;
+    if (!empty)
+        *cursor++ = ',';
+    memcpy (cursor, key, key_size);
+    cursor += key_size;
+    memcpy (cursor, body, body_size);
+    cursor += body_size;
+    *cursor++ = '}';
+    *cursor = '\0';
+
+    return content;
+}
+
+void payload_test (bool verbose) {
+    printf (" * payload: ");
+
+    json_t *json = json_pack ("{si}", "n", 1);
+    payload_t *self = payload_new_json (json);
+    json_decref (json);
+    assert (streq (payload_data (self), "{\"n\":1}"));
+    assert (payload_size (self) == 7);
+    assert (payload_new_json (NULL) == NULL);
+
+    //  Shared between messages
+    payload_t *copy = payload_incref (self);
+    assert (copy == self);
+    payload_decref (&self);
+    assert (self == NULL);
+
+    json_t *envelope = json_pack ("{ss}", "subject", "hello");
+    char *content = payload_wrap (copy, envelope);
+    assert (streq (content, "{\"subject\":\"hello\",\"body\":{\"n\":1}}"));
+    zstr_free (&content);
+
+    content = payload_wrap (NULL, envelope);
+    assert (streq (content, "{\"subject\":\"hello\",\"body\":null}"));
+    zstr_free (&content);
+    json_decref (envelope);
+
+    envelope = json_object ();
+    content = payload_wrap (copy, envelope);
+    assert (streq (content, "{\"body\":{\"n\":1}}"));
+    zstr_free (&content);
+    json_decref (envelope);
+
+    payload_decref (&copy);
+
+    //  A reference to a blob instead of the body
+    payload_t *ref = payload_new_ref ("sha256:00");
+    assert (streq (payload_ref (ref), "sha256:00"));
+    envelope = json_pack ("{ss}", "subject", "hello");
+    content = payload_wrap (ref, envelope);
+    assert (streq (content, "{\"subject\":\"hello\",\"body_ref\":\"sha256:00\"}"));
+    zstr_free (&content);
+    json_decref (envelope);
+    payload_decref (&ref);
+
+    //  Any json value can be a body
+    self = payload_new ("\"text\"", 6);
+    assert (streq (payload_data (self), "\"text\""));
+    assert (payload_ref (self) == NULL);
+    payload_decref (&self);
+
+    //  The data of a frame is taken as is
+    zframe_t *frame = zframe_new ("[1,2]", 5);
+    const char *data = (const char *) zframe_data (frame);
+    self = payload_new_frame (&frame);
+    assert (frame == NULL);
+    assert (payload_data (self) == data);
+    assert (payload_size (self) == 5);
+    envelope = json_object ();
+    content = payload_wrap (self, envelope);
+    assert (streq (content, "{\"body\":[1,2]}"));
+    zstr_free (&content);
+    json_decref (envelope);
+    payload_decref (&self);
+
+    printf ("OK\n");
+}
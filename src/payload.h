@@ -0,0 +1,56 @@
+#ifndef PAYLOAD_H_INCLUDED
+#define PAYLOAD_H_INCLUDED
+
+#include "mql_classes.h"
+
+typedef struct _payload_t payload_t;
+
+//  Serialized json body of a message. A payload is immutable and reference
+//  counted, so a message sent to many actors is serialized only once.
+
+payload_t *payload_new (const char *data, size_t size);
+
+//  Take the frame, its data is used as is, without a terminator
+payload_t *payload_new_frame (zframe_t **frame_p);
+
+//  Serialize the json, return NULL if json is NULL
+payload_t *payload_new_json (json_t *json);
+
+//  Payload standing for the blob of the reference, wrapped as body_ref
+payload_t *payload_new_ref (const char *ref);
+
+//  Return the reference of the blob, NULL if the payload is the body itself
+const char *payload_ref (payload_t *self);
+
+//  Take another reference of the payload, if not NULL
+payload_t *payload_incref (payload_t *self);
+
+//  Release the reference, the last one destroys the payload
+void payload_decref (payload_t **self_p);
+
+//  Return the data, read back first if spilled, NULL if it can't be read.
+//  The data is terminated, except for the data of a frame
+const char *payload_data (payload_t *self);
+
+size_t payload_size (payload_t *self);
+
+//  Move the data to the spill file until it is needed again, return -1 if
+//  it can't be written, the data is then kept in memory
+int payload_spill (payload_t *self, spill_t *spill);
+
+bool payload_spilled (payload_t *self);
+
+//  Hint the data of a spilled payload will be needed soon
+void payload_prefetch (payload_t *self);
+
+//  Read the data back in memory, return -1 if it can't be read
+int payload_load (payload_t *self);
+
+//  Serialize the envelope object with the payload as its body member, a
+//  NULL payload is a null body, a reference is a body_ref member. Return
+//  NULL if the data of the payload can't be read back
+char *payload_wrap (payload_t *self, json_t *envelope);
+
+void payload_test (bool verbose);
+
+#endif
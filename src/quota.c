@@ -0,0 +1,92 @@
+#include "mql_classes.h"
+
+struct _quota_t {
+    size_t max_length;
+    size_t max_bytes;
+    size_t length;
+    size_t bytes;
+};
+
+quota_t *quota_new (size_t max_length, size_t max_bytes) {
+    quota_t *self = (quota_t *) zmalloc (sizeof (quota_t));
+    assert (self);
+
+    self->max_length = max_length;
+    self->max_bytes = max_bytes;
+
+    return self;
+}
+
+void quota_destroy (quota_t **self_p) {
+    assert (self_p);
+    quota_t *self = *self_p;
+
+    if (self) {
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+bool quota_fits (quota_t *self, size_t bytes) {
+    assert (self);
+
+    if (self->max_length && self->length + 1 > self->max_length)
+        return false;
+
+    if (self->max_bytes && self->bytes + bytes > self->max_bytes)
+        return false;
+
+    return true;
+}
+
+void quota_add (quota_t *self, size_t bytes) {
+    assert (self);
+    self->length++;
+    self->bytes += bytes;
+}
+
+void quota_remove (quota_t *self, size_t bytes) {
+    assert (self);
+    assert (self->length > 0 && self->bytes >= bytes);
+    self->length--;
+    self->bytes -= bytes;
+}
+
+size_t quota_length (quota_t *self) {
+    assert (self);
+    return self->length;
+}
+
+size_t quota_bytes (quota_t *self) {
+    assert (self);
+    return self->bytes;
+}
+
+void quota_test (bool verbose) {
+    printf (" * quota: ");
+
+    quota_t *self = quota_new (2, 100);
+    assert (quota_fits (self, 100));
+    assert (!quota_fits (self, 101));
+
+    quota_add (self, 60);
+    assert (quota_fits (self, 40));
+    assert (!quota_fits (self, 41));
+
+    quota_add (self, 10);
+    assert (!quota_fits (self, 0));
+    assert (quota_length (self) == 2 && quota_bytes (self) == 70);
+
+    quota_remove (self, 60);
+    assert (quota_fits (self, 90));
+    quota_destroy (&self);
+
+    //  Unlimited
+    self = quota_new (0, 0);
+    for (int i = 0; i < 1000; i++)
+        quota_add (self, 1000000);
+    assert (quota_fits (self, SIZE_MAX / 2));
+    quota_destroy (&self);
+
+    printf ("OK\n");
+}
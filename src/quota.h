@@ -0,0 +1,27 @@
+#ifndef QUOTA_H_INCLUDED
+#define QUOTA_H_INCLUDED
+
+#include "mql_classes.h"
+
+typedef struct _quota_t quota_t;
+
+//  Limits of a queue in messages and bytes, a zero limit is unlimited
+
+quota_t *quota_new (size_t max_length, size_t max_bytes);
+
+void quota_destroy (quota_t **self_p);
+
+//  Return true if a message of the size fits within the limits
+bool quota_fits (quota_t *self, size_t bytes);
+
+void quota_add (quota_t *self, size_t bytes);
+
+void quota_remove (quota_t *self, size_t bytes);
+
+size_t quota_length (quota_t *self);
+
+size_t quota_bytes (quota_t *self);
+
+void quota_test (bool verbose);
+
+#endif
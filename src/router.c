@@ -0,0 +1,245 @@
+#include "mql_classes.h"
+#include <jansson.h>
+
+//  Completions before an endpoint can be ejected, and error rate ejecting it
+#define ROUTER_MIN_SAMPLES 5
+#define ROUTER_EJECT_ERRORS 0.5
+#define ROUTER_EJECT_TIME 10000
+#define ROUTER_EJECT_MAX 300000
+
+typedef struct {
+    char *name;
+    double latency;             //  Moving average in milliseconds
+    double errors;              //  Moving average of the failed invocations
+    size_t samples;
+    size_t inflight;
+    int64_t ejected_until;      //  Zero when not ejected
+    int64_t eject_time;         //  Time of the next ejection, doubled on each failed probe
+    bool probing;               //  The probe of an ejected endpoint is in flight
+} router_endpoint_t;
+
+struct _router_t {
+    router_endpoint_t endpoints[ROUTER_MAX_ENDPOINTS];
+    size_t size;
+};
+
+router_t *router_new (void) {
+    router_t *self = (router_t *) zmalloc (sizeof (router_t));
+    assert (self);
+    return self;
+}
+
+void router_destroy (router_t **self_p) {
+    assert (self_p);
+    router_t *self = *self_p;
+
+    if (self) {
+        for (size_t index = 0; index < self->size; index++)
+            zstr_free (&self->endpoints[index].name);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+int router_add (router_t *self, const char *name) {
+    assert (self);
+    assert (name);
+    assert (self->size < ROUTER_MAX_ENDPOINTS);
+
+    router_endpoint_t *endpoint = &self->endpoints[self->size];
+    endpoint->name = strdup (name);
+    endpoint->eject_time = ROUTER_EJECT_TIME;
+
+    return (int) self->size++;
+}
+
+int router_lookup (router_t *self, const char *name) {
+    assert (self);
+
+    for (size_t index = 0; index < self->size; index++)
+        if (streq (self->endpoints[index].name, name))
+            return (int) index;
+
+    return -1;
+}
+
+size_t router_size (router_t *self) {
+    assert (self);
+    return self->size;
+}
+
+bool router_ejected (router_t *self, int index, int64_t now) {
+    assert (self);
+    assert (index >= 0 && (size_t) index < self->size);
+
+    router_endpoint_t *endpoint = &self->endpoints[index];
+    return endpoint->ejected_until != 0 && (endpoint->probing || now < endpoint->ejected_until);
+}
+
+//  Expected latency of one more invocation, lower is better
+static double
+router_score (router_endpoint_t *endpoint) {
+    return (endpoint->latency + 1) * (1 + 4 * endpoint->errors) * (endpoint->inflight + 1);
+}
+
+int router_pick (router_t *self, uint32_t set, int64_t now) {
+    assert (self);
+
+    int best = -1;
+    int fallback = -1;
+
+    for (size_t index = 0; index < self->size; index++) {
+        if ((set & ((uint32_t) 1 << index)) == 0)
+            continue;
+
+        router_endpoint_t *endpoint = &self->endpoints[index];
+
+        //  An ejected endpoint past its time gets a single probe first
+        if (endpoint->ejected_until != 0 && !endpoint->probing && now >= endpoint->ejected_until) {
+            endpoint->probing = true;
+            endpoint->inflight++;
+            return (int) index;
+        }
+
+        int *candidate = router_ejected (self, (int) index, now) ? &fallback : &best;
+        if (*candidate == -1 || router_score (endpoint) < router_score (&self->endpoints[*candidate]))
+            *candidate = (int) index;
+    }
+
+    if (best == -1)
+        best = fallback;
+    if (best != -1)
+        self->endpoints[best].inflight++;
+
+    return best;
+}
+
+void router_completed (router_t *self, int index, int64_t latency, bool failed, int64_t now) {
+    assert (self);
+    assert (index >= 0 && (size_t) index < self->size);
+
+    router_endpoint_t *endpoint = &self->endpoints[index];
+    assert (endpoint->inflight > 0);
+    endpoint->inflight--;
+
+    if (endpoint->samples++ == 0)
+        endpoint->latency = latency;
+    else
+    if (!failed)
+        endpoint->latency = endpoint->latency * 0.9 + latency * 0.1;
+    endpoint->errors = endpoint->errors * 0.9 + (failed ? 0.1 : 0);
+
+    if (endpoint->ejected_until != 0) {
+        if (!endpoint->probing)
+            return;
+
+        //  The probe decides, a failed one ejects the endpoint for longer
+        endpoint->probing = false;
+        if (failed) {
+            endpoint->eject_time = endpoint->eject_time * 2 < ROUTER_EJECT_MAX ? endpoint->eject_time * 2 : ROUTER_EJECT_MAX;
+            endpoint->ejected_until = now + endpoint->eject_time;
+        }
+        else {
+            endpoint->ejected_until = 0;
+            endpoint->eject_time = ROUTER_EJECT_TIME;
+            endpoint->errors = 0;
+        }
+    }
+    else
+    if (endpoint->samples >= ROUTER_MIN_SAMPLES && endpoint->errors > ROUTER_EJECT_ERRORS) {
+        zsys_warning ("Router: ejecting endpoint %s", endpoint->name);
+        endpoint->ejected_until = now + endpoint->eject_time;
+    }
+}
+
+json_t *router_status (router_t *self, int64_t now) {
+    assert (self);
+
+    json_t *status = json_object ();
+    for (size_t index = 0; index < self->size; index++) {
+        router_endpoint_t *endpoint = &self->endpoints[index];
+        json_object_set_new (status, endpoint->name, json_pack ("{sfsfsisb}",
+                             "latency", endpoint->latency,
+                             "errors", endpoint->errors,
+                             "inflight", (int) endpoint->inflight,
+                             "ejected", router_ejected (self, (int) index, now)));
+    }
+
+    return status;
+}
+
+void router_test (bool verbose) {
+    printf (" * router: ");
+
+    int64_t now = 1000;
+    router_t *self = router_new ();
+    int near = router_add (self, "http://near");
+    int far = router_add (self, "http://far");
+    assert (router_size (self) == 2);
+    assert (router_lookup (self, "http://far") == far);
+    assert (router_lookup (self, "http://none") == -1);
+
+    //  Both are tried, then the faster one is preferred
+    int first = router_pick (self, ROUTER_ALL, now);
+    int second = router_pick (self, ROUTER_ALL, now);
+    assert (first != second);
+    router_completed (self, near, 10, false, now);
+    router_completed (self, far, 80, false, now);
+
+    for (int index = 0; index < 10; index++) {
+        int picked = router_pick (self, ROUTER_ALL, now);
+        assert (picked == near);
+        router_completed (self, picked, 10, false, now);
+    }
+
+    //  Until its invocations in flight make the other one better
+    for (int index = 0; index < 7; index++)
+        assert (router_pick (self, ROUTER_ALL, now) == near);
+    assert (router_pick (self, ROUTER_ALL, now) == far);
+    router_completed (self, far, 80, false, now);
+    for (int index = 0; index < 7; index++)
+        router_completed (self, near, 10, false, now);
+
+    //  A set restricts the choice
+    assert (router_pick (self, 1 << far, now) == far);
+    router_completed (self, far, 80, false, now);
+
+    //  A failing endpoint is ejected
+    for (int index = 0; index < 10 && !router_ejected (self, near, now); index++) {
+        assert (router_pick (self, 1 << near, now) == near);
+        router_completed (self, near, 10, true, now);
+    }
+    assert (router_ejected (self, near, now));
+    assert (router_pick (self, ROUTER_ALL, now) == far);
+    router_completed (self, far, 80, false, now);
+
+    //  Unless nothing else is left
+    assert (router_pick (self, 1 << near, now) == near);
+    router_completed (self, near, 10, true, now);
+
+    //  Probed once after the ejection, a failed probe ejects it for longer
+    now += ROUTER_EJECT_TIME;
+    assert (router_pick (self, ROUTER_ALL, now) == near);
+    assert (router_pick (self, ROUTER_ALL, now) == far);
+    router_completed (self, far, 80, false, now);
+    router_completed (self, near, 10, true, now);
+    assert (router_ejected (self, near, now + ROUTER_EJECT_TIME));
+    now += 2 * ROUTER_EJECT_TIME;
+    assert (!router_ejected (self, near, now));
+
+    //  A successful probe brings it back
+    assert (router_pick (self, ROUTER_ALL, now) == near);
+    router_completed (self, near, 10, false, now);
+    assert (!router_ejected (self, near, now));
+    assert (router_pick (self, ROUTER_ALL, now) == near);
+    router_completed (self, near, 10, false, now);
+
+    json_t *status = router_status (self, now);
+    assert (json_object_size (status) == 2);
+    json_decref (status);
+
+    router_destroy (&self);
+    assert (self == NULL);
+
+    printf ("OK\n");
+}
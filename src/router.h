@@ -0,0 +1,44 @@
+#ifndef ROUTER_H_INCLUDED
+#define ROUTER_H_INCLUDED
+
+#include "mql_classes.h"
+
+typedef struct _router_t router_t;
+
+//  Most endpoints of a router, an endpoint set is a mask of them
+#define ROUTER_MAX_ENDPOINTS 32
+#define ROUTER_ALL ((uint32_t) -1)
+
+//  Choice between endpoints serving the same functions, by their moving
+//  average latency, error rate and invocations in flight. An endpoint
+//  failing most invocations is ejected for a while, then probed with a
+//  single invocation before it gets traffic again.
+
+router_t *router_new (void);
+
+void router_destroy (router_t **self_p);
+
+//  Add an endpoint, return its index
+int router_add (router_t *self, const char *name);
+
+//  Return the index of the endpoint, -1 if unknown
+int router_lookup (router_t *self, const char *name);
+
+size_t router_size (router_t *self);
+
+//  Pick the best endpoint of the set and count an invocation in flight on
+//  it, ejected endpoints only when all of the set are
+int router_pick (router_t *self, uint32_t set, int64_t now);
+
+//  Count the completion of an invocation picked on the endpoint
+void router_completed (router_t *self, int index, int64_t latency, bool failed, int64_t now);
+
+//  Return true if the endpoint is ejected
+bool router_ejected (router_t *self, int index, int64_t now);
+
+//  Latency, error rate and state of each endpoint
+json_t *router_status (router_t *self, int64_t now);
+
+void router_test (bool verbose);
+
+#endif
@@ -0,0 +1,359 @@
+#include "mql_classes.h"
+
+#define RUNTIME_REQUEST_ID_LEN 17
+
+typedef struct {
+    char request_id[RUNTIME_REQUEST_ID_LEN];
+    char *function_name;
+    char *content;
+    int64_t deadline;
+    aws_lambda_callback_fn *callback;
+    void *arg;
+} runtime_invocation_t;
+
+typedef struct {
+    void *connection;
+    int64_t since;              //  Time the worker started polling
+} runtime_worker_t;
+
+typedef struct {
+    zlistx_t *pending;          //  Invocations waiting for a worker
+    zlistx_t *workers;          //  Workers waiting for an invocation, oldest first
+} runtime_function_t;
+
+struct _runtime_t {
+    zsock_t *http_worker;
+    zhttp_response_t *response;
+    zhttp_response_t *result;
+    zhashx_t *functions;
+    zhashx_t *invocations;      //  Invocations handed to a worker, by request id
+    uint64_t next_id;
+    int timeout;
+    int poll_timeout;           //  Milliseconds a worker is held before it polls again
+};
+
+static void
+runtime_invocation_destroy (runtime_invocation_t **self_p) {
+    runtime_invocation_t *self = *self_p;
+    zstr_free (&self->function_name);
+    zstr_free (&self->content);
+
+    free (self);
+    *self_p = NULL;
+}
+
+static void
+runtime_worker_destroy (runtime_worker_t **self_p) {
+    free (*self_p);
+    *self_p = NULL;
+}
+
+static runtime_function_t *
+runtime_function_new () {
+    runtime_function_t *self = (runtime_function_t *) zmalloc (sizeof (runtime_function_t));
+    self->pending = zlistx_new ();
+    zlistx_set_destructor (self->pending, (zlistx_destructor_fn *) runtime_invocation_destroy);
+    self->workers = zlistx_new ();
+    zlistx_set_destructor (self->workers, (zlistx_destructor_fn *) runtime_worker_destroy);
+
+    return self;
+}
+
+static void
+runtime_function_destroy (runtime_function_t **self_p) {
+    runtime_function_t *self = *self_p;
+    zlistx_destroy (&self->pending);
+    zlistx_destroy (&self->workers);
+
+    free (self);
+    *self_p = NULL;
+}
+
+runtime_t *runtime_new (zsock_t *http_worker, int timeout, int poll_timeout) {
+    runtime_t *self = (runtime_t *) zmalloc (sizeof (runtime_t));
+    assert (self);
+
+    self->http_worker = http_worker;
+    self->response = zhttp_response_new ();
+    self->result = zhttp_response_new ();
+    self->functions = zhashx_new ();
+    zhashx_set_destructor (self->functions, (czmq_destructor *) runtime_function_destroy);
+    self->invocations = zhashx_new ();
+    zhashx_set_destructor (self->invocations, (czmq_destructor *) runtime_invocation_destroy);
+    self->next_id =  (((uint64_t) rand() <<  0) & 0x00000000FFFFFFFFull) |
+                     (((uint64_t) rand() << 32) & 0xFFFFFFFF00000000ull);
+    self->timeout = timeout;
+    self->poll_timeout = poll_timeout;
+
+    return self;
+}
+
+void runtime_destroy (runtime_t **self_p) {
+    assert (self_p);
+    runtime_t *self = *self_p;
+
+    if (self) {
+        zhttp_response_destroy (&self->response);
+        zhttp_response_destroy (&self->result);
+        zhashx_destroy (&self->functions);
+        zhashx_destroy (&self->invocations);
+
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+static runtime_function_t *
+runtime_get_function (runtime_t *self, const char *function_name) {
+    runtime_function_t *function = (runtime_function_t *) zhashx_lookup (self->functions, function_name);
+    if (!function) {
+        function = runtime_function_new ();
+        zhashx_insert (self->functions, function_name, function);
+    }
+
+    return function;
+}
+
+static void
+runtime_deliver (runtime_t *self, runtime_invocation_t *invocation, void *connection) {
+    char deadline[32];
+    snprintf (deadline, sizeof (deadline), "%" PRId64, invocation->deadline);
+
+    zhash_t *headers = zhttp_response_headers (self->response);
+    zhash_insert (headers, "Lambda-Runtime-Aws-Request-Id", invocation->request_id);
+    zhash_insert (headers, "Lambda-Runtime-Deadline-Ms", deadline);
+    zhash_insert (headers, "Lambda-Runtime-Invoked-Function-Arn", invocation->function_name);
+
+    zhttp_response_set_status_code (self->response, 200);
+    zhttp_response_set_content (self->response, &invocation->content);
+    zhttp_response_send (self->response, self->http_worker, &connection);
+
+    zhashx_insert (self->invocations, invocation->request_id, invocation);
+}
+
+int runtime_invoke (
+        runtime_t *self,
+        const char *function_name,
+        char **content,
+        aws_lambda_callback_fn callback,
+        void *arg) {
+    assert (self);
+
+    runtime_invocation_t *invocation = (runtime_invocation_t *) zmalloc (sizeof (runtime_invocation_t));
+    snprintf (invocation->request_id, RUNTIME_REQUEST_ID_LEN, "%016" PRIx64, self->next_id++);
+    invocation->function_name = strdup (function_name);
+    invocation->content = *content;
+    invocation->deadline = zclock_time () + self->timeout;
+    invocation->callback = callback;
+    invocation->arg = arg;
+    *content = NULL;
+
+    runtime_function_t *function = runtime_get_function (self, function_name);
+    runtime_worker_t *worker = (runtime_worker_t *) zlistx_first (function->workers);
+
+    if (worker) {
+        zlistx_detach_cur (function->workers);
+        runtime_deliver (self, invocation, worker->connection);
+        runtime_worker_destroy (&worker);
+    }
+    else
+        zlistx_add_end (function->pending, invocation);
+
+    return 0;
+}
+
+void runtime_next (runtime_t *self, const char *function_name, void *connection) {
+    assert (self);
+
+    runtime_function_t *function = runtime_get_function (self, function_name);
+    runtime_invocation_t *invocation = (runtime_invocation_t *) zlistx_first (function->pending);
+
+    if (invocation) {
+        zlistx_detach_cur (function->pending);
+        runtime_deliver (self, invocation, connection);
+    }
+    else {
+        runtime_worker_t *worker = (runtime_worker_t *) zmalloc (sizeof (runtime_worker_t));
+        worker->connection = connection;
+        worker->since = zclock_time ();
+        zlistx_add_end (function->workers, worker);
+    }
+}
+
+static void
+runtime_callback (runtime_t *self, runtime_invocation_t *invocation, uint32_t status_code, const char *content, bool error) {
+    zhash_t *headers = zhttp_response_headers (self->result);
+    if (error)
+        zhash_update (headers, "X-Amz-Function-Error", "Unhandled");
+    else
+        zhash_delete (headers, "X-Amz-Function-Error");
+
+    zhttp_response_set_status_code (self->result, status_code);
+    zhttp_response_set_content_const (self->result, content);
+
+    invocation->callback (invocation->arg, self->result);
+}
+
+void runtime_complete (runtime_t *self, const char *request_id, const char *content, bool error, void *connection) {
+    assert (self);
+
+    runtime_invocation_t *invocation = (runtime_invocation_t *) zhashx_lookup (self->invocations, request_id);
+
+    if (invocation == NULL) {
+        zsys_warning ("Runtime: unknown invocation %s", request_id);
+        zhttp_response_set_status_code (self->response, 404);
+        zhttp_response_set_content_const (self->response, "{\"errorMessage\": \"unknown request id\"}");
+        zhttp_response_send (self->response, self->http_worker, &connection);
+        return;
+    }
+
+    zhttp_response_set_status_code (self->response, 202);
+    zhttp_response_set_content_const (self->response, "{\"status\": \"OK\"}");
+    zhttp_response_send (self->response, self->http_worker, &connection);
+
+    runtime_callback (self, invocation, 200, content, error);
+    zhashx_delete (self->invocations, request_id);
+}
+
+void runtime_expire (runtime_t *self) {
+    assert (self);
+
+    int64_t now = zclock_time ();
+    zlistx_t *expired = zlistx_new ();
+
+    runtime_invocation_t *invocation = (runtime_invocation_t *) zhashx_first (self->invocations);
+    while (invocation) {
+        if (invocation->deadline < now)
+            zlistx_add_end (expired, invocation);
+
+        invocation = (runtime_invocation_t *) zhashx_next (self->invocations);
+    }
+
+    invocation = (runtime_invocation_t *) zlistx_first (expired);
+    while (invocation) {
+        zsys_warning ("Runtime: invocation %s of %s timed out", invocation->request_id, invocation->function_name);
+        runtime_callback (self, invocation, 504, "{\"errorMessage\": \"invocation timed out\"}", false);
+        zhashx_delete (self->invocations, invocation->request_id);
+
+        invocation = (runtime_invocation_t *) zlistx_next (expired);
+    }
+
+    zlistx_destroy (&expired);
+
+    // Pending invocations share the same timeout, so the oldest are at the head
+    runtime_function_t *function = (runtime_function_t *) zhashx_first (self->functions);
+    while (function) {
+        invocation = (runtime_invocation_t *) zlistx_first (function->pending);
+        while (invocation && invocation->deadline < now) {
+            zlistx_detach_cur (function->pending);
+
+            zsys_warning ("Runtime: no worker picked invocation %s of %s", invocation->request_id, invocation->function_name);
+            runtime_callback (self, invocation, 504, "{\"errorMessage\": \"no worker available\"}", false);
+            runtime_invocation_destroy (&invocation);
+
+            invocation = (runtime_invocation_t *) zlistx_first (function->pending);
+        }
+
+        // A worker which went away would otherwise be handed the next
+        // invocation, workers still there poll again
+        runtime_worker_t *worker = (runtime_worker_t *) zlistx_first (function->workers);
+        while (worker && worker->since + self->poll_timeout < now) {
+            zlistx_detach_cur (function->workers);
+
+            zhttp_response_set_status_code (self->response, 204);
+            zhttp_response_set_content_const (self->response, "");
+            zhttp_response_send (self->response, self->http_worker, &worker->connection);
+            runtime_worker_destroy (&worker);
+
+            worker = (runtime_worker_t *) zlistx_first (function->workers);
+        }
+
+        function = (runtime_function_t *) zhashx_next (self->functions);
+    }
+}
+
+static void
+runtime_test_callback (void *arg, zhttp_response_t *response) {
+    *(uint32_t *) arg = zhttp_response_status_code (response);
+}
+
+//  Count the responses sent to the workers, waiting a little for each
+static int
+runtime_test_responses (zsock_t *router) {
+    int count = 0;
+    zmsg_t *msg;
+    while ((msg = zmsg_recv (router))) {
+        zmsg_destroy (&msg);
+        count++;
+    }
+    return count;
+}
+
+void runtime_test (bool verbose) {
+    printf (" * runtime: ");
+
+    //  The responses go through the socket the http server would read
+    zsock_t *router = zsock_new_router ("inproc://runtime-test");
+    assert (router);
+    zsock_set_rcvtimeo (router, 100);
+    zsock_t *dealer = zsock_new_dealer (">inproc://runtime-test");
+    assert (dealer);
+
+    runtime_t *self = runtime_new (dealer, 50, 50);
+    assert (self);
+
+    //  A worker polling with nothing to do is held, then answered 204 and dropped
+    int worker = 0;
+    runtime_next (self, "echo", &worker);
+    assert (runtime_test_responses (router) == 0);
+    zclock_sleep (100);
+    runtime_expire (self);
+    assert (runtime_test_responses (router) == 1);
+
+    //  So the next invocation waits for a worker which is really there
+    uint32_t status = 0;
+    char *content = strdup ("{\"n\": 1}");
+    runtime_invoke (self, "echo", &content, runtime_test_callback, &status);
+    assert (content == NULL);
+    assert (runtime_test_responses (router) == 0);
+
+    runtime_next (self, "echo", &worker);
+    assert (runtime_test_responses (router) == 1);
+
+    //  Completion of an unknown invocation is refused, the known one is
+    //  acknowledged and passed on
+    runtime_invocation_t *invocation = (runtime_invocation_t *) zhashx_first (self->invocations);
+    assert (invocation);
+    char *known = strdup (invocation->request_id);
+    runtime_complete (self, "0000000000000000", "{}", false, &worker);
+    assert (status == 0);
+    runtime_complete (self, known, "{\"n\": 2}", false, &worker);
+    assert (status == 200);
+    assert (runtime_test_responses (router) == 2);
+    zstr_free (&known);
+
+    //  An invocation no worker completes in time fails
+    status = 0;
+    content = strdup ("{\"n\": 3}");
+    runtime_invoke (self, "echo", &content, runtime_test_callback, &status);
+    runtime_next (self, "echo", &worker);
+    assert (runtime_test_responses (router) == 1);
+    zclock_sleep (100);
+    runtime_expire (self);
+    assert (status == 504);
+
+    //  Same when no worker even picked it
+    status = 0;
+    content = strdup ("{\"n\": 4}");
+    runtime_invoke (self, "echo", &content, runtime_test_callback, &status);
+    zclock_sleep (100);
+    runtime_expire (self);
+    assert (status == 504);
+    assert (runtime_test_responses (router) == 0);
+
+    runtime_destroy (&self);
+    zsock_destroy (&dealer);
+    zsock_destroy (&router);
+
+    printf ("OK\n");
+}
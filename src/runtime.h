@@ -0,0 +1,30 @@
+#ifndef RUNTIME_H_INCLUDED
+#define RUNTIME_H_INCLUDED
+
+#include "mql_classes.h"
+
+typedef struct _runtime_t runtime_t;
+
+//  Lambda runtime api backend. Instead of invoking the function, invocations
+//  wait for a worker to long-poll them with GET /runtime/invocation/next.
+
+//  Invocations not completed within timeout milliseconds fail, workers
+//  polling for longer than poll_timeout are answered 204 and dropped
+runtime_t *runtime_new (zsock_t *http_worker, int timeout, int poll_timeout);
+
+void runtime_destroy (runtime_t **self_p);
+
+int runtime_invoke (runtime_t *self, const char *function_name, char **content, aws_lambda_callback_fn callback, void *arg);
+
+//  Worker is asking for the next invocation, the connection is held until one is available
+void runtime_next (runtime_t *self, const char *function_name, void *connection);
+
+//  Worker completed an invocation, successfully or with an error
+void runtime_complete (runtime_t *self, const char *request_id, const char *content, bool error, void *connection);
+
+//  Fail invocations whose worker didn't complete them in time
+void runtime_expire (runtime_t *self);
+
+void runtime_test (bool verbose);
+
+#endif
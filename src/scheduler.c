@@ -0,0 +1,425 @@
+#include "mql_classes.h"
+#include <jansson.h>
+
+typedef struct {
+    scheduler_t *parent;
+    char *key;
+    char *to;
+    char *from;
+    char *subject;
+    payload_t *body;            //  Serialized, so no jansson memory outlives the message
+    char *expression;           //  Cron expression of a recurring reminder, NULL if once
+    cron_t *cron;
+    int64_t due;                //  Wall clock time in milliseconds
+    timewheel_timer_t *timer;
+} scheduler_reminder_t;
+
+struct _scheduler_t {
+    timewheel_t *wheel;
+    scheduler_fn *fn;
+    void *arg;
+    zhashx_t *reminders;
+    uint64_t sequence;
+    FILE *journal;
+};
+
+static void
+scheduler_reminder_destroy (scheduler_reminder_t **self_p) {
+    scheduler_reminder_t *self = *self_p;
+
+    timewheel_cancel (self->parent->wheel, &self->timer);
+    zstr_free (&self->key);
+    zstr_free (&self->to);
+    zstr_free (&self->from);
+    zstr_free (&self->subject);
+    zstr_free (&self->expression);
+    cron_destroy (&self->cron);
+    payload_decref (&self->body);
+
+    free (self);
+    *self_p = NULL;
+}
+
+static void
+scheduler_journal (scheduler_t *self, json_t *entry) {
+    if (self->journal) {
+        json_dumpf (entry, self->journal, JSON_COMPACT);
+        fputc ('\n', self->journal);
+        fflush (self->journal);
+    }
+    json_decref (entry);
+}
+
+static json_t *
+scheduler_reminder_entry (scheduler_reminder_t *self) {
+    const char *data = self->body ? payload_data (self->body) : NULL;
+    json_t *body = data ? json_loadb (data, payload_size (self->body), JSON_DECODE_ANY, NULL) : json_null ();
+
+    return json_pack ("{sssssssssosIss?}", "key", self->key, "to", self->to, "from", self->from,
+                      "subject", self->subject, "body", body,
+                      "due", (json_int_t) self->due, "cron", self->expression);
+}
+
+static void scheduler_reminder_fire (scheduler_reminder_t *self, uint64_t key);
+
+//  Return -1 if the reminder never fires again
+static int
+scheduler_reminder_start (scheduler_reminder_t *self) {
+    int64_t now = zclock_time ();
+
+    if (self->cron) {
+        int64_t next = cron_next (self->cron, now / 1000);
+        if (next == -1) {
+            zsys_warning ("Scheduler: reminder %s never fires again", self->key);
+            return -1;
+        }
+        self->due = next * 1000;
+    }
+
+    //  The wheel runs on the monotonic clock
+    int64_t delay = self->due > now ? self->due - now : 0;
+    self->timer = timewheel_add (self->parent->wheel, zclock_mono () + delay,
+                                 (timewheel_fn *) scheduler_reminder_fire, self, 0);
+    return 0;
+}
+
+//  Forget the reminder, in the journal as well
+static void
+scheduler_remove (scheduler_t *self, const char *key) {
+    scheduler_journal (self, json_pack ("{sssb}", "key", key, "del", true));
+    zhashx_delete (self->reminders, key);
+}
+
+static void
+scheduler_reminder_fire (scheduler_reminder_t *self, uint64_t key) {
+    scheduler_t *parent = self->parent;
+
+    //  The wheel releases the timer once we return
+    self->timer = NULL;
+
+    parent->fn (parent->arg, self->to, self->from, self->subject, payload_incref (self->body));
+
+    if (!self->cron || scheduler_reminder_start (self) != 0)
+        scheduler_remove (parent, self->key);
+}
+
+static scheduler_reminder_t *
+scheduler_insert (scheduler_t *self, const char *key, const char *to, const char *from, const char *subject,
+                  json_t *body, const char *expression, int64_t due) {
+    cron_t *cron = NULL;
+    if (expression) {
+        cron = cron_new (expression);
+        if (!cron)
+            return NULL;
+    }
+
+    scheduler_reminder_t *reminder = (scheduler_reminder_t *) zmalloc (sizeof (scheduler_reminder_t));
+    reminder->parent = self;
+    reminder->key = strdup (key);
+    reminder->to = strdup (to);
+    reminder->from = strdup (from);
+    reminder->subject = strdup (subject);
+    reminder->body = body && !json_is_null (body) ? payload_new_json (body) : NULL;
+    reminder->expression = expression ? strdup (expression) : NULL;
+    reminder->cron = cron;
+    reminder->due = due;
+
+    //  Replaces the previous reminder with the same name, and its timer
+    zhashx_update (self->reminders, key, reminder);
+    if (scheduler_reminder_start (reminder) != 0) {
+        scheduler_remove (self, key);
+        return NULL;
+    }
+
+    return reminder;
+}
+
+scheduler_t *scheduler_new (timewheel_t *wheel, scheduler_fn *fn, void *arg) {
+    assert (wheel);
+    assert (fn);
+
+    scheduler_t *self = (scheduler_t *) zmalloc (sizeof (scheduler_t));
+    assert (self);
+
+    self->wheel = wheel;
+    self->fn = fn;
+    self->arg = arg;
+    self->reminders = zhashx_new ();
+    zhashx_set_destructor (self->reminders, (czmq_destructor *) scheduler_reminder_destroy);
+
+    return self;
+}
+
+void scheduler_destroy (scheduler_t **self_p) {
+    assert (self_p);
+    scheduler_t *self = *self_p;
+
+    if (self) {
+        zhashx_destroy (&self->reminders);
+        if (self->journal)
+            fclose (self->journal);
+
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+int scheduler_load (scheduler_t *self, const char *path) {
+    assert (self);
+    assert (path);
+
+    //  Replay the journal, the last entry of a key wins
+    FILE *file = fopen (path, "r");
+    if (file) {
+        char *line = NULL;
+        size_t capacity = 0;
+
+        while (getline (&line, &capacity, file) != -1) {
+            json_error_t error;
+            json_t *entry = json_loads (line, 0, &error);
+            const char *key = json_string_value (json_object_get (entry, "key"));
+
+            if (key == NULL)
+                zsys_warning ("Scheduler: skipping invalid journal entry %s", line);
+            else
+            if (json_is_true (json_object_get (entry, "del")))
+                zhashx_delete (self->reminders, key);
+            else {
+                const char *to = json_string_value (json_object_get (entry, "to"));
+                const char *from = json_string_value (json_object_get (entry, "from"));
+                const char *subject = json_string_value (json_object_get (entry, "subject"));
+                const char *expression = json_string_value (json_object_get (entry, "cron"));
+                json_t *due = json_object_get (entry, "due");
+
+                if (!to || !from || !subject || !json_is_integer (due)
+                ||  !scheduler_insert (self, key, to, from, subject, json_object_get (entry, "body"),
+                                       expression, json_integer_value (due)))
+                    zsys_warning ("Scheduler: skipping invalid journal entry %s", line);
+            }
+
+            if (entry)
+                json_decref (entry);
+        }
+
+        free (line);
+        fclose (file);
+    }
+
+    //  Compact the journal down to the pending reminders
+    char *temp_path = zsys_sprintf ("%s.tmp", path);
+    self->journal = fopen (temp_path, "w");
+    if (self->journal == NULL) {
+        zsys_error ("Scheduler: fail to write journal %s", temp_path);
+        zstr_free (&temp_path);
+        return -1;
+    }
+
+    for (scheduler_reminder_t *reminder = (scheduler_reminder_t *) zhashx_first (self->reminders);
+         reminder; reminder = (scheduler_reminder_t *) zhashx_next (self->reminders))
+        scheduler_journal (self, scheduler_reminder_entry (reminder));
+
+    int rc = rename (temp_path, path);
+    zstr_free (&temp_path);
+    if (rc == -1) {
+        zsys_error ("Scheduler: fail to write journal %s", path);
+        fclose (self->journal);
+        self->journal = NULL;
+        return -1;
+    }
+
+    zsys_info ("Scheduler: restored %zu reminders from %s", zhashx_size (self->reminders), path);
+
+    return 0;
+}
+
+//  Return -1 if the schedule object is invalid
+static int
+scheduler_check (json_t *schedule) {
+    if (!json_is_object (schedule))
+        return -1;
+
+    json_t *to = json_object_get (schedule, "to");
+    json_t *name = json_object_get (schedule, "name");
+    json_t *subject = json_object_get (schedule, "subject");
+    json_t *delay = json_object_get (schedule, "delay");
+    json_t *cron = json_object_get (schedule, "cron");
+
+    if ((to && !json_is_string (to)) || (name && !json_is_string (name)))
+        return -1;
+
+    if (json_is_true (json_object_get (schedule, "cancel")))
+        return name ? 0 : -1;
+
+    //  Either once after a delay or recurring
+    if (!json_is_string (subject)
+    ||  (delay && cron) || (!delay && !cron)
+    ||  (delay && (!json_is_integer (delay) || json_integer_value (delay) < 0))
+    ||  (cron && !json_is_string (cron)))
+        return -1;
+
+    if (cron) {
+        cron_t *parsed = cron_new (json_string_value (cron));
+        if (!parsed)
+            return -1;
+
+        int64_t next = cron_next (parsed, zclock_time () / 1000);
+        cron_destroy (&parsed);
+        if (next == -1)
+            return -1;
+    }
+
+    return 0;
+}
+
+static int
+scheduler_add_one (scheduler_t *self, const char *from, json_t *schedule) {
+    json_t *to = json_object_get (schedule, "to");
+    json_t *name = json_object_get (schedule, "name");
+    json_t *subject = json_object_get (schedule, "subject");
+    json_t *delay = json_object_get (schedule, "delay");
+    json_t *cron = json_object_get (schedule, "cron");
+
+    char *key = name
+        ? zsys_sprintf ("%s#%s", from, json_string_value (name))
+        : zsys_sprintf ("%s@%" PRId64 "-%" PRIu64, from, zclock_time (), self->sequence++);
+
+    if (json_is_true (json_object_get (schedule, "cancel"))) {
+        if (zhashx_lookup (self->reminders, key))
+            scheduler_remove (self, key);
+
+        zstr_free (&key);
+        return 0;
+    }
+
+    int64_t due = delay ? zclock_time () + json_integer_value (delay) : 0;
+    scheduler_reminder_t *reminder = scheduler_insert (
+        self, key, to ? json_string_value (to) : from, from, json_string_value (subject),
+        json_object_get (schedule, "body"), cron ? json_string_value (cron) : NULL, due);
+    zstr_free (&key);
+
+    if (reminder == NULL)
+        return -1;
+
+    scheduler_journal (self, scheduler_reminder_entry (reminder));
+
+    return 0;
+}
+
+int scheduler_add (scheduler_t *self, const char *from, json_t *schedule) {
+    assert (self);
+    assert (from);
+
+    //  All or nothing, so a retry doesn't add the valid ones again
+    size_t index;
+    json_t *value;
+    if (json_is_array (schedule)) {
+        json_array_foreach (schedule, index, value) {
+            if (scheduler_check (value) != 0)
+                return -1;
+        }
+    }
+    else
+    if (scheduler_check (schedule) != 0)
+        return -1;
+
+    int rc = 0;
+    if (json_is_array (schedule)) {
+        json_array_foreach (schedule, index, value) {
+            if (scheduler_add_one (self, from, value) != 0)
+                rc = -1;
+        }
+    }
+    else
+        rc = scheduler_add_one (self, from, schedule);
+
+    return rc;
+}
+
+size_t scheduler_size (scheduler_t *self) {
+    assert (self);
+    return zhashx_size (self->reminders);
+}
+
+#define SELFTEST_DIR_RW "src/selftest-rw"
+
+static void
+scheduler_test_fn (void *arg, const char *to, const char *from, const char *subject, payload_t *body) {
+    int *fired = (int *) arg;
+
+    assert (streq (to, "counter/2"));
+    assert (streq (from, "counter/1"));
+    assert (streq (subject, "tick"));
+    assert (streq (payload_data (body), "{\"n\":1}"));
+    payload_decref (&body);
+
+    (*fired)++;
+}
+
+void scheduler_test (bool verbose) {
+    printf (" * scheduler: ");
+
+    const char *journal = SELFTEST_DIR_RW "/scheduler.journal";
+    unlink (journal);
+
+    timewheel_t *wheel = timewheel_new (zclock_mono ());
+    int fired = 0;
+
+    scheduler_t *self = scheduler_new (wheel, scheduler_test_fn, &fired);
+    assert (scheduler_load (self, journal) == 0);
+
+    json_t *schedule = json_loads ("{\"to\": \"counter/2\", \"subject\": \"tick\", \"body\": {\"n\": 1}, \"delay\": 10}", 0, NULL);
+    assert (scheduler_add (self, "counter/1", schedule) == 0);
+    json_decref (schedule);
+
+    //  Named reminders replace each other
+    schedule = json_loads ("{\"name\": \"daily\", \"to\": \"counter/2\", \"subject\": \"tick\", \"body\": {\"n\": 1}, \"cron\": \"0 0 * * *\"}", 0, NULL);
+    assert (scheduler_add (self, "counter/1", schedule) == 0);
+    assert (scheduler_add (self, "counter/1", schedule) == 0);
+    json_decref (schedule);
+    assert (scheduler_size (self) == 2);
+
+    schedule = json_loads ("{\"subject\": \"tick\", \"delay\": 10, \"cron\": \"* * * * *\"}", 0, NULL);
+    assert (scheduler_add (self, "counter/1", schedule) == -1);
+    json_decref (schedule);
+    schedule = json_loads ("{\"subject\": \"tick\", \"cron\": \"every minute\"}", 0, NULL);
+    assert (scheduler_add (self, "counter/1", schedule) == -1);
+    json_decref (schedule);
+
+    //  A cron expression which never fires is refused
+    schedule = json_loads ("{\"subject\": \"tick\", \"cron\": \"0 0 30 2 *\"}", 0, NULL);
+    assert (scheduler_add (self, "counter/1", schedule) == -1);
+    json_decref (schedule);
+
+    //  An array with an invalid schedule adds none of them
+    schedule = json_loads ("[{\"subject\": \"tick\", \"delay\": 10}, {\"subject\": \"tick\"}]", 0, NULL);
+    assert (scheduler_add (self, "counter/1", schedule) == -1);
+    json_decref (schedule);
+    assert (scheduler_size (self) == 2);
+
+    timewheel_execute (wheel, zclock_mono () + 20);
+    assert (fired == 1);
+    assert (scheduler_size (self) == 1);
+
+    //  The recurring reminder is restored from the journal
+    scheduler_destroy (&self);
+    self = scheduler_new (wheel, scheduler_test_fn, &fired);
+    assert (scheduler_load (self, journal) == 0);
+    assert (scheduler_size (self) == 1);
+
+    schedule = json_loads ("{\"name\": \"daily\", \"cancel\": true}", 0, NULL);
+    assert (scheduler_add (self, "counter/1", schedule) == 0);
+    json_decref (schedule);
+    assert (scheduler_size (self) == 0);
+    assert (timewheel_size (wheel) == 0);
+
+    scheduler_destroy (&self);
+    self = scheduler_new (wheel, scheduler_test_fn, &fired);
+    assert (scheduler_load (self, journal) == 0);
+    assert (scheduler_size (self) == 0);
+    scheduler_destroy (&self);
+
+    timewheel_destroy (&wheel);
+    unlink (journal);
+
+    printf ("OK\n");
+}
@@ -0,0 +1,33 @@
+#ifndef SCHEDULER_H_INCLUDED
+#define SCHEDULER_H_INCLUDED
+
+#include "mql_classes.h"
+
+typedef struct _scheduler_t scheduler_t;
+
+//  Deliver a reminder, the callee owns the reference of the body, which is NULL for no body
+typedef void (scheduler_fn) (void *arg, const char *to, const char *from, const char *subject, payload_t *body);
+
+//  Reminders actors schedule for themselves or other actors, the timers are
+//  kept on the timing wheel, which must outlive the scheduler
+scheduler_t *scheduler_new (timewheel_t *wheel, scheduler_fn *fn, void *arg);
+
+void scheduler_destroy (scheduler_t **self_p);
+
+//  Restore the reminders of the journal and keep it up to date from now on,
+//  return -1 if the journal can't be written
+int scheduler_load (scheduler_t *self, const char *path);
+
+//  Add a reminder from the schedule object returned by an actor, with to,
+//  subject, body and either delay in milliseconds or a cron expression. To
+//  defaults to the actor itself. A named reminder replaces the previous one of
+//  the actor with the same name and can be removed with cancel. The schedule
+//  can also be an array of such objects, none is added if any is invalid.
+//  Return -1 if the schedule is invalid.
+int scheduler_add (scheduler_t *self, const char *from, json_t *schedule);
+
+size_t scheduler_size (scheduler_t *self);
+
+void scheduler_test (bool verbose);
+
+#endif
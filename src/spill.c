@@ -0,0 +1,257 @@
+#include "mql_classes.h"
+#include <fcntl.h>
+
+typedef struct {
+    int fd;
+    uint64_t size;              //  Bytes written
+    size_t live;                //  Records still needed
+} spill_segment_t;
+
+struct _spill_t {
+    char *directory;
+    size_t watermark;
+    size_t segment_size;
+    spill_segment_t **segments; //  By id, NULL once closed until the id is reused
+    uint32_t segments_size;
+    uint32_t current;           //  Segment appended to
+    size_t bytes;
+};
+
+static void
+spill_segment_close (spill_t *self, uint32_t id) {
+    spill_segment_t *segment = self->segments[id];
+    if (segment) {
+        close (segment->fd);
+        free (segment);
+        self->segments[id] = NULL;
+    }
+}
+
+static spill_segment_t *
+spill_segment_open (spill_t *self) {
+    //  The id of a closed segment is taken again before the array grows
+    uint32_t id = 0;
+    while (id < self->segments_size && self->segments[id])
+        id++;
+
+    char *path = zsys_sprintf ("%s/%u-%u.spill", self->directory, (unsigned) getpid (), id);
+    int fd = open (path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd != -1)
+        unlink (path);
+    zstr_free (&path);
+
+    if (fd == -1) {
+        zsys_error ("spill: fail to create a spill file in %s", self->directory);
+        return NULL;
+    }
+
+    if (id == self->segments_size) {
+        self->segments = (spill_segment_t **) realloc (self->segments, (self->segments_size + 1) * sizeof (spill_segment_t *));
+        assert (self->segments);
+        self->segments_size++;
+    }
+
+    spill_segment_t *segment = (spill_segment_t *) zmalloc (sizeof (spill_segment_t));
+    segment->fd = fd;
+    self->current = id;
+    self->segments[id] = segment;
+
+    return segment;
+}
+
+spill_t *spill_new (const char *directory, size_t watermark, size_t segment_size) {
+    assert (directory);
+
+    spill_t *self = (spill_t *) zmalloc (sizeof (spill_t));
+    assert (self);
+
+    self->directory = strdup (directory);
+    self->watermark = watermark;
+    self->segment_size = segment_size;
+
+    return self;
+}
+
+void spill_destroy (spill_t **self_p) {
+    assert (self_p);
+    spill_t *self = *self_p;
+
+    if (self) {
+        for (uint32_t id = 0; id < self->segments_size; id++)
+            spill_segment_close (self, id);
+        free (self->segments);
+        zstr_free (&self->directory);
+
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+bool spill_needed (spill_t *self, size_t queued) {
+    assert (self);
+    return queued > self->bytes && queued - self->bytes > self->watermark;
+}
+
+int spill_write (spill_t *self, const char *data, size_t size, uint32_t *segment_id, uint64_t *offset) {
+    assert (self);
+
+    spill_segment_t *segment = self->segments_size ? self->segments[self->current] : NULL;
+    if (segment == NULL || segment->size >= self->segment_size) {
+        segment = spill_segment_open (self);
+        if (segment == NULL)
+            return -1;
+    }
+
+    for (size_t written = 0; written < size; ) {
+        ssize_t rc = pwrite (segment->fd, data + written, size - written, segment->size + written);
+        if (rc == -1 && errno == EINTR)
+            continue;
+        if (rc <= 0) {
+            zsys_error ("spill: fail to write a spill file: %s", strerror (errno));
+            return -1;
+        }
+        written += rc;
+    }
+
+    *segment_id = self->current;
+    *offset = segment->size;
+    segment->size += size;
+    segment->live++;
+    self->bytes += size;
+
+    return 0;
+}
+
+int spill_read (spill_t *self, uint32_t segment_id, uint64_t offset, char *data, size_t size) {
+    assert (self);
+    assert (segment_id < self->segments_size && self->segments[segment_id]);
+    spill_segment_t *segment = self->segments[segment_id];
+
+    for (size_t read = 0; read < size; ) {
+        ssize_t rc = pread (segment->fd, data + read, size - read, offset + read);
+        if (rc == -1 && errno == EINTR)
+            continue;
+        if (rc <= 0) {
+            zsys_error ("spill: fail to read a spill file: %s", rc == 0 ? "truncated" : strerror (errno));
+            return -1;
+        }
+        read += rc;
+    }
+
+    return 0;
+}
+
+void spill_prefetch (spill_t *self, uint32_t segment_id, uint64_t offset, size_t size) {
+    assert (self);
+    assert (segment_id < self->segments_size && self->segments[segment_id]);
+#if defined (POSIX_FADV_WILLNEED)
+    posix_fadvise (self->segments[segment_id]->fd, offset, size, POSIX_FADV_WILLNEED);
+#endif
+}
+
+void spill_release (spill_t *self, uint32_t segment_id, size_t size) {
+    assert (self);
+    assert (segment_id < self->segments_size && self->segments[segment_id]);
+    spill_segment_t *segment = self->segments[segment_id];
+
+    assert (segment->live > 0);
+    segment->live--;
+    self->bytes -= size;
+
+    if (segment->live == 0) {
+        //  The current segment is rewound rather than closed
+        if (segment_id == self->current) {
+            if (ftruncate (segment->fd, 0) == 0)
+                segment->size = 0;
+        }
+        else
+            spill_segment_close (self, segment_id);
+    }
+}
+
+size_t spill_bytes (spill_t *self) {
+    assert (self);
+    return self->bytes;
+}
+
+#define SELFTEST_DIR_RW "src/selftest-rw"
+
+void spill_test (bool verbose) {
+    printf (" * spill: ");
+
+    spill_t *self = spill_new (SELFTEST_DIR_RW, 100, 64);
+    assert (!spill_needed (self, 100));
+    assert (spill_needed (self, 101));
+
+    uint32_t segments[3];
+    uint64_t offsets[3];
+    char record[40];
+    for (int index = 0; index < 3; index++) {
+        memset (record, 'a' + index, sizeof (record));
+        assert (spill_write (self, record, sizeof (record), &segments[index], &offsets[index]) == 0);
+    }
+
+    //  Segments are rotated once full
+    assert (segments[0] == segments[1] && offsets[1] == 40);
+    assert (segments[2] != segments[1] && offsets[2] == 0);
+    assert (spill_bytes (self) == 120);
+    assert (!spill_needed (self, 220));
+
+    spill_prefetch (self, segments[1], offsets[1], sizeof (record));
+    assert (spill_read (self, segments[1], offsets[1], record, sizeof (record)) == 0);
+    assert (record[0] == 'b' && record[39] == 'b');
+
+    //  The files are already gone from the directory
+    char *path = zsys_sprintf ("%s/%u-%u.spill", SELFTEST_DIR_RW, (unsigned) getpid (), segments[0]);
+    assert (access (path, F_OK) == -1);
+    zstr_free (&path);
+
+    spill_release (self, segments[0], sizeof (record));
+    spill_release (self, segments[1], sizeof (record));
+    assert (self->segments[segments[0]] == NULL);
+    spill_release (self, segments[2], sizeof (record));
+    assert (spill_bytes (self) == 0);
+
+    //  The ids of the closed segments are reused
+    uint32_t closed = segments[0];
+    for (int index = 0; index < 3; index++)
+        assert (spill_write (self, record, sizeof (record), &segments[index], &offsets[index]) == 0);
+    assert (segments[2] == closed);
+    assert (self->segments_size == 2);
+    for (int index = 0; index < 3; index++)
+        spill_release (self, segments[index], sizeof (record));
+    assert (spill_bytes (self) == 0);
+
+    //  Payloads move their data to the spill file and back
+    payload_t *payload = payload_new ("{\"spilled\":true}", 16);
+    assert (payload_spill (payload, self) == 0);
+    assert (payload_spilled (payload));
+    assert (spill_bytes (self) == 16);
+    payload_prefetch (payload);
+    assert (payload_load (payload) == 0);
+    assert (!payload_spilled (payload));
+    assert (streq (payload_data (payload), "{\"spilled\":true}"));
+    assert (spill_bytes (self) == 0);
+
+    //  Spilled payloads can also be read lazily or dropped
+    assert (payload_spill (payload, self) == 0);
+    assert (streq (payload_data (payload), "{\"spilled\":true}"));
+    assert (payload_spill (payload, self) == 0);
+    payload_decref (&payload);
+    assert (spill_bytes (self) == 0);
+
+    //  A payload which can't be read back has no data
+    payload = payload_new ("{\"spilled\":true}", 16);
+    assert (payload_spill (payload, self) == 0);
+    assert (ftruncate (self->segments[self->current]->fd, 0) == 0);
+    assert (payload_data (payload) == NULL);
+    json_t *envelope = json_object ();
+    assert (payload_wrap (payload, envelope) == NULL);
+    json_decref (envelope);
+    payload_decref (&payload);
+    assert (spill_bytes (self) == 0);
+
+    spill_destroy (&self);
+
+    printf ("OK\n");
+}
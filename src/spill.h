@@ -0,0 +1,41 @@
+#ifndef SPILL_H_INCLUDED
+#define SPILL_H_INCLUDED
+
+#include "mql_classes.h"
+
+typedef struct _spill_t spill_t;
+
+//  Smaller bodies aren't worth a trip to disk
+#define SPILL_MIN_SIZE 512
+
+//  Append only files holding the bodies of queued messages while memory is
+//  short. The files are unlinked as soon as they are created, so they never
+//  outlive the process, and a file is closed, releasing its space, once all
+//  its records were read back or dropped.
+
+//  Spill once the resident queued bytes reach the watermark
+spill_t *spill_new (const char *directory, size_t watermark, size_t segment_size);
+
+void spill_destroy (spill_t **self_p);
+
+//  Return true if the queued bytes, minus the spilled ones, are beyond the watermark
+bool spill_needed (spill_t *self, size_t queued);
+
+//  Append the record, return -1 if it can't be written
+int spill_write (spill_t *self, const char *data, size_t size, uint32_t *segment, uint64_t *offset);
+
+//  Read the record back, return -1 if it can't be read
+int spill_read (spill_t *self, uint32_t segment, uint64_t offset, char *data, size_t size);
+
+//  Hint the record will be read soon
+void spill_prefetch (spill_t *self, uint32_t segment, uint64_t offset, size_t size);
+
+//  The record isn't needed anymore
+void spill_release (spill_t *self, uint32_t segment, size_t size);
+
+//  Bytes of the records still needed
+size_t spill_bytes (spill_t *self);
+
+void spill_test (bool verbose);
+
+#endif
@@ -0,0 +1,336 @@
+#include "mql_classes.h"
+
+#define TIMEWHEEL_LEVELS 4
+#define TIMEWHEEL_BITS 8
+#define TIMEWHEEL_SLOTS (1 << TIMEWHEEL_BITS)
+#define TIMEWHEEL_MASK (TIMEWHEEL_SLOTS - 1)
+#define TIMEWHEEL_OVERFLOW TIMEWHEEL_LEVELS
+
+struct _timewheel_timer_t {
+    timewheel_timer_t *next;
+    timewheel_timer_t *prev;
+    int64_t expiry;
+    int level;
+    timewheel_fn *fn;
+    void *arg;
+    uint64_t key;
+};
+
+struct _timewheel_t {
+    int64_t tick;               //  Next tick to process, all earlier ticks already fired
+    timewheel_timer_t slots[TIMEWHEEL_LEVELS][TIMEWHEEL_SLOTS];
+    timewheel_timer_t overflow; //  Timers beyond the last level
+    size_t counts[TIMEWHEEL_LEVELS + 1];
+    size_t size;
+};
+
+static void
+timewheel_list_init (timewheel_timer_t *head) {
+    head->next = head;
+    head->prev = head;
+}
+
+static void
+timewheel_list_append (timewheel_timer_t *head, timewheel_timer_t *timer) {
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+static void
+timewheel_list_unlink (timewheel_timer_t *timer) {
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = timer->prev = NULL;
+}
+
+//  Place the timer on the finest level that can hold it, relative to the current tick
+
+static void
+timewheel_place (timewheel_t *self, timewheel_timer_t *timer) {
+    if (timer->expiry < self->tick)
+        timer->expiry = self->tick;
+
+    int64_t delta = timer->expiry - self->tick;
+
+    for (int level = 0; level < TIMEWHEEL_LEVELS; level++) {
+        if (delta < ((int64_t) 1 << (TIMEWHEEL_BITS * (level + 1)))) {
+            int slot = (int) ((timer->expiry >> (TIMEWHEEL_BITS * level)) & TIMEWHEEL_MASK);
+            timer->level = level;
+            timewheel_list_append (&self->slots[level][slot], timer);
+            self->counts[level]++;
+            return;
+        }
+    }
+
+    timer->level = TIMEWHEEL_OVERFLOW;
+    timewheel_list_append (&self->overflow, timer);
+    self->counts[TIMEWHEEL_OVERFLOW]++;
+}
+
+static void
+timewheel_replace_all (timewheel_t *self, timewheel_timer_t *head, int level) {
+    while (head->next != head) {
+        timewheel_timer_t *timer = head->next;
+        timewheel_list_unlink (timer);
+        self->counts[level]--;
+        timewheel_place (self, timer);
+    }
+}
+
+//  Called on ticks which are a multiple of the slots count, move the timers
+//  of the coarser levels due in the next rotation down a level
+
+static void
+timewheel_cascade (timewheel_t *self, int64_t tick) {
+    int level = 1;
+    while (level < TIMEWHEEL_LEVELS
+           && ((tick >> (TIMEWHEEL_BITS * level)) & TIMEWHEEL_MASK) == 0
+           && (tick & (((int64_t) 1 << (TIMEWHEEL_BITS * level)) - 1)) == 0)
+        level++;
+
+    //  Coarser levels first, so their timers can be cascaded further down
+    if (level == TIMEWHEEL_LEVELS)
+        timewheel_replace_all (self, &self->overflow, TIMEWHEEL_OVERFLOW);
+
+    for (int l = level < TIMEWHEEL_LEVELS ? level : TIMEWHEEL_LEVELS - 1; l >= 1; l--) {
+        int slot = (int) ((tick >> (TIMEWHEEL_BITS * l)) & TIMEWHEEL_MASK);
+        timewheel_replace_all (self, &self->slots[l][slot], l);
+    }
+}
+
+timewheel_t *timewheel_new (int64_t now) {
+    timewheel_t *self = (timewheel_t *) zmalloc (sizeof (timewheel_t));
+    assert (self);
+
+    self->tick = now;
+    for (int level = 0; level < TIMEWHEEL_LEVELS; level++)
+        for (int slot = 0; slot < TIMEWHEEL_SLOTS; slot++)
+            timewheel_list_init (&self->slots[level][slot]);
+    timewheel_list_init (&self->overflow);
+
+    return self;
+}
+
+static void
+timewheel_free_all (timewheel_timer_t *head) {
+    while (head->next != head) {
+        timewheel_timer_t *timer = head->next;
+        timewheel_list_unlink (timer);
+        free (timer);
+    }
+}
+
+void timewheel_destroy (timewheel_t **self_p) {
+    assert (self_p);
+    timewheel_t *self = *self_p;
+
+    if (self) {
+        for (int level = 0; level < TIMEWHEEL_LEVELS; level++)
+            for (int slot = 0; slot < TIMEWHEEL_SLOTS; slot++)
+                timewheel_free_all (&self->slots[level][slot]);
+        timewheel_free_all (&self->overflow);
+
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+timewheel_timer_t *timewheel_add (timewheel_t *self, int64_t expiry, timewheel_fn *fn, void *arg, uint64_t key) {
+    assert (self);
+    assert (fn);
+
+    timewheel_timer_t *timer = (timewheel_timer_t *) zmalloc (sizeof (timewheel_timer_t));
+    timer->expiry = expiry;
+    timer->fn = fn;
+    timer->arg = arg;
+    timer->key = key;
+
+    timewheel_place (self, timer);
+    self->size++;
+
+    return timer;
+}
+
+void timewheel_cancel (timewheel_t *self, timewheel_timer_t **timer_p) {
+    assert (self);
+    assert (timer_p);
+    timewheel_timer_t *timer = *timer_p;
+
+    if (timer) {
+        timewheel_list_unlink (timer);
+        self->counts[timer->level]--;
+        self->size--;
+
+        free (timer);
+        *timer_p = NULL;
+    }
+}
+
+int timewheel_timeout (timewheel_t *self, int64_t now) {
+    assert (self);
+
+    if (self->size == 0)
+        return -1;
+
+    //  Timers on the coarser levels are only due after a cascade, so the
+    //  next cascade bounds the wait when there are any
+    int64_t due = INT64_MAX;
+    if (self->size > self->counts[0])
+        due = (self->tick + TIMEWHEEL_MASK) & ~((int64_t) TIMEWHEEL_MASK);
+
+    if (self->counts[0] > 0) {
+        for (int64_t tick = self->tick; tick < self->tick + TIMEWHEEL_SLOTS && tick < due; tick++) {
+            timewheel_timer_t *head = &self->slots[0][tick & TIMEWHEEL_MASK];
+            if (head->next != head) {
+                due = tick;
+                break;
+            }
+        }
+    }
+
+    if (due <= now)
+        return 0;
+
+    return due - now > INT_MAX ? INT_MAX : (int) (due - now);
+}
+
+size_t timewheel_execute (timewheel_t *self, int64_t now) {
+    assert (self);
+    size_t fired = 0;
+
+    while (self->tick <= now) {
+        int64_t tick = self->tick;
+
+        if ((tick & TIMEWHEEL_MASK) == 0)
+            timewheel_cascade (self, tick);
+
+        timewheel_timer_t *head = &self->slots[0][tick & TIMEWHEEL_MASK];
+        while (head->next != head) {
+            timewheel_timer_t *timer = head->next;
+            timewheel_list_unlink (timer);
+            self->counts[0]--;
+            self->size--;
+
+            timer->fn (timer->arg, timer->key);
+            free (timer);
+            fired++;
+        }
+
+        self->tick = tick + 1;
+
+        //  Nothing on the finest level, skip to the next cascade
+        if (self->counts[0] == 0) {
+            if (self->size == 0) {
+                self->tick = now + 1;
+                break;
+            }
+
+            int64_t next = (self->tick + TIMEWHEEL_MASK) & ~((int64_t) TIMEWHEEL_MASK);
+            self->tick = next < now + 1 ? next : now + 1;
+        }
+    }
+
+    return fired;
+}
+
+size_t timewheel_size (timewheel_t *self) {
+    assert (self);
+    return self->size;
+}
+
+typedef struct {
+    int64_t now;
+    int fired;
+    int64_t last;
+} timewheel_test_t;
+
+static void
+timewheel_test_fn (void *arg, uint64_t key) {
+    timewheel_test_t *test = (timewheel_test_t *) arg;
+
+    //  Timers fire on their expiry, in order
+    assert ((int64_t) key == test->now);
+    assert ((int64_t) key >= test->last);
+    test->last = (int64_t) key;
+    test->fired++;
+}
+
+void timewheel_test (bool verbose) {
+    printf (" * timewheel: ");
+
+    int64_t start = 1000003;
+    timewheel_t *self = timewheel_new (start);
+    assert (self);
+    assert (timewheel_timeout (self, start) == -1);
+
+    timewheel_test_t test = { start, 0, 0 };
+
+    //  Timers on every level, including beyond the last one
+    int64_t delays[] = { 0, 1, 255, 256, 257, 1000, 65535, 65536, 70000, 16777216, 20000000, 4294967296LL + 5 };
+    int count = sizeof (delays) / sizeof (delays[0]);
+    for (int i = 0; i < count; i++)
+        timewheel_add (self, start + delays[i], timewheel_test_fn, &test, start + delays[i]);
+
+    timewheel_timer_t *cancelled = timewheel_add (self, start + 500, timewheel_test_fn, &test, 0);
+    timewheel_cancel (self, &cancelled);
+    assert (cancelled == NULL);
+    assert (timewheel_size (self) == (size_t) count);
+
+    //  Step through every expiry, the timeout never overshoots the next one
+    for (int i = 0; i < count; i++) {
+        int64_t expiry = start + delays[i];
+        while (test.now < expiry) {
+            int timeout = timewheel_timeout (self, test.now);
+            assert (timeout >= 0);
+            assert (test.now + timeout <= expiry);
+            test.now += timeout > 0 ? timeout : 1;
+            if (test.now > expiry)
+                test.now = expiry;
+            timewheel_execute (self, test.now);
+        }
+        timewheel_execute (self, test.now);
+        assert (test.fired == i + 1);
+    }
+
+    assert (timewheel_size (self) == 0);
+
+    //  Expiry in the past fires on the next tick
+    timewheel_add (self, test.now - 10, timewheel_test_fn, &test, test.now + 1);
+    assert (timewheel_timeout (self, test.now) == 1);
+    test.now++;
+    assert (timewheel_execute (self, test.now) == 1);
+
+    //  A timer of a coarser level due before a later timer of the finest
+    //  level, the wait stops at the cascade which brings it down
+    int64_t base = (test.now + 2 * TIMEWHEEL_SLOTS) & ~((int64_t) TIMEWHEEL_MASK);
+    while (test.now < base) {
+        test.now = base;
+        timewheel_execute (self, test.now);
+    }
+    test.last = 0;
+    timewheel_add (self, base + 300, timewheel_test_fn, &test, base + 300);
+    test.now = base + 200;
+    timewheel_execute (self, test.now);
+    timewheel_add (self, base + 450, timewheel_test_fn, &test, base + 450);
+
+    int expected = test.fired + 2;
+    int64_t expiries[] = { base + 300, base + 450 };
+    for (int i = 0; i < 2; i++) {
+        while (test.now < expiries[i]) {
+            int timeout = timewheel_timeout (self, test.now);
+            assert (timeout >= 0);
+            assert (test.now + timeout <= expiries[i]);
+            test.now += timeout > 0 ? timeout : 1;
+            timewheel_execute (self, test.now);
+        }
+    }
+    assert (test.fired == expected);
+
+    //  Destroying with pending timers releases them
+    timewheel_add (self, test.now + 100000, timewheel_test_fn, &test, 0);
+    timewheel_destroy (&self);
+
+    printf ("OK\n");
+}
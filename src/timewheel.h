@@ -0,0 +1,34 @@
+#ifndef TIMEWHEEL_H_INCLUDED
+#define TIMEWHEEL_H_INCLUDED
+
+#include "mql_classes.h"
+
+typedef struct _timewheel_t timewheel_t;
+typedef struct _timewheel_timer_t timewheel_timer_t;
+
+typedef void (timewheel_fn) (void *arg, uint64_t key);
+
+//  Hierarchical timing wheel with millisecond resolution. Adding, cancelling
+//  and expiring a timer are O(1), timers are cascaded down to the finer
+//  levels as their expiry gets closer.
+
+timewheel_t *timewheel_new (int64_t now);
+
+void timewheel_destroy (timewheel_t **self_p);
+
+//  Add a timer expiring at an absolute time, in the same clock as now
+timewheel_timer_t *timewheel_add (timewheel_t *self, int64_t expiry, timewheel_fn *fn, void *arg, uint64_t key);
+
+void timewheel_cancel (timewheel_t *self, timewheel_timer_t **timer_p);
+
+//  Milliseconds until the wheel needs to execute again, -1 when empty
+int timewheel_timeout (timewheel_t *self, int64_t now);
+
+//  Fire all timers expired by now, return how many fired
+size_t timewheel_execute (timewheel_t *self, int64_t now);
+
+size_t timewheel_size (timewheel_t *self);
+
+void timewheel_test (bool verbose);
+
+#endif
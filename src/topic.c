@@ -0,0 +1,128 @@
+#include "mql_classes.h"
+
+struct _topic_t {
+    uint32_t *ids;
+    size_t size;
+    size_t capacity;
+};
+
+topic_t *topic_new () {
+    topic_t *self = (topic_t *) zmalloc (sizeof (topic_t));
+    assert (self);
+
+    return self;
+}
+
+void topic_destroy (topic_t **self_p) {
+    assert (self_p);
+    topic_t *self = *self_p;
+
+    if (self) {
+        free (self->ids);
+
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+//  Index of the id, or where it would be inserted
+static size_t
+topic_search (topic_t *self, uint32_t id) {
+    size_t low = 0;
+    size_t high = self->size;
+
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (self->ids[middle] < id)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+bool topic_subscribe (topic_t *self, uint32_t id) {
+    assert (self);
+
+    size_t index = topic_search (self, id);
+    if (index < self->size && self->ids[index] == id)
+        return false;
+
+    if (self->size == self->capacity) {
+        self->capacity = self->capacity ? self->capacity * 2 : 8;
+        self->ids = (uint32_t *) realloc (self->ids, self->capacity * sizeof (uint32_t));
+        assert (self->ids);
+    }
+
+    memmove (&self->ids[index + 1], &self->ids[index], (self->size - index) * sizeof (uint32_t));
+    self->ids[index] = id;
+    self->size++;
+
+    return true;
+}
+
+bool topic_unsubscribe (topic_t *self, uint32_t id) {
+    assert (self);
+
+    size_t index = topic_search (self, id);
+    if (index == self->size || self->ids[index] != id)
+        return false;
+
+    memmove (&self->ids[index], &self->ids[index + 1], (self->size - index - 1) * sizeof (uint32_t));
+    self->size--;
+
+    return true;
+}
+
+bool topic_subscribed (topic_t *self, uint32_t id) {
+    assert (self);
+
+    size_t index = topic_search (self, id);
+    return index < self->size && self->ids[index] == id;
+}
+
+size_t topic_size (topic_t *self) {
+    assert (self);
+    return self->size;
+}
+
+const uint32_t *topic_ids (topic_t *self) {
+    assert (self);
+    return self->ids;
+}
+
+void topic_test (bool verbose) {
+    printf (" * topic: ");
+
+    topic_t *self = topic_new ();
+    assert (topic_size (self) == 0);
+
+    //  Out of order and duplicated subscriptions
+    uint32_t ids[] = { 7, 3, 100000, 3, 0, 42, 7 };
+    size_t added = 0;
+    for (size_t i = 0; i < sizeof (ids) / sizeof (ids[0]); i++)
+        added += topic_subscribe (self, ids[i]);
+    assert (added == 5);
+    assert (topic_size (self) == 5);
+
+    const uint32_t *sorted = topic_ids (self);
+    for (size_t i = 1; i < topic_size (self); i++)
+        assert (sorted[i - 1] < sorted[i]);
+
+    assert (topic_subscribed (self, 42));
+    assert (topic_unsubscribe (self, 42));
+    assert (!topic_unsubscribe (self, 42));
+    assert (!topic_subscribed (self, 42));
+    assert (!topic_subscribed (self, 43));
+
+    //  Large fan-out
+    for (uint32_t id = 0; id < 100000; id++)
+        topic_subscribe (self, id);
+    assert (topic_size (self) == 100001);
+    assert (topic_ids (self)[100000] == 100000);
+
+    topic_destroy (&self);
+
+    printf ("OK\n");
+}
@@ -0,0 +1,29 @@
+#ifndef TOPIC_H_INCLUDED
+#define TOPIC_H_INCLUDED
+
+#include "mql_classes.h"
+
+typedef struct _topic_t topic_t;
+
+//  Subscribers of a topic, a sorted array of mailbox ids
+
+topic_t *topic_new ();
+
+void topic_destroy (topic_t **self_p);
+
+//  Return false if already subscribed
+bool topic_subscribe (topic_t *self, uint32_t id);
+
+//  Return false if not subscribed
+bool topic_unsubscribe (topic_t *self, uint32_t id);
+
+bool topic_subscribed (topic_t *self, uint32_t id);
+
+size_t topic_size (topic_t *self);
+
+//  Ids of the subscribers in ascending order, valid until the topic changes
+const uint32_t *topic_ids (topic_t *self);
+
+void topic_test (bool verbose);
+
+#endif
@@ -0,0 +1,180 @@
+#include "mql_classes.h"
+
+//  Slots of the keep time, each with the most invocations in flight during it
+#define WARMER_SLOTS 30
+
+struct _warmer_t {
+    size_t min_warm;
+    bucket_t *budget;           //  Warm invocations which can still be spent
+    int64_t slot_time;          //  Milliseconds of a slot
+    int64_t slot;               //  Current slot, by time
+    size_t peaks[WARMER_SLOTS];
+    size_t inflight;
+    size_t warming;             //  Warm invocations in flight
+    size_t demand;              //  Demand of the previous plan
+};
+
+warmer_t *warmer_new (size_t min_warm, double budget, int64_t keep, int64_t now) {
+    assert (keep >= WARMER_SLOTS);
+
+    warmer_t *self = (warmer_t *) zmalloc (sizeof (warmer_t));
+    assert (self);
+
+    self->min_warm = min_warm;
+    self->budget = bucket_new (budget, budget);
+    self->slot_time = keep / WARMER_SLOTS;
+    self->slot = now / self->slot_time;
+
+    return self;
+}
+
+void warmer_destroy (warmer_t **self_p) {
+    assert (self_p);
+    warmer_t *self = *self_p;
+
+    if (self) {
+        bucket_destroy (&self->budget);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+//  Move to the slot of now, the containers still busy are warm in the new slots
+static void
+warmer_advance (warmer_t *self, int64_t now) {
+    int64_t slot = now / self->slot_time;
+    if (slot - self->slot > WARMER_SLOTS)
+        self->slot = slot - WARMER_SLOTS;
+
+    while (self->slot < slot) {
+        self->slot++;
+        self->peaks[self->slot % WARMER_SLOTS] = self->inflight;
+    }
+}
+
+void warmer_started (warmer_t *self, int64_t now) {
+    assert (self);
+    warmer_advance (self, now);
+
+    self->inflight++;
+    size_t *peak = &self->peaks[self->slot % WARMER_SLOTS];
+    if (self->inflight > *peak)
+        *peak = self->inflight;
+}
+
+void warmer_completed (warmer_t *self, int64_t now) {
+    assert (self);
+    assert (self->inflight > 0);
+    warmer_advance (self, now);
+
+    self->inflight--;
+}
+
+void warmer_warmed (warmer_t *self, int64_t now) {
+    assert (self);
+    assert (self->warming > 0);
+
+    self->warming--;
+    warmer_completed (self, now);
+}
+
+size_t warmer_warm (warmer_t *self, int64_t now) {
+    assert (self);
+    warmer_advance (self, now);
+
+    size_t warm = 0;
+    for (int index = 0; index < WARMER_SLOTS; index++)
+        if (self->peaks[index] > warm)
+            warm = self->peaks[index];
+
+    return warm;
+}
+
+size_t warmer_inflight (warmer_t *self) {
+    assert (self);
+    return self->inflight;
+}
+
+size_t warmer_plan (warmer_t *self, size_t queued, size_t limit, int64_t now) {
+    assert (self);
+
+    //  A growing demand is expected to grow as much by the next call
+    size_t demand = self->inflight - self->warming + queued;
+    size_t forecast = demand > self->demand ? 2 * demand - self->demand : demand;
+    self->demand = demand;
+
+    size_t target = forecast > self->min_warm ? forecast : self->min_warm;
+    size_t warm = warmer_warm (self, now);
+    size_t count = 0;
+
+    while (warm + count < target && count < limit && bucket_take (self->budget, now))
+        count++;
+
+    for (size_t index = 0; index < count; index++)
+        warmer_started (self, now);
+    self->warming += count;
+
+    return count;
+}
+
+void warmer_test (bool verbose) {
+    printf (" * warmer: ");
+
+    int64_t now = 1000000;
+    warmer_t *self = warmer_new (2, 5, 30000, now);
+    assert (warmer_warm (self, now) == 0);
+
+    //  The minimum is kept warm
+    assert (warmer_plan (self, 0, SIZE_MAX, now) == 2);
+    assert (warmer_inflight (self) == 2);
+    assert (warmer_warm (self, now) == 2);
+    warmer_warmed (self, now + 100);
+    warmer_warmed (self, now + 100);
+    assert (warmer_plan (self, 0, SIZE_MAX, now + 1000) == 0);
+
+    //  Real invocations warm containers too
+    now += 1000;
+    for (int index = 0; index < 4; index++)
+        warmer_started (self, now);
+    for (int index = 0; index < 4; index++)
+        warmer_completed (self, now + 50);
+    assert (warmer_warm (self, now + 50) == 4);
+
+    //  A growing backlog is warmed ahead, as much as it grew
+    assert (warmer_plan (self, 3, SIZE_MAX, now + 1000) == 2);
+    warmer_warmed (self, now + 1100);
+    warmer_warmed (self, now + 1100);
+    assert (warmer_warm (self, now + 1100) == 4);
+    assert (warmer_plan (self, 3, SIZE_MAX, now + 2000) == 0);
+
+    //  Within the budget
+    assert (warmer_plan (self, 9, SIZE_MAX, now + 3000) == 5);
+    assert (warmer_inflight (self) == 5);
+    while (warmer_inflight (self) > 0)
+        warmer_warmed (self, now + 3100);
+    assert (warmer_warm (self, now + 3100) == 5);
+
+    //  No more than the invocations which can start, the budget is kept
+    assert (warmer_plan (self, 0, 3, now + 4000) == 0);
+    assert (warmer_plan (self, 9, 1, now + 4000) == 1);
+    assert (warmer_inflight (self) == 1);
+    assert (warmer_plan (self, 9, SIZE_MAX, now + 4000) > 0);
+    while (warmer_inflight (self) > 0)
+        warmer_warmed (self, now + 4100);
+
+    //  Idle containers go cold after the keep time, except for the minimum
+    now += 40000;
+    assert (warmer_warm (self, now) == 0);
+    assert (warmer_plan (self, 0, SIZE_MAX, now) == 2);
+    while (warmer_inflight (self) > 0)
+        warmer_warmed (self, now);
+
+    //  Long idle periods are skipped
+    now += 1000000000;
+    assert (warmer_warm (self, now) == 0);
+
+    warmer_destroy (&self);
+    assert (self == NULL);
+
+    printf ("OK\n");
+}
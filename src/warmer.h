@@ -0,0 +1,41 @@
+#ifndef WARMER_H_INCLUDED
+#define WARMER_H_INCLUDED
+
+#include "mql_classes.h"
+
+typedef struct _warmer_t warmer_t;
+
+//  Subject of the invocations which only warm a container
+#define WARMER_SUBJECT "$warm"
+
+//  Estimate of the warm containers of a function, the most invocations in
+//  flight at once within the time lambda keeps an idle container, and of the
+//  containers needed ahead of the demand
+
+//  Keep at least min_warm containers warm, spending at most budget warm
+//  invocations per second, a container stays warm keep milliseconds
+warmer_t *warmer_new (size_t min_warm, double budget, int64_t keep, int64_t now);
+
+void warmer_destroy (warmer_t **self_p);
+
+//  Count an invocation starting, or completing
+void warmer_started (warmer_t *self, int64_t now);
+
+void warmer_completed (warmer_t *self, int64_t now);
+
+//  Count a warm invocation completing
+void warmer_warmed (warmer_t *self, int64_t now);
+
+//  Containers estimated warm
+size_t warmer_warm (warmer_t *self, int64_t now);
+
+size_t warmer_inflight (warmer_t *self);
+
+//  Warm invocations to start now for the queued messages, they are counted
+//  as started, no more than limit. Called at a regular interval, the demand
+//  is extrapolated from the previous call.
+size_t warmer_plan (warmer_t *self, size_t queued, size_t limit, int64_t now);
+
+void warmer_test (bool verbose);
+
+#endif